@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/Disassemble8080.h"
+#include "../src/stats.h"
+
+/*  Benchmark for the disassembler.
+    Checks every opcode first: the text fits DISASM_TEXT_SIZE, ends in the
+    operand bytes high byte first, and the length is 1 to 3. Then sweeps
+    64K of random code repeatedly, into a buffer with disassemble8080 and
+    through the printing Disassemble8080Op with stdout sent to /dev/null,
+    the only way to get a disassembly before the table.
+*/
+
+#define SWEEPS 100
+#define PRINT_SWEEPS 5
+#define CODE_SIZE 0x10000
+
+static uint8_t code[CODE_SIZE + 2];
+
+/**
+ * @brief checks the table for every opcode
+ *
+ * @return int number of bad opcodes
+ */
+int check_table() {
+    int bad = 0;
+    for (int op = 0; op < 256; op++) {
+        uint8_t bytes[3] = { op, 0x34, 0x12 };
+        char text[DISASM_TEXT_SIZE + 8];
+        memset(text, 0x7f, sizeof(text));
+        int length = disassemble8080(bytes, text);
+        size_t size = strlen(text);
+        const char *operand = length == 3 ? "1234" : length == 2 ? "34" : "";
+        if (length < 1 || length > 3 || size >= DISASM_TEXT_SIZE ||
+            size < strlen(operand) || strcmp(text + size - strlen(operand), operand) != 0) {
+            printf("bad entry for opcode %02x: \"%s\", %d bytes\n", op, text, length);
+            bad++;
+        }
+    }
+    return bad;
+}
+
+int main(void) {
+    int bad = check_table();
+    printf("table check: %d bad opcodes\n", bad);
+
+    srand(8080);
+    for (int i = 0; i < CODE_SIZE; i++)
+        code[i] = rand();
+
+    char text[DISASM_TEXT_SIZE];
+    volatile char sink;
+    long instructions = 0;
+    double start = now_seconds();
+    for (int sweep = 0; sweep < SWEEPS; sweep++) {
+        for (int pc = 0; pc < CODE_SIZE; instructions++) {
+            pc += disassemble8080(&code[pc], text);
+            sink = text[0];
+        }
+    }
+    double buffered = now_seconds() - start;
+
+    fflush(stdout);
+    FILE *console = fdopen(dup(fileno(stdout)), "w");
+    freopen("/dev/null", "w", stdout);
+    long printed = 0;
+    start = now_seconds();
+    for (int sweep = 0; sweep < PRINT_SWEEPS; sweep++)
+        for (int pc = 0; pc < CODE_SIZE; printed++)
+            pc += Disassemble8080Op(code, pc);
+    fflush(stdout);
+    double printing = now_seconds() - start;
+
+    fprintf(console, "disassemble8080 into a buffer: %8.1f M instructions/s\n", instructions / buffered / 1e6);
+    fprintf(console, "Disassemble8080Op to stdout:   %8.1f M instructions/s\n", printed / printing / 1e6);
+    fclose(console);
+    return bad != 0;
+}
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include "../src/8080.h"
+#include "../src/stats.h"
+
+/*  Microbenchmark for the flag engine.
+    Times the table-driven add/subtract/cmp in 8080.h against the previous
+    implementation (bitfield condition codes, parity computed by looping over
+    the 8 bits), after checking that both produce the same flags for every
+    input.
+*/
+
+#define ITERATIONS 50000000
+#define INPUTS 4096 // must be a power of two
+
+typedef struct ConditionCodes {
+    uint8_t z:1; // zero
+    uint8_t s:1; // sign
+    uint8_t p:1; // parity
+    uint8_t cy:1; // carry
+    uint8_t ac:1; // auxiliary carry
+    uint8_t pad:3; // data
+} ConditionCodes;
+
+static inline bool ref_parity(uint8_t value) {
+    uint8_t one_bits = 0;
+    for (int i = 0; i < 8; i++) {
+        one_bits += ((value >> i) & 1);
+    }
+    return (one_bits & 1) == 0;
+}
+
+static inline void ref_update_zsp(ConditionCodes *cc, uint8_t value) {
+    cc->z = (value == 0);
+    cc->s = (value >> 7);
+    cc->p = ref_parity(value);
+}
+
+static inline bool ref_carry(int bit_no, uint8_t a, uint8_t b, bool cy) {
+    int16_t result = a + b + cy;
+    int16_t carry = result ^ a ^ b;
+    return carry & (1 << bit_no);
+}
+
+static inline void ref_add(ConditionCodes *cc, uint8_t *reg, uint8_t val, bool cy) {
+    uint8_t sum = *reg + val + cy;
+    ref_update_zsp(cc, sum);
+    cc->cy = ref_carry(8, *reg, val, cy);
+    cc->ac = ref_carry(4, *reg, val, cy);
+    *reg = sum;
+}
+
+static inline void ref_subtract(ConditionCodes *cc, uint8_t *reg, uint8_t val, bool cy) {
+    ref_add(cc, reg, ~val, !cy);
+    cc->cy = !cc->cy;
+}
+
+static inline void ref_cmp(ConditionCodes *cc, uint8_t a, uint8_t value) {
+    int16_t result = a - value;
+    cc->cy = result >> 8;
+    ref_update_zsp(cc, result & 0xFF);
+}
+
+static inline uint8_t pack(ConditionCodes cc) {
+    return (cc.s << 7) | (cc.z << 6) | (cc.ac << 4) | (cc.p << 2) | FLAG_ONE | cc.cy;
+}
+
+/**
+ * @brief checks the table-driven flags against the reference for every input
+ * 
+ * @return int number of mismatches
+ */
+int cross_check() {
+    int mismatches = 0;
+    State8080 state = {0};
+    for (int a = 0; a < 256; a++) {
+        for (int v = 0; v < 256; v++) {
+            for (int cy = 0; cy < 2; cy++) {
+                ConditionCodes cc = {0};
+                uint8_t ref_a = a, new_a = a;
+
+                ref_add(&cc, &ref_a, v, cy);
+                add(&state, &new_a, v, cy);
+                mismatches += (ref_a != new_a) || (pack(cc) != state.f);
+
+                ref_a = new_a = a;
+                ref_subtract(&cc, &ref_a, v, cy);
+                subtract(&state, &new_a, v, cy);
+                mismatches += (ref_a != new_a) || (pack(cc) != state.f);
+            }
+            // the previous cmp never set ac, so only s, z, p and cy are compared
+            ConditionCodes cc = {0};
+            ref_cmp(&cc, a, v);
+            state.a = a;
+            cmp(&state, v);
+            mismatches += (pack(cc) & ~FLAG_AC) != (state.f & ~FLAG_AC);
+        }
+    }
+    return mismatches;
+}
+
+int main(void) {
+    int mismatches = cross_check();
+    printf("cross-check: %d mismatches\n", mismatches);
+
+    uint8_t *inputs = malloc(INPUTS);
+    srand(8080);
+    for (int i = 0; i < INPUTS; i++)
+        inputs[i] = rand();
+
+    volatile uint8_t sink;
+
+    double start = now_seconds();
+    ConditionCodes cc = {0};
+    uint8_t a = 0;
+    for (int i = 0; i < ITERATIONS; i++) {
+        uint8_t v = inputs[i & (INPUTS - 1)];
+        ref_add(&cc, &a, v, cc.cy);
+        ref_subtract(&cc, &a, v >> 1, cc.cy);
+        ref_cmp(&cc, a, v);
+    }
+    sink = pack(cc) ^ a;
+    double reference = now_seconds() - start;
+
+    start = now_seconds();
+    State8080 state = {0};
+    for (int i = 0; i < ITERATIONS; i++) {
+        uint8_t v = inputs[i & (INPUTS - 1)];
+        add(&state, &state.a, v, state.f & FLAG_CY);
+        subtract(&state, &state.a, v >> 1, state.f & FLAG_CY);
+        cmp(&state, v);
+    }
+    sink = state.f ^ state.a;
+    double table = now_seconds() - start;
+
+    double ops = ITERATIONS * 3.0;
+    printf("bitfield + parity loop: %6.2f ns/op\n", reference / ops * 1e9);
+    printf("packed PSW + ZSP table: %6.2f ns/op\n", table / ops * 1e9);
+    printf("speedup: %.2fx\n", reference / table);
+
+    free(inputs);
+    return mismatches != 0;
+}
@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../src/8080.h"
+#include "../src/stats.h"
+
+/*  Check and microbenchmark for the memory map in the store path.
+    Checks that stores into ROM are dropped, that the 0x4000+ mirrors land
+    on RAM for both loads and stores, that mirrored stores mark the dirty
+    map and that the write hook sees mapped addresses. Then times the
+    masked write_memory against the previous unmasked store over the same
+    addresses, and a store-heavy 8080 loop on the core with a flat 64K,
+    with the Space Invaders map, and with a write hook installed.
+*/
+
+#define ITERATIONS 100000000
+#define ADDRESSES 4096 // must be a power of two
+#define CORE_CYCLES 200000000
+#define CORE_RUNS 5 // best of, the loop is short enough to be noisy
+
+#define ROM_END 0x2000
+#define MASK 0x3fff
+#define DIRTY_BASE 0x2400
+
+/**
+ * @brief the store before the memory map: dirty tracking only
+ */
+static inline void ref_write_memory(State8080 *state, uint16_t address, uint8_t value) {
+    if (state->dirty_map && address >= state->dirty_base && state->memory[address] != value) {
+        uint16_t offset = address - state->dirty_base;
+        state->dirty_map[offset >> 3] |= 1 << (offset & 7);
+    }
+    state->memory[address] = value;
+}
+
+static long hook_calls;
+static uint16_t hook_address;
+
+static void count_store(void *context, uint16_t address, uint8_t value) {
+    hook_calls++;
+    hook_address = address;
+}
+
+static State8080 *new_cpu(uint16_t mask, uint16_t rom_end, uint8_t *dirty) {
+    State8080 *state = Init8080();
+    state->pc = 0;
+    state->sp = 0;
+    state->address_mask = mask;
+    state->rom_end = rom_end;
+    state->dirty_map = dirty;
+    state->dirty_base = DIRTY_BASE;
+    return state;
+}
+
+/**
+ * @brief checks the map
+ *
+ * @return int number of failed checks
+ */
+int check_map() {
+    static uint8_t dirty[(0x4000 - DIRTY_BASE) / 8];
+    State8080 *state = new_cpu(MASK, ROM_END, dirty);
+    int failed = 0;
+
+    state->memory[0x0100] = 0xaa;
+    write_memory(state, 0x0100, 0x55);
+    write_memory(state, 0x4100, 0x55);
+    failed += state->memory[0x0100] != 0xaa;
+    failed += state->memory[0x4100] != 0;
+
+    write_memory(state, 0x6010, 0x42);
+    failed += state->memory[0x2010] != 0x42;
+    failed += state->memory[0x6010] != 0;
+    failed += read_memory(state, 0xe010) != 0x42;
+
+    write_memory(state, 0x6400, 0x01);
+    failed += (dirty[0] & 1) == 0;
+
+    state->write_hook = count_store;
+    write_memory(state, 0xa123, 7);
+    write_memory(state, 0x0123, 7);
+    failed += hook_calls != 1 || hook_address != 0x2123;
+
+    free(state->memory);
+    free(state);
+    return failed;
+}
+
+/*  LXI H,2400; LXI SP,3000; then forever: MOV M,A; INX H; PUSH B; POP B;
+    INR A; keep H in 0x20-0x3F; JMP. Two stores and a two byte load every
+    eight instructions, like the game's RAM heavy loops.
+*/
+static const uint8_t STORE_LOOP[] = {
+    0x21, 0x00, 0x24,
+    0x31, 0x00, 0x30,
+    0x77,
+    0x23,
+    0xc5,
+    0xc1,
+    0x3c,
+    0x7c, 0xe6, 0x1f, 0xf6, 0x20, 0x67,
+    0xc3, 0x06, 0x00
+};
+
+/**
+ * @brief runs the store loop on the core
+ *
+ * @return double emulated MHz of the fastest run
+ */
+double time_core(uint16_t mask, uint16_t rom_end, WriteHook8080 hook) {
+    static uint8_t dirty[(0x10000 - DIRTY_BASE) / 8]; // flat runs are not masked
+    double best = 0;
+    for (int run = 0; run < CORE_RUNS; run++) {
+        State8080 *state = new_cpu(mask, rom_end, dirty);
+        state->write_hook = hook;
+        memcpy(state->memory, STORE_LOOP, sizeof(STORE_LOOP));
+        double start = now_seconds();
+        emulate8080_run(state, CORE_CYCLES);
+        double mhz = CORE_CYCLES / (now_seconds() - start) / 1e6;
+        if (mhz > best)
+            best = mhz;
+        free(state->memory);
+        free(state);
+    }
+    return best;
+}
+
+int main(void) {
+    int failed = check_map();
+    printf("map check: %d failed\n", failed);
+
+    // mostly RAM and VRAM, some into the mirror and a few into ROM
+    uint16_t *addresses = malloc(ADDRESSES * sizeof(uint16_t));
+    srand(8080);
+    for (int i = 0; i < ADDRESSES; i++) {
+        int r = rand() % 100;
+        addresses[i] = r < 90 ? 0x2000 + rand() % 0x2000 : r < 98 ? 0x6000 + rand() % 0x2000 : rand() % 0x2000;
+    }
+
+    static uint8_t dirty[(0x4000 - DIRTY_BASE) / 8];
+    static uint8_t flat_dirty[(0x10000 - DIRTY_BASE) / 8]; // unmasked stores reach the mirrors
+    volatile uint8_t sink;
+
+    State8080 *flat = new_cpu(0xffff, 0, flat_dirty);
+    double start = now_seconds();
+    for (int i = 0; i < ITERATIONS; i++)
+        ref_write_memory(flat, addresses[i & (ADDRESSES - 1)], i);
+    double reference = now_seconds() - start;
+    sink = flat->memory[0x2000];
+
+    State8080 *mapped = new_cpu(MASK, ROM_END, dirty);
+    start = now_seconds();
+    for (int i = 0; i < ITERATIONS; i++)
+        write_memory(mapped, addresses[i & (ADDRESSES - 1)], i);
+    double masked = now_seconds() - start;
+    sink = mapped->memory[0x2000];
+
+    printf("unmasked store:         %6.2f ns/store\n", reference / ITERATIONS * 1e9);
+    printf("masked store, ROM drop: %6.2f ns/store\n", masked / ITERATIONS * 1e9);
+
+    printf("store loop, flat 64K:          %8.1f MHz\n", time_core(0xffff, 0, NULL));
+    printf("store loop, invaders map:      %8.1f MHz\n", time_core(MASK, ROM_END, NULL));
+    printf("store loop, map and write hook:%8.1f MHz\n", time_core(MASK, ROM_END, count_store));
+
+    free(addresses);
+    free(flat->memory);
+    free(flat);
+    free(mapped->memory);
+    free(mapped);
+    return failed != 0;
+}
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include "../src/video.h"
+#include "../src/stats.h"
+
+/*  Benchmark and golden-output check for the video conversion kernels.
+    Every available block kernel is checked pixel by pixel against the VRAM
+    layout at scales 1 to 4, then timed converting whole frames at scale 2
+    against the per-pixel conversion render() used before the kernels.
+*/
+
+#define FRAMES 2000
+#define MAX_SCALE 4
+
+uint8_t vram[VRAM_SIZE];
+uint32_t image[SCREEN_HEIGHT * MAX_SCALE * (SCREEN_WIDTH * MAX_SCALE + 8)];
+
+/**
+ * @brief the conversion render() did before the block kernels: rotate into two 
+ * bool arrays, then write every scaled pixel
+ */
+void old_render(const uint8_t *vram, uint32_t *dst, int pitch, int scale) {
+    bool rotated_screen[224][256];
+    bool fixed_screen[256][224];
+
+    for (int y = 0; y < SCREEN_WIDTH; y++)
+        for (int x = 0; x < SCREEN_HEIGHT; x++)
+            rotated_screen[y][x] = vram[x / 8 + y * SCREEN_HEIGHT / 8] & (1 << (x & 7));
+
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            fixed_screen[y][x] = rotated_screen[x][SCREEN_HEIGHT - 1 - y];
+            for (int i = y * scale; i < (y * scale) + scale; i++)
+                for (int j = x * scale; j < (x * scale) + scale; j++)
+                    dst[i * pitch + j] = fixed_screen[y][x] ? PIXEL_ON : PIXEL_OFF;
+        }
+    }
+}
+
+/**
+ * @brief checks a converted image pixel by pixel against VRAM
+ * 
+ * @return int number of wrong pixels
+ */
+int check_image(const uint32_t *dst, int pitch, int scale) {
+    int wrong = 0;
+    for (int y = 0; y < SCREEN_HEIGHT * scale; y++) {
+        for (int x = 0; x < SCREEN_WIDTH * scale; x++) {
+            int source_y = SCREEN_HEIGHT - 1 - y / scale;
+            bool on = vram[(x / scale) * BLOCK_ROWS + source_y / 8] & (1 << (source_y & 7));
+            wrong += dst[y * pitch + x] != (on ? PIXEL_ON : PIXEL_OFF);
+        }
+    }
+    return wrong;
+}
+
+typedef struct Kernel {
+    const char *name;
+    VideoBlockKernel kernel;
+    bool supported;
+} Kernel;
+
+int main(void) {
+    srand(8080);
+    for (int i = 0; i < VRAM_SIZE; i++)
+        vram[i] = rand();
+
+#ifdef VIDEO_HAVE_X86
+    __builtin_cpu_init();
+    Kernel kernels[] = {
+        { "scalar", video_block_scalar, true },
+        { "sse2", video_block_sse2, __builtin_cpu_supports("sse2") },
+        { "avx2", video_block_avx2, __builtin_cpu_supports("avx2") },
+    };
+#else
+    Kernel kernels[] = {
+        { "scalar", video_block_scalar, true },
+    };
+#endif
+    int kernel_count = sizeof(kernels) / sizeof(kernels[0]);
+
+    int failures = 0;
+    for (int k = 0; k < kernel_count; k++) {
+        if (!kernels[k].supported)
+            continue;
+        for (int scale = 1; scale <= MAX_SCALE; scale++) {
+            int pitch = SCREEN_WIDTH * scale + 8; // padded rows catch pitch mistakes
+            memset(image, 0xaa, sizeof(image));
+            video_convert_frame(kernels[k].kernel, vram, image, pitch, scale);
+            int wrong = check_image(image, pitch, scale);
+            if (wrong) {
+                printf("%s scale %d: %d wrong pixels\n", kernels[k].name, scale, wrong);
+                failures++;
+            }
+        }
+    }
+    printf("golden check: %s\n", failures ? "FAILED" : "ok");
+
+    int scale = 2, pitch = SCREEN_WIDTH * scale;
+    double start = now_seconds();
+    for (int i = 0; i < FRAMES; i++)
+        old_render(vram, image, pitch, scale);
+    double old_time = now_seconds() - start;
+    printf("%-8s %8.1f us/frame\n", "render", old_time / FRAMES * 1e6);
+
+    for (int k = 0; k < kernel_count; k++) {
+        if (!kernels[k].supported)
+            continue;
+        start = now_seconds();
+        for (int i = 0; i < FRAMES; i++)
+            video_convert_frame(kernels[k].kernel, vram, image, pitch, scale);
+        double time = now_seconds() - start;
+        printf("%-8s %8.1f us/frame (%.1fx)\n", kernels[k].name, time / FRAMES * 1e6, old_time / time);
+    }
+    return failures != 0;
+}
@@ -2,18 +2,41 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "Disassemble8080.h"
+#include "trace.h"
 
 #define FOR_CPUDIAG false
-#define DEBUG true
 
-typedef struct ConditionCodes {    
-    uint8_t z:1; // zero
-    uint8_t s:1; // sign
-    uint8_t p:1; // parity
-    uint8_t cy:1; // carry
-    uint8_t ac:1; // auxiliary carry
-    uint8_t pad:3; // data
-} ConditionCodes;    
+/*  Condition flags are kept packed in the PSW layout used by PUSH PSW/POP PSW:
+    bit 7 S, bit 6 Z, bit 4 AC, bit 2 P, bit 1 always 1, bit 0 CY
+*/
+#define FLAG_S 0x80 // sign
+#define FLAG_Z 0x40 // zero
+#define FLAG_AC 0x10 // auxiliary carry
+#define FLAG_P 0x04 // parity
+#define FLAG_ONE 0x02 // always reads as 1
+#define FLAG_CY 0x01 // carry
+
+#define MAX_EVENTS 4
+
+/*  An interrupt raised when the cycle counter reaches `at`, then every 
+    `period` cycles after that (or only once if period is 0).
+*/
+typedef struct Event8080 {
+    uint64_t at;
+    uint32_t period;
+    uint8_t interrupt; // RST number
+} Event8080;
+
+/*  I/O port handlers installed by the machine. IN and OUT call them 
+    directly from the core, passing the machine's io_context.
+*/
+typedef uint8_t (*PortIn8080)(void *context, uint8_t port);
+typedef void (*PortOut8080)(void *context, uint8_t port, uint8_t value);
+
+/*  Called before a store lands, with the address already mapped. Used by the
+    debugger for write watchpoints; NULL in normal runs.
+*/
+typedef void (*WriteHook8080)(void *context, uint16_t address, uint8_t value);
 
 typedef struct State8080 {
     uint8_t a;
@@ -26,10 +49,22 @@ typedef struct State8080 {
     uint16_t sp;
     uint16_t pc;
     uint8_t *memory; // array of bytes
-    struct ConditionCodes cc;
+    uint8_t f; // condition flags (PSW layout)
     uint8_t int_enable;
     uint8_t halted;
-    uint16_t cycles;
+    uint64_t cycles; // total cycles executed since reset
+    struct Event8080 events[MAX_EVENTS]; // scheduled interrupts
+    uint8_t event_count;
+    PortIn8080 port_in; // IN handler, NULL if the machine has no ports
+    PortOut8080 port_out; // OUT handler
+    void *io_context; // passed to the port handlers
+    uint8_t *dirty_map; // one bit per byte from dirty_base up, set when a store changes it; NULL to disable
+    uint16_t dirty_base;
+    uint16_t address_mask; // address lines decoded, higher addresses mirror lower ones
+    uint16_t rom_end; // stores below this are dropped
+    WriteHook8080 write_hook; // NULL unless something watches stores
+    void *hook_context; // passed to write_hook
+    uint8_t untraced; // kept out of instruction and I/O traces, for shadow machines
 } State8080;
 
 static const uint8_t OPCODES_CYCLES[256] = {
@@ -52,6 +87,27 @@ static const uint8_t OPCODES_CYCLES[256] = {
     5, 10, 10, 4,  11, 11, 7,  11, 5, 5,  10, 4,  11, 17, 7, 11  // F
 };
 
+/* S, Z and P flags (plus the always-one bit) of every byte value */
+static const uint8_t ZSP_FLAGS[256] = {
+//  0     1     2     3     4     5     6     7     8     9     A     B     C     D     E     F
+    0x46, 0x02, 0x02, 0x06, 0x02, 0x06, 0x06, 0x02, 0x02, 0x06, 0x06, 0x02, 0x06, 0x02, 0x02, 0x06, // 0
+    0x02, 0x06, 0x06, 0x02, 0x06, 0x02, 0x02, 0x06, 0x06, 0x02, 0x02, 0x06, 0x02, 0x06, 0x06, 0x02, // 1
+    0x02, 0x06, 0x06, 0x02, 0x06, 0x02, 0x02, 0x06, 0x06, 0x02, 0x02, 0x06, 0x02, 0x06, 0x06, 0x02, // 2
+    0x06, 0x02, 0x02, 0x06, 0x02, 0x06, 0x06, 0x02, 0x02, 0x06, 0x06, 0x02, 0x06, 0x02, 0x02, 0x06, // 3
+    0x02, 0x06, 0x06, 0x02, 0x06, 0x02, 0x02, 0x06, 0x06, 0x02, 0x02, 0x06, 0x02, 0x06, 0x06, 0x02, // 4
+    0x06, 0x02, 0x02, 0x06, 0x02, 0x06, 0x06, 0x02, 0x02, 0x06, 0x06, 0x02, 0x06, 0x02, 0x02, 0x06, // 5
+    0x06, 0x02, 0x02, 0x06, 0x02, 0x06, 0x06, 0x02, 0x02, 0x06, 0x06, 0x02, 0x06, 0x02, 0x02, 0x06, // 6
+    0x02, 0x06, 0x06, 0x02, 0x06, 0x02, 0x02, 0x06, 0x06, 0x02, 0x02, 0x06, 0x02, 0x06, 0x06, 0x02, // 7
+    0x82, 0x86, 0x86, 0x82, 0x86, 0x82, 0x82, 0x86, 0x86, 0x82, 0x82, 0x86, 0x82, 0x86, 0x86, 0x82, // 8
+    0x86, 0x82, 0x82, 0x86, 0x82, 0x86, 0x86, 0x82, 0x82, 0x86, 0x86, 0x82, 0x86, 0x82, 0x82, 0x86, // 9
+    0x86, 0x82, 0x82, 0x86, 0x82, 0x86, 0x86, 0x82, 0x82, 0x86, 0x86, 0x82, 0x86, 0x82, 0x82, 0x86, // A
+    0x82, 0x86, 0x86, 0x82, 0x86, 0x82, 0x82, 0x86, 0x86, 0x82, 0x82, 0x86, 0x82, 0x86, 0x86, 0x82, // B
+    0x86, 0x82, 0x82, 0x86, 0x82, 0x86, 0x86, 0x82, 0x82, 0x86, 0x86, 0x82, 0x86, 0x82, 0x82, 0x86, // C
+    0x82, 0x86, 0x86, 0x82, 0x86, 0x82, 0x82, 0x86, 0x86, 0x82, 0x82, 0x86, 0x82, 0x86, 0x86, 0x82, // D
+    0x82, 0x86, 0x86, 0x82, 0x86, 0x82, 0x82, 0x86, 0x86, 0x82, 0x82, 0x86, 0x82, 0x86, 0x86, 0x82, // E
+    0x86, 0x82, 0x82, 0x86, 0x82, 0x86, 0x86, 0x82, 0x82, 0x86, 0x86, 0x82, 0x86, 0x82, 0x82, 0x86  // F
+};
+
 
 int ReadFileIntoMemoryAt(State8080* state, char* filename, uint32_t offset)
 {
@@ -62,11 +118,20 @@ int ReadFileIntoMemoryAt(State8080* state, char* filename, uint32_t offset)
 		exit(1);
 	}
 	fseek(f, 0L, SEEK_END);
-	int fsize = ftell(f);
+	long fsize = ftell(f);
 	fseek(f, 0L, SEEK_SET);
+	if (fsize <= 0 || offset + fsize > 0x10000)
+	{
+		printf("error: %s (%ld bytes) does not fit in memory at %04x\n", filename, fsize, offset);
+		exit(1);
+	}
 	
 	uint8_t *buffer = &state->memory[offset];
-	fread(buffer, fsize, 1, f);
+	if (fread(buffer, fsize, 1, f) != 1)
+	{
+		printf("error: Couldn't read %s\n", filename);
+		exit(1);
+	}
 	fclose(f);
 
     return fsize;
@@ -74,53 +139,64 @@ int ReadFileIntoMemoryAt(State8080* state, char* filename, uint32_t offset)
 
 
 /************************ CONDITION FLAGS UPDATERS ************************/
-/**
- * @brief checks the bit parity of a byte
- * 
- * @param value the byte to check parity of
- * @return true 
- * @return false 
- */
-static inline bool parity(uint8_t value) {
-    uint8_t one_bits = 0;
-    for (int i = 0; i < 8; i++) {
-        one_bits += ((value >> i) & 1);
-    }
-    return (one_bits & 1) == 0; // return 1 if even number of one bits, 0 if odd number of one bits
-}
 /**
  * @brief updates the z (zero), s (sign), and p (parity) condition bits
  * 
- * This function accepts a State8080 objct and an 8 bit value. It checks if 
- * the value equals zero, is negative, and whether the parity is even or odd. 
+ * This function accepts a State8080 objct and an 8 bit value. The z, s and p
+ * bits are looked up in ZSP_FLAGS, ac and cy are left untouched.
  * @param state the State8080 object
  * @param value the result of an operation
  */
 static inline void update_zsp(State8080 *state, uint8_t value) {
-    state->cc.z = (value == 0); // zero
-    state->cc.s = (value >> 7); // sign
-    state->cc.p = parity(value); // parity
+    state->f = (state->f & (FLAG_AC | FLAG_CY)) | ZSP_FLAGS[value];
 }
+
 /**
- * @brief updates the ac (auxiliary carry) condition bits
+ * @brief sets or clears the carry bit
  * 
- * This function accepts a State8080 objct and an 8 bit value. The auxiliary carry bit
- * is to be set if a carry from the 3rd bit to the 4th bit occurred as a result of 
- * an arithmetic operation. When called on the result of an arithmetic operation, this
- * function checks if the lower nibble of the byte is equal to zero. If so, an aux. carry
- * must have occurred.  
- * @param bit_no bit_no the bit to check for carry
- * @param a value 1
- * @param b value 2
- * @param cy whether to use carry in addition
+ * @param state the State8080 object
+ * @param cy the new carry (0 or 1)
  */
-static inline bool carry(int bit_no, uint8_t a, uint8_t b, bool cy) {
-  int16_t result = a + b + cy;
-  int16_t carry = result ^ a ^ b;
-  return carry & (1 << bit_no);
+static inline void set_carry(State8080 *state, uint8_t cy) {
+    state->f = (state->f & ~FLAG_CY) | cy;
 }
 
 /************************ LOAD/STORE/MOVE OPERATIONS ************************/
+/**
+ * @brief loads a byte from memory
+ * Data reads go through here and see the same mirrors as stores. Opcode 
+ * fetches index memory directly, code never runs from a mirror.
+ * @param state the State8080 object
+ * @param address the address to read
+ * @return uint8_t 
+ */
+static inline uint8_t read_memory(State8080 *state, uint16_t address) {
+    return state->memory[address & state->address_mask];
+}
+
+/**
+ * @brief stores a byte in memory
+ * Every store of the CPU goes through here. The address is masked into the 
+ * decoded range, so mirrors land on the RAM they alias, and stores into ROM 
+ * are dropped. Stores that change a byte at or above dirty_base are marked 
+ * in the dirty map, which the video uses to redraw only what changed.
+ * @param state the State8080 object
+ * @param address the address to write to
+ * @param value the byte to write
+ */
+static inline void write_memory(State8080 *state, uint16_t address, uint8_t value) {
+    address &= state->address_mask;
+    if (__builtin_expect(address < state->rom_end, 0))
+        return;
+    if (__builtin_expect(state->write_hook != NULL, 0))
+        state->write_hook(state->hook_context, address, value);
+    if (state->dirty_map && address >= state->dirty_base && state->memory[address] != value) {
+        uint16_t offset = address - state->dirty_base;
+        state->dirty_map[offset >> 3] |= 1 << (offset & 7);
+    }
+    state->memory[address] = value;
+}
+
 /**
  * @brief writes the specified 16-bit value to the BC register pair
  * 
@@ -202,7 +278,7 @@ static inline uint16_t read_hl(State8080 *state) {
  */
 static inline void stax_b(State8080 *state) {
     uint16_t address = read_bc(state);
-    state->memory[address] = state->a;
+    write_memory(state, address, state->a);
 }
 
 /**
@@ -213,7 +289,7 @@ static inline void stax_b(State8080 *state) {
  */
 static inline void stax_d(State8080 *state) {
     uint16_t address = read_de(state);
-    state->memory[address] = state->a;
+    write_memory(state, address, state->a);
 }
 
 /**
@@ -224,8 +300,8 @@ static inline void stax_d(State8080 *state) {
  */
 static inline void push(State8080 *state, uint16_t value) {
     state->sp -= 2;
-    state->memory[state->sp + 1] = value >> 8;
-    state->memory[state->sp] = value & 0xff;
+    write_memory(state, state->sp + 1, value >> 8);
+    write_memory(state, state->sp, value & 0xff);
     // printf("NOW ON STACK: %04x\n", (state->memory[state->sp + 1] << 8 | state->memory[state->sp]));
 }
 
@@ -235,7 +311,7 @@ static inline void push(State8080 *state, uint16_t value) {
  * @param state the State8080 object
  */
 static uint16_t pop(State8080 *state) {
-    uint16_t value = (state->memory[state->sp + 1] << 8) | state->memory[state->sp];
+    uint16_t value = (read_memory(state, state->sp + 1) << 8) | read_memory(state, state->sp);
     state->sp += 2;
     // printf("NOW ON STACK: %04x\n", (state->memory[state->sp + 1] << 8 | state->memory[state->sp]));
     return value;
@@ -258,8 +334,9 @@ static uint16_t pop(State8080 *state) {
  * @param state the State8080 object
  */
 static inline void dad_b(State8080 *state) {
-    state->cc.cy = ((read_hl(state) + (read_bc(state) >> 16)) & 1);
-    write_hl(state, read_hl(state) + read_bc(state));
+    uint32_t result = read_hl(state) + read_bc(state);
+    set_carry(state, result >> 16);
+    write_hl(state, result);
 }
 
 /**
@@ -269,8 +346,9 @@ static inline void dad_b(State8080 *state) {
  * @param state the State8080 object
  */
 static inline void dad_d(State8080 *state) {
-    state->cc.cy = (((read_hl(state) + (read_de(state))) >> 16) & 1);
-    write_hl(state, read_hl(state) + read_de(state));
+    uint32_t result = read_hl(state) + read_de(state);
+    set_carry(state, result >> 16);
+    write_hl(state, result);
 }
 
 /**
@@ -280,8 +358,9 @@ static inline void dad_d(State8080 *state) {
  * @param state the State8080 object
  */
 static inline void dad_h(State8080 *state) {
-    state->cc.cy = ((read_hl(state) + (read_hl(state) >> 16)) & 1);
-    write_hl(state, read_hl(state) + read_hl(state));
+    uint32_t result = read_hl(state) + read_hl(state);
+    set_carry(state, result >> 16);
+    write_hl(state, result);
 }
 
 /**
@@ -291,8 +370,9 @@ static inline void dad_h(State8080 *state) {
  * @param state the State8080 object
  */
 static inline void dad_sp(State8080 *state) {
-    state->cc.cy = ((read_hl(state) + (state->sp >> 16)) & 1);
-    write_hl(state, read_hl(state) + state->sp);
+    uint32_t result = read_hl(state) + state->sp;
+    set_carry(state, result >> 16);
+    write_hl(state, result);
 }
 
 /**
@@ -304,16 +384,25 @@ static inline void dad_sp(State8080 *state) {
  * @param cy optional carry bit to be used in addition
  */
 static inline void add(State8080 *state, uint8_t *reg, uint8_t val, bool cy) {
-    uint8_t sum = *reg + val + cy;
-    update_zsp(state, sum);
-    state->cc.cy = carry(8, *reg, val, cy);
-    state->cc.ac = carry(4, *reg, val, cy);
-    *reg = sum;
+    uint16_t result = *reg + val + cy;
+    // bit 4 of (a ^ b ^ sum) is the carry out of bit 3, which lines up with FLAG_AC,
+    // and bit 8 of the 9-bit sum is the carry, which lines up with FLAG_CY
+    state->f = ZSP_FLAGS[result & 0xff] | ((*reg ^ val ^ result) & FLAG_AC) | (result >> 8);
+    *reg = result;
 }
 
+/**
+ * @brief subtracts a byte and an optional borrow from a register
+ * The 8080 subtracts by adding the complement, so the ac bit is the carry of that
+ * addition and the carry bit is inverted to become a borrow.
+ * @param state the State8080 object
+ * @param reg pointer to the register that is being subtracted from
+ * @param val byte to subtract
+ * @param cy optional borrow bit to be used in subtraction
+ */
 static inline void subtract(State8080 *state, uint8_t *reg, uint8_t val, bool cy) {
     add(state, reg, ~val, !cy);
-    state->cc.cy = !state->cc.cy;
+    state->f ^= FLAG_CY;
 }
 
 /**
@@ -323,10 +412,71 @@ static inline void subtract(State8080 *state, uint8_t *reg, uint8_t val, bool cy
  * @param value the value to compare the accumulator to
  */
 static inline void cmp(State8080 *state, uint8_t value) {
-   int16_t result = state->a - value;
-    state->cc.cy = result >> 8;
-    state->cc.ac = ~(state->a ^ result ^ value) & 0x10;
-    update_zsp(state, result & 0xFF);
+    uint8_t a = state->a;
+    subtract(state, &a, value, 0);
+}
+
+/**
+ * @brief increments a byte, updating all flags except carry
+ * 
+ * @param state the State8080 object
+ * @param value the byte to increment
+ * @return uint8_t 
+ */
+static inline uint8_t inr(State8080 *state, uint8_t value) {
+    value++;
+    state->f = (state->f & FLAG_CY) | ZSP_FLAGS[value] | ((value & 0xf) == 0 ? FLAG_AC : 0);
+    return value;
+}
+
+/**
+ * @brief decrements a byte, updating all flags except carry
+ * 
+ * @param state the State8080 object
+ * @param value the byte to decrement
+ * @return uint8_t 
+ */
+static inline uint8_t dcr(State8080 *state, uint8_t value) {
+    value--;
+    state->f = (state->f & FLAG_CY) | ZSP_FLAGS[value] | ((value & 0xf) != 0xf ? FLAG_AC : 0);
+    return value;
+}
+
+
+/************************ LOGICAL OPERATIONS ************************/
+
+/**
+ * @brief ands the value into the accumulator
+ * Carry is cleared, ac is set from bit 3 of either operand.
+ * @param state the State8080 object
+ * @param value the value to and with the accumulator
+ */
+static inline void ana(State8080 *state, uint8_t value) {
+    uint8_t ac = ((state->a | value) & 0x08) << 1; // bit 3 moved to FLAG_AC
+    state->a &= value;
+    state->f = ZSP_FLAGS[state->a] | ac;
+}
+
+/**
+ * @brief exclusive-ors the value into the accumulator, clearing carry and ac
+ * 
+ * @param state the State8080 object
+ * @param value the value to xor with the accumulator
+ */
+static inline void xra(State8080 *state, uint8_t value) {
+    state->a ^= value;
+    state->f = ZSP_FLAGS[state->a];
+}
+
+/**
+ * @brief ors the value into the accumulator, clearing carry and ac
+ * 
+ * @param state the State8080 object
+ * @param value the value to or with the accumulator
+ */
+static inline void ora(State8080 *state, uint8_t value) {
+    state->a |= value;
+    state->f = ZSP_FLAGS[state->a];
 }
 
 
@@ -398,1365 +548,269 @@ static inline void generate_interrupt(State8080 *state, int interrupt_num) {
 
 
 
+/************************ TRACING ************************/
+
+/**
+ * @brief traces an instruction before it executes
+ * With the ring sink the pre-execution registers are recorded, with the 
+ * stdout sink the instruction is disassembled.
+ * @param state the State8080 object
+ */
+static inline void trace_before(State8080 *state) {
+    if (state->untraced)
+        return;
+    if (trace_sink == TRACE_SINK_RING) {
+        TraceEntry entry = {
+            .pc = state->pc, .sp = state->sp, .opcode = state->memory[state->pc],
+            .a = state->a, .flags = state->f,
+            .b = state->b, .c = state->c, .d = state->d,
+            .e = state->e, .h = state->h, .l = state->l
+        };
+        trace_record(&entry);
+    }
+    else
+        Disassemble8080Op(state->memory, state->pc);
+}
+
+/**
+ * @brief traces the processor state after an instruction executed
+ * 
+ * @param state the State8080 object
+ */
+static inline void trace_after(State8080 *state) {
+    if (trace_sink != TRACE_SINK_STDOUT || state->untraced)
+        return;
+    /* print out processor state */    
+    printf("\tCY=%d,P=%d,S=%d,Z=%d,AC=%d,INT_EN=%d\n", (state->f & FLAG_CY) != 0, (state->f & FLAG_P) != 0,    
+        (state->f & FLAG_S) != 0, (state->f & FLAG_Z) != 0, (state->f & FLAG_AC) != 0, state->int_enable);    
+    printf("\tAF $%02x%02x BC $%02x%02x DE $%02x%02x HL $%02x%02x SP %04x PC %04x\n",    
+        state->a, state->f, state->b, state->c, state->d,    
+        state->e, state->h, state->l, state->sp, state->pc);    
+}
+
 /**
  * @brief emulates an operation of the 8080 given its current state
  * 
  * @param state the State8080 object, or current state of the machine
- * @return int 
+ * @return int 1 if the instruction halted the CPU, 0 otherwise
  */
 int emulate8080Op(State8080 *state) {
     unsigned char *opcode = &state->memory[state->pc];
-    if(DEBUG)
-        Disassemble8080Op(state->memory, state->pc);   
+#if TRACE_LEVEL >= TRACE_INSTRUCTION
+    trace_before(state);
+#endif
     state->cycles += OPCODES_CYCLES[*opcode];
     // printf("OPCODE: %02x\n", *opcode); 
     switch(*opcode) 
     {
-        case 0x00: state->pc += 1; break; //    NOP
-        case 0x01:        //    LXI B, word
-        {
-            uint16_t value = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
-            write_bc(state, value);
-            state->pc += 3;
-            break;
-        }
-        case 0x02:        //    STAX B
-            stax_b(state);
-            state->pc += 1;
-            break;
-            
-        case 0x03:        //    INX B
-            state->c++;
-            if(state->c == 0)
-                state->b++;
-            state->pc += 1;
-            break;
-        case 0x04:        //    INR B
-            state->b++;
-            update_zsp(state, state->b);
-            state->cc.ac = (state->b & 0xf) == 0;
-            state->pc += 1;
-            break;
-        case 0x05:        //    DCR B
-            state->b--;
-            update_zsp(state, state->b);
-            state->cc.ac = !((state->b & 0xF) == 0xF);
-            state->pc += 1;
-            break;
-        case 0x06:        //    MVI B, byte
-            state->b = opcode[1];
-            state->pc += 2;
-            break;
-        case 0x07:        //    RLC
-            state->cc.cy = state->a >> 7; // set carry bit to high order bit (rotating left)
-            state->a = (state->a << 1) | (state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x08: state->pc += 1; break; //    *NOP
-        case 0x09:        //    DAD B
-            dad_b(state);
-            state->pc += 1;
-            break;
-        case 0x0a:        //    LDAX B
-            state->a = state->memory[read_bc(state)];
-            state->pc += 1;
-            break;
-        case 0x0b:        //    DCX B
-            write_bc(state, read_bc(state) - 1);
-            state->pc += 1;
-            break;
-        case 0x0c:        //    INR C
-            state->c++;
-            update_zsp(state, state->c);
-            state->cc.ac = (state->c & 0xf) == 0;
-            state->pc += 1;
-            break;
-        case 0x0d:        //    DCR C
-            state->c--;
-            update_zsp(state, state->c);
-            state->cc.ac = !((state->c & 0xF) == 0xF);
-            state->pc += 1;
-            break;
-        case 0x0e:        //    MVI C, byte
-            state->c = opcode[1];
-            state->pc += 2;
-            break;
-        case 0x0f:        //    RRC
-            state->cc.cy = state->a & 1;
-            state->a = (state->a >> 1) | (state->cc.cy << 7);
-            state->pc += 1;
-            break;
-        
-        case 0x10: state->pc += 1; break; //    NOP
-        case 0x11:        //    LXI D, word
-        {
-            uint16_t value = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
-            write_de(state, value);
-            state->pc += 3;
-            break;
-        }   
-        case 0x12:        //    STAX D
-            stax_d(state);
-            state->pc += 1;
-            break;
-        case 0x13:        //    INX D
-            write_de(state, read_de(state) + 1);
-            state->pc += 1;
-            break;
-        case 0x14:        //    INR D
-            state->d++;
-            update_zsp(state, state->d);
-            state->cc.ac = (state->d & 0xf) == 0;
-            state->pc += 1;
-            break;
-        case 0x15:        //    DCR D
-            state->d--;
-            update_zsp(state, state->d);
-            state->cc.ac = !((state->d & 0xF) == 0xF);
-            state->pc += 1;
-            break;
-        case 0x16:        //    MVI D, byte
-            state->d = opcode[1];
-            state->pc += 2;
-            break;
-        case 0x17:        //    RAL
-        {
-            bool cy = state->cc.cy;
-            state->cc.cy = (state->a >> 7);
-            state->a = (state->a << 1) | cy;
-            state->pc += 1;
-            break;
-        }    
-        case 0x18: state->pc += 1; break; //    *NOP
-        case 0x19:        //    DAD D
-            dad_d(state);
-            state->pc += 1;
-            break;
-        case 0x1a:        //    LDAX D
-            state->a = state->memory[read_de(state)];
-            state->pc += 1;
-            break;
-        case 0x1b:        //    DCX D
-            write_de(state, read_de(state) - 1);
-            state->pc += 1;
-            break;
-        case 0x1c:        //    INR E
-            state->e++;
-            update_zsp(state, state->e);
-            state->cc.ac = (state->e & 0xf) == 0;
-            state->pc += 1;
-            break;
-        case 0x1d:        //    DCR E
-            state->e--;
-            update_zsp(state, state->e);
-            state->cc.ac = !((state->e & 0xF) == 0xF);
-            state->pc += 1;
-            break;
-        case 0x1e:        //    MVI E, byte
-            state->e = opcode[1];
-            state->pc += 2;
-            break;
-        case 0x1f:        //    RAR
-        {
-            bool cy = state->cc.cy;
-            state->cc.cy = (state->a) & 1;
-            state->a = (state->a >> 1) | (cy << 7);
-            state->pc += 1;
-            break;
-        }    
-        case 0x20: state->pc += 1; break; //    *NOP
-        case 0x21:        //    LXI H, word
-        {
-            uint16_t value = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
-            write_hl(state, value);
-            state->pc += 3;
-            break;
-        }    
-        case 0x22:        //    SHLD word
-        {
-            uint16_t address = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
-            state->memory[address] = state->l;
-            state->memory[address + 1] = state->h;
-            state->pc += 3;
-            break;
-        }    
-        case 0x23:        //    INX H
-            // printf("PREVIOUS HL %04x\n", read_hl(state));
-            write_hl(state, read_hl(state) + 1);
-            // printf("AFTER INX HL %04x\n", read_hl(state));
-            state->pc += 1;
-            break;
-        case 0x24:        //    INR H
-            state->h++;
-            update_zsp(state, state->h);
-            state->cc.ac = (state->h & 0xf) == 0;
-            state->pc += 1;
-            break;
-        case 0x25:        //    DCR H
-            state->h--;
-            update_zsp(state, state->h);
-            state->cc.ac = !((state->h & 0xF) == 0xF);
-            state->pc += 1;
-            break;
-        case 0x26:        //    MVI H, byte
-            state->h = opcode[1];
-            state->pc += 2;
-            break;
-        case 0x27:        //    DAA
-        {
-            bool cy = state->cc.cy;
-            uint8_t correction = 0;
-
-            uint8_t lsb = state->a & 0x0F;
-            uint8_t msb = state->a >> 4;
-
-            if (state->cc.ac || lsb > 9) {
-                correction += 0x06;
-            }
+#define OP(n) case n:
+#define NEXT break
+#define HALT break
+#include "8080_ops.h"
+#undef OP
+#undef NEXT
+#undef HALT
 
-            if (state->cc.cy || msb > 9 || (msb >= 9 && lsb > 9)) {
-                correction += 0x60;
-                cy = 1;
-            }
-
-            add(state, &state->a, correction, 0);
+    } 
+    
+#if TRACE_LEVEL >= TRACE_INSTRUCTION
+    trace_after(state);
+#endif
+    // printf("MEMORY: %02x", state->memory[state->pc]);
+    return state->halted;
+}
 
-            state->cc.cy = cy;
-            state->pc += 1;
-            break;
-        }
-        case 0x28: state->pc += 1; break; //    *NOP
-        case 0x29:        //    DAD H 
-            dad_h(state);
-            state->pc += 1;
-            break;
-        case 0x2a:        //    LHLD word
-        {
-            uint16_t address = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
-            state->l = state->memory[address];
-            state->h = state->memory[address + 1];
-            state->pc += 3;
-            break;
-        }    
-        case 0x2b:        //    DCX H
-            write_hl(state, read_hl(state) - 1);
-            state->pc += 1;
-            break;
-        case 0x2c:        //    INR L
-            state->l++;
-            update_zsp(state, state->l);
-            state->cc.ac = (state->l & 0xf) == 0;
-            state->pc += 1;
-            break;
-        case 0x2d:        //    DCR L
-            state->l--;
-            update_zsp(state, state->l);
-            state->cc.ac = !((state->l & 0xF) == 0xF);
-            state->pc += 1;
-            break;
-        case 0x2e:        //    MVI L, byte
-            state->l = opcode[1];
-            state->pc += 2;
-            break;
-        case 0x2f:        //    CMA
-            state->a = ~state->a;
-            state->pc += 1;
-            break;
-        
-        case 0x30: state->pc += 1; break; //    *NOP
-        case 0x31:        //    LXI SP, word
-        {
-            uint16_t value = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
-            write_sp(state, value);
-            state->pc += 3;
-            break;
-        }    
-        case 0x32:        //    STA, word
-        {
-            uint16_t address = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
-            state->memory[address] = state->a;
-            state->pc += 3;
-            break;
-        }    
-        case 0x33:        //    INX SP
-            state->sp++;
-            state->pc += 1;
-            break;
-        case 0x34:        //    INR M 
-            state->memory[read_hl(state)] =  state->memory[read_hl(state)] + 1;
-            state->cc.ac = (state->memory[read_hl(state)] & 0xf) == 0;
-            update_zsp(state, read_hl(state));
-            state->pc += 1;
-            break;
-        case 0x35:        //    DCR M
-            state->memory[read_hl(state)] -= 1;
-            state->cc.ac = !((state->memory[read_hl(state)] & 0xF) == 0xF);
-            update_zsp(state, state->memory[read_hl(state)]);
-            state->pc += 1;
-            break;
-        case 0x36:        //    MVI M, byte
-            state->memory[read_hl(state)] = opcode[1];
-            state->pc += 2;
-            break;
-        case 0x37:        //    STC
-            state->cc.cy = 1;
-            state->pc += 1;
-            break;
-        case 0x38:        //    *NOP
-            state->pc += 1;
-            break;
-        case 0x39:        //    DAD SP
-            dad_sp(state);
-            state->pc += 1;
-            break;
-        case 0x3a:        //    LDA word
-        {
-            uint16_t address = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
-            state->a = state->memory[address];
-            state->pc += 3;
-            break;
-        }    
-        case 0x3b:        //    DCX SP 
-            state->sp--;
-            state->pc += 1;
-            break;
-        case 0x3c:        //    INR A
-            state->a++;
-            update_zsp(state, state->a);
-            state->cc.ac = (state->a & 0xf) == 0;
-            state->pc += 1;
-            break;
-        case 0x3d:        //    DCR A
-            state->a--;
-            update_zsp(state, state->a);
-            state->cc.ac = !((state->a & 0xF) == 0xF);
-            state->pc += 1;
-            break;
-        case 0x3e:        //    MVI A, byte
-            state->a = opcode[1];
-            state->pc += 2;
-            break;
-        case 0x3f:        //    CMC
-            state->cc.cy = !state->cc.cy;
-            state->pc += 1;
+/**
+ * @brief runs the switch core for up to budget cycles
+ * Execution stops once the budget is used up, or after HLT.
+ * @param state the State8080 object
+ * @param budget number of cycles to run
+ * @return uint32_t number of cycles executed
+ */
+uint32_t run_until_switch(State8080 *state, uint32_t budget) {
+    uint32_t consumed = 0;
+    while (consumed < budget) {
+        consumed += OPCODES_CYCLES[state->memory[state->pc]];
+        if (emulate8080Op(state))
             break;
+    }
+    return consumed;
+}
 
-        case 0x40:        //    MOV B, B
-            state->b = state->b;
-            state->pc += 1;
-            break;
-        case 0x41:        //    MOV B, C
-            state->b = state->c;
-            state->pc += 1;
-            break;
-        case 0x42:        //    MOV B, D
-            state->b = state->d;
-            state->pc += 1;
-            break;
-        case 0x43:        //    MOV B, E
-            state->b = state->e;
-            state->pc += 1;
-            break;
-        case 0x44:        //    MOV B, H
-            state->b = state->h;
-            state->pc += 1;
-            break;
-        case 0x45:        //    MOV B, L
-            state->b = state->l;
-            state->pc += 1;
-            break;
-        case 0x46:        //    MOV B, M
-            state->b = state->memory[read_hl(state)];
-            state->pc += 1;
-            break;
-        case 0x47:        //    MOV B, A
-            state->b = state->a;
-            state->pc += 1;
-            break;
-        case 0x48:        //    MOV C, B
-            state->c = state->b;
-            state->pc += 1;
-            break;
-        case 0x49:        //    MOV C, C
-            state->c = state->c;
-            state->pc += 1;
-            break;
-        case 0x4a:        //    MOV C, D
-            state->c = state->d;
-            state->pc += 1;
-            break;
-        case 0x4b:        //    MOV C, E
-            state->c = state->e;
-            state->pc += 1;
-            break;
-        case 0x4c:        //    MOV C, H
-            state->c = state->h;
-            state->pc += 1;
-            break;
-        case 0x4d:        //    MOV C, L
-            state->c = state->l;
-            state->pc += 1;
-            break;
-        case 0x4e:        //    MOV C, M
-            state->c = state->memory[read_hl(state)];
-            state->pc += 1;
-            break;
-        case 0x4f:        //    MOV C, A
-            state->c = state->a;
-            state->pc += 1;
-            break;
+#if defined(__GNUC__)
+#define HAVE_THREADED_CORE 1
 
-        case 0x50:        //    MOV D, B
-            state->d = state->b;
-            state->pc += 1;
-            break;
-        case 0x51:        //    MOV D, C
-            state->d = state->c;
-            state->pc += 1;
-            break;
-        case 0x52:        //    MOV D, D
-            state->d = state->d;
-            state->pc += 1;
-            break;
-        case 0x53:        //    MOV D, E
-            state->d = state->e;
-            state->pc += 1;
-            break;
-        case 0x54:        //    MOV D, H
-            state->d = state->h;
-            state->pc += 1;
-            break;
-        case 0x55:        //    MOV D, L
-            state->d = state->l;
-            state->pc += 1;
-            break;
-        case 0x56:        //    MOV D, M
-            state->d = state->memory[read_hl(state)];
-            state->pc += 1;
-            break;
-        case 0x57:        //    MOV D, A
-            state->d = state->a;
-            state->pc += 1;
-            break;
-        case 0x58:        //    MOV E, B
-            state->e = state->b;
-            state->pc += 1;
-            break;
-        case 0x59:        //    MOV E, C
-            state->e = state->c;
-            state->pc += 1;
-            break;
-        case 0x5a:        //    MOV E, D
-            state->e = state->d;
-            state->pc += 1;
-            break;
-        case 0x5b:        //    MOV E, E
-            state->e = state->e;
-            state->pc += 1;
-            break;
-        case 0x5c:        //    MOV E, H
-            state->e = state->h;
-            state->pc += 1;
-            break;
-        case 0x5d:        //    MOV E, L
-            state->e = state->l;
-            state->pc += 1;
-            break;
-        case 0x5e:        //    MOV E, M
-            state->e = state->memory[read_hl(state)];
-            state->pc += 1;
-            break;
-        case 0x5f:        //    MOV E, A
-            state->e = state->a;
-            state->pc += 1;
-            break;
+/**
+ * @brief runs the threaded (computed goto) core for up to budget cycles
+ * Each instruction body ends with its own indirect jump to the next one instead of 
+ * returning to a shared switch, and the loop stays inside this function for the 
+ * whole batch. Stops at the same points as run_until_switch.
+ * @param state the State8080 object
+ * @param budget number of cycles to run
+ * @return uint32_t number of cycles executed
+ */
+uint32_t run_until_threaded(State8080 *state, uint32_t budget) {
+    static void *dispatch[256] = {
+        &&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07,
+        &&op_0x08, &&op_0x09, &&op_0x0a, &&op_0x0b, &&op_0x0c, &&op_0x0d, &&op_0x0e, &&op_0x0f,
+        &&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17,
+        &&op_0x18, &&op_0x19, &&op_0x1a, &&op_0x1b, &&op_0x1c, &&op_0x1d, &&op_0x1e, &&op_0x1f,
+        &&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27,
+        &&op_0x28, &&op_0x29, &&op_0x2a, &&op_0x2b, &&op_0x2c, &&op_0x2d, &&op_0x2e, &&op_0x2f,
+        &&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37,
+        &&op_0x38, &&op_0x39, &&op_0x3a, &&op_0x3b, &&op_0x3c, &&op_0x3d, &&op_0x3e, &&op_0x3f,
+        &&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47,
+        &&op_0x48, &&op_0x49, &&op_0x4a, &&op_0x4b, &&op_0x4c, &&op_0x4d, &&op_0x4e, &&op_0x4f,
+        &&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57,
+        &&op_0x58, &&op_0x59, &&op_0x5a, &&op_0x5b, &&op_0x5c, &&op_0x5d, &&op_0x5e, &&op_0x5f,
+        &&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67,
+        &&op_0x68, &&op_0x69, &&op_0x6a, &&op_0x6b, &&op_0x6c, &&op_0x6d, &&op_0x6e, &&op_0x6f,
+        &&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77,
+        &&op_0x78, &&op_0x79, &&op_0x7a, &&op_0x7b, &&op_0x7c, &&op_0x7d, &&op_0x7e, &&op_0x7f,
+        &&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87,
+        &&op_0x88, &&op_0x89, &&op_0x8a, &&op_0x8b, &&op_0x8c, &&op_0x8d, &&op_0x8e, &&op_0x8f,
+        &&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97,
+        &&op_0x98, &&op_0x99, &&op_0x9a, &&op_0x9b, &&op_0x9c, &&op_0x9d, &&op_0x9e, &&op_0x9f,
+        &&op_0xa0, &&op_0xa1, &&op_0xa2, &&op_0xa3, &&op_0xa4, &&op_0xa5, &&op_0xa6, &&op_0xa7,
+        &&op_0xa8, &&op_0xa9, &&op_0xaa, &&op_0xab, &&op_0xac, &&op_0xad, &&op_0xae, &&op_0xaf,
+        &&op_0xb0, &&op_0xb1, &&op_0xb2, &&op_0xb3, &&op_0xb4, &&op_0xb5, &&op_0xb6, &&op_0xb7,
+        &&op_0xb8, &&op_0xb9, &&op_0xba, &&op_0xbb, &&op_0xbc, &&op_0xbd, &&op_0xbe, &&op_0xbf,
+        &&op_0xc0, &&op_0xc1, &&op_0xc2, &&op_0xc3, &&op_0xc4, &&op_0xc5, &&op_0xc6, &&op_0xc7,
+        &&op_0xc8, &&op_0xc9, &&op_0xca, &&op_0xcb, &&op_0xcc, &&op_0xcd, &&op_0xce, &&op_0xcf,
+        &&op_0xd0, &&op_0xd1, &&op_0xd2, &&op_0xd3, &&op_0xd4, &&op_0xd5, &&op_0xd6, &&op_0xd7,
+        &&op_0xd8, &&op_0xd9, &&op_0xda, &&op_0xdb, &&op_0xdc, &&op_0xdd, &&op_0xde, &&op_0xdf,
+        &&op_0xe0, &&op_0xe1, &&op_0xe2, &&op_0xe3, &&op_0xe4, &&op_0xe5, &&op_0xe6, &&op_0xe7,
+        &&op_0xe8, &&op_0xe9, &&op_0xea, &&op_0xeb, &&op_0xec, &&op_0xed, &&op_0xee, &&op_0xef,
+        &&op_0xf0, &&op_0xf1, &&op_0xf2, &&op_0xf3, &&op_0xf4, &&op_0xf5, &&op_0xf6, &&op_0xf7,
+        &&op_0xf8, &&op_0xf9, &&op_0xfa, &&op_0xfb, &&op_0xfc, &&op_0xfd, &&op_0xfe, &&op_0xff
+    };
+    unsigned char *opcode;
+    uint32_t consumed = 0;
+
+#if TRACE_LEVEL >= TRACE_INSTRUCTION
+#define TRACE_BEFORE() trace_before(state)
+#define TRACE_AFTER() trace_after(state)
+#else
+#define TRACE_BEFORE()
+#define TRACE_AFTER()
+#endif
+
+#define DISPATCH() do { \
+        opcode = &state->memory[state->pc]; \
+        if (consumed >= budget) \
+            return consumed; \
+        TRACE_BEFORE(); \
+        consumed += OPCODES_CYCLES[*opcode]; \
+        state->cycles += OPCODES_CYCLES[*opcode]; \
+        goto *dispatch[*opcode]; \
+    } while (0)
+
+    DISPATCH();
+
+#define OP(n) op_##n:
+#define NEXT do { TRACE_AFTER(); DISPATCH(); } while (0)
+#define HALT do { TRACE_AFTER(); return consumed; } while (0)
+#include "8080_ops.h"
+#undef OP
+#undef NEXT
+#undef HALT
+#undef DISPATCH
+#undef TRACE_BEFORE
+#undef TRACE_AFTER
+}
+#endif
+
+/*  run_until is the core the machine uses, picked at build time:
+    the threaded core when the compiler supports computed goto, 
+    unless CPU_CORE_SWITCH is defined.
+*/
+#if defined(HAVE_THREADED_CORE) && !defined(CPU_CORE_SWITCH)
+#define run_until run_until_threaded
+#define CPU_CORE_NAME "threaded"
+#else
+#define run_until run_until_switch
+#define CPU_CORE_NAME "switch"
+#endif
+
+/************************ SCHEDULING ************************/
 
-        case 0x60:        //    MOV H, B
-            state->h = state->b;
-            state->pc += 1;
-            break;
-        case 0x61:        //    MOV H, C
-            state->h = state->c;
-            state->pc += 1;
-            break;
-        case 0x62:        //    MOV H, D
-            state->h = state->d;
-            state->pc += 1;
-            break;
-        case 0x63:        //    MOV H, E
-            state->h = state->e;
-            state->pc += 1;
-            break;
-        case 0x64:        //    MOV H, H
-            state->h = state->h;
-            state->pc += 1;
-            break;
-        case 0x65:        //    MOV H, L
-            state->h = state->l;
-            state->pc += 1;
-            break;
-        case 0x66:        //    MOV H, M
-            state->h = state->memory[read_hl(state)];
-            state->pc += 1;
-            break;
-        case 0x67:        //    MOV H, A
-            state->h = state->a;
-            state->pc += 1;
-            break;
-        case 0x68:        //    MOV L, B
-            state->l = state->b;
-            state->pc += 1;
-            break;
-        case 0x69:        //    MOV L, C
-            state->l = state->c;
-            state->pc += 1;
-            break;
-        case 0x6a:        //    MOV L, D
-            state->l = state->d;
-            state->pc += 1;
-            break;
-        case 0x6b:        //    MOV L, E
-            state->l = state->e;
-            state->pc += 1;
-            break;
-        case 0x6c:        //    MOV L, H
-            state->l = state->h;
-            state->pc += 1;
-            break;
-        case 0x6d:        //    MOV L, L
-            state->l = state->l;
-            state->pc += 1;
-            break;
-        case 0x6e:        //    MOV L, M
-            state->l = state->memory[read_hl(state)];
-            state->pc += 1;
-            break;
-        case 0x6f:        //    MOV L, A
-            state->l = state->a;
-            state->pc += 1;
-            break;
-        
-        case 0x70:        //    MOV M, B
-            state->memory[read_hl(state)] = state->b;
-            state->pc += 1;
-            break;
-        case 0x71:        //    MOV M, C
-            state->memory[read_hl(state)] = state->c;
-            state->pc += 1;
-            break;
-        case 0x72:        //    MOV M, D
-            state->memory[read_hl(state)] = state->d;
-            state->pc += 1;
-            break;
-        case 0x73:        //    MOV M, E
-            state->memory[read_hl(state)] = state->e;
-            state->pc += 1;
-            break;
-        case 0x74:        //    MOV M, H
-            state->memory[read_hl(state)] = state->h;
-            state->pc += 1;
-            break;
-        case 0x75:        //    MOV M, L
-            state->memory[read_hl(state)] = state->l;
-            state->pc += 1;
-            break;
-        case 0x76:        //    HLT
-            state->halted = 1;
-            state->pc += 1;
-            break;
-        case 0x77:        //    MOV M, A
-            state->memory[read_hl(state)] = state->a;
-            state->pc += 1;
-            break;
-        case 0x78:        //    MOV A, B
-            state->a = state->b;
-            state->pc += 1;
-            break;
-        case 0x79:        //    MOV A, C
-            state->a = state->c;
-            state->pc += 1;
-            break;
-        case 0x7a:        //    MOV A, D
-            state->a = state->d;
-            state->pc += 1;
-            break;
-        case 0x7b:        //    MOV A, E
-            state->a = state->e;
-            state->pc += 1;
-            break;
-        case 0x7c:        //    MOV A, H
-            state->a = state->h;
-            state->pc += 1;
-            break;
-        case 0x7d:        //    MOV A, L
-            state->a = state->l;
-            state->pc += 1;
-            break;
-        case 0x7e:        //    MOV A, M
-            state->a = state->memory[read_hl(state)];
-            state->pc += 1;
-            break;
-        case 0x7f:        //    MOV A, A
-            state->a = state->a;
-            state->pc += 1;
-            break;
-        
-        case 0x80:        //    ADD B
-            add(state, &state->a, state->b, 0);
-            state->pc += 1;
-            break;
-        case 0x81:        //    ADD C
-            add(state, &state->a, state->c, 0);
-            state->pc += 1;
-            break;
-        case 0x82:        //    ADD D
-            add(state, &state->a, state->d, 0);
-            state->pc += 1;
-            break;
-        case 0x83:        //    ADD E
-            add(state, &state->a, state->e, 0);
-            state->pc += 1;
-            break;
-        case 0x84:        //    ADD H
-            add(state, &state->a, state->h, 0);
-            state->pc += 1;
-            break;
-        case 0x85:        //    ADD L
-            add(state, &state->a, state->l, 0);
-            state->pc += 1;
-            break;
-        case 0x86:        //    ADD M
-            add(state, &state->a, state->memory[read_hl(state)], 0);
-            state->pc += 1;
-            break;
-        case 0x87:        //    ADD A
-            add(state, &state->a, state->a, 0);
-            state->pc += 1;
-            break;
-        case 0x88:        //    ADC B
-            add(state, &state->a, state->b, state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x89:        //    ADC C
-            add(state, &state->a, state->c, state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x8a:        //    ADC D
-            add(state, &state->a, state->d, state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x8b:        //    ADC E
-            add(state, &state->a, state->e, state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x8c:        //    ADC H
-            add(state, &state->a, state->h, state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x8d:        //    ADC L
-            add(state, &state->a, state->l, state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x8e:        //    ADC M
-            add(state, &state->a, state->memory[read_hl(state)], state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x8f:        //    ADC A
-            add(state, &state->a, state->a, state->cc.cy);
-            state->pc += 1;
-            break;
-        
-        case 0x90:        //    SUB B 
-            subtract(state, &state->a, state->b, 0);
-            state->pc += 1;
-            break;
-        case 0x91:        //    SUB C 
-            subtract(state, &state->a, state->c, 0);
-            state->pc += 1;
-            break;
-        case 0x92:        //    SUB D 
-            subtract(state, &state->a, state->d, 0);
-            state->pc += 1;
-            break;
-        case 0x93:        //    SUB E
-            subtract(state, &state->a, state->e, 0);
-            state->pc += 1;
-            break;
-        case 0x94:        //    SUB H 
-            subtract(state, &state->a, state->h, 0);
-            state->pc += 1;
-            break;
-        case 0x95:        //    SUB L 
-            subtract(state, &state->a, state->l, 0);
-            state->pc += 1;
-            break;
-        case 0x96:        //    SUB M 
-            subtract(state, &state->a, state->memory[read_hl(state)], 0);
-            state->pc += 1;
-            break;
-        case 0x97:        //    SUB A 
-            subtract(state, &state->a, state->a, 0);
-            state->pc += 1;
-            break;
-        case 0x98:        //    SBB B
-            subtract(state, &state->a, state->b, state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x99:        //    SBB C 
-            subtract(state, &state->a, state->c, state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x9a:        //    SBB D
-            subtract(state, &state->a, state->d, state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x9b:        //    SBB E
-            subtract(state, &state->a, state->e, state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x9c:        //    SBB H
-            subtract(state, &state->a, state->h, state->cc.cy);
-            state->pc += 1;
-            break;
-        case 0x9d:        //    SBB L
-            subtract(state, &state->a, state->l, state->cc.cy);
-            state->pc += 1;
-            break;  
-        case 0x9e:        //    SBB M
-            subtract(state, &state->a, state->memory[read_hl(state)], state->cc.cy);
-            state->pc += 1;
-            break; 
-        case 0x9f:        //    SBB A
-            subtract(state, &state->a, state->a, state->cc.cy);
-            state->pc += 1;
-            break;  
-        
-        case 0xa0:        //    ANA B
-        {
-            uint8_t val = state->a &= state->b;
-            update_zsp(state, val);
-            state->cc.ac = ((state->a | val) & 0x08) != 0;
-            state->cc.cy = 0;
-            state->a = val;
-            state->pc += 1;
-            break;
-        }
-        case 0xa1:        //    ANA C
-        {
-            uint8_t val = state->a &= state->c;
-            update_zsp(state, val);
-            state->cc.ac = ((state->a | val) & 0x08) != 0;
-            state->cc.cy = 0;
-            state->a = val;
-            state->pc += 1;
-            break;
-        }
-        case 0xa2:        //    ANA D
-        {
-            uint8_t val = state->a &= state->d;
-            update_zsp(state, val);
-            state->cc.ac = ((state->a | val) & 0x08) != 0;
-            state->cc.cy = 0;
-            state->a = val;
-            state->pc += 1;
-            break;
-        }
-        case 0xa3:        //    ANA E
-        {
-            uint8_t val = state->a &= state->e;
-            update_zsp(state, val);
-            state->cc.ac = ((state->a | val) & 0x08) != 0;
-            state->cc.cy = 0;
-            state->a = val;
-            state->pc += 1;
-            break;
-        }
-        case 0xa4:        //    ANA H
-        {
-            uint8_t val = state->a &= state->h;
-            update_zsp(state, val);
-            state->cc.ac = ((state->a | val) & 0x08) != 0;
-            state->cc.cy = 0;
-            state->a = val;
-            state->pc += 1;
-            break;
-        }
-        case 0xa5:        //    ANA L
-        {
-            uint8_t val = state->a &= state->l;
-            update_zsp(state, val);
-            state->cc.ac = ((state->a | val) & 0x08) != 0;
-            state->cc.cy = 0;
-            state->a = val;
-            state->pc += 1;
-            break;
-        }
-        case 0xa6:        //    ANA M
-        {
-            uint8_t val = state->a &= state->memory[read_hl(state)];
-            update_zsp(state, val);
-            state->cc.ac = ((state->a | val) & 0x08) != 0;
-            state->cc.cy = 0;
-            state->a = val;
-            state->pc += 1;
-            break;
-        }
-        case 0xa7:        //    ANA A
-        {
-            uint8_t val = state->a &= state->a;
-            update_zsp(state, val);
-            state->cc.ac = ((state->a | val) & 0x08) != 0;
-            state->cc.cy = 0;
-            state->a = val;
-            state->pc += 1;
-            break;
-        }
-        case 0xa8:        //    XRA B
-            state->a ^= state->b;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xa9:        //    XRA C
-            state->a ^= state->c;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xaa:        //    XRA D
-            state->a ^= state->d;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xab:        //    XRA E
-            state->a ^= state->e;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xac:        //    XRA H
-            state->a ^= state->h;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xad:        //    XRA L
-            state->a ^= state->l;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xae:        //    XRA M
-            state->a ^= state->memory[read_hl(state)];
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xaf:        //    XRA A
-            state->a ^= state->a;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
+/**
+ * @brief schedules an interrupt at an exact cycle count
+ * 
+ * @param state the State8080 object
+ * @param at the cycle count at which the interrupt is raised
+ * @param period cycles between repeats, or 0 to raise it once
+ * @param interrupt the RST number to call
+ */
+void emulate8080_schedule(State8080 *state, uint64_t at, uint32_t period, uint8_t interrupt) {
+    if (state->event_count == MAX_EVENTS) {
+        fprintf(stderr, "error: too many scheduled events\n");
+        exit(1);
+    }
+    Event8080 *event = &state->events[state->event_count++];
+    event->at = at;
+    event->period = period;
+    event->interrupt = interrupt;
+}
 
-        case 0xb0:        //    ORA B
-            state->a |= state->b;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xb1:        //    ORA C
-            state->a |= state->c;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xb2:        //    ORA D
-            state->a |= state->d;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xb3:        //    ORA E
-            state->a |= state->e;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xb4:        //    ORA H
-            state->a |= state->h;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xb5:        //    ORA L
-            state->a |= state->l;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xb6:        //    ORA M
-            state->a |= state->memory[read_hl(state)];
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xb7:        //    ORA A
-            state->a |= state->a;
-            state->cc.cy = 0;
-            state->cc.ac = 0;
-            update_zsp(state, state->a);
-            state->pc += 1;
-            break;
-        case 0xb8:        //    CMP B
-        {
-            cmp(state, state->b);
-            state->pc += 1;
-            break;
-        }    
-        case 0xb9:        //    CMP C
-        {   
-            cmp(state, state->c);
-            state->pc += 1;
-            break;
-        }
-        case 0xba:        //    CMP D
-        {   
-            cmp(state, state->d);
-            state->pc += 1;
-            break;
-        }
-        case 0xbb:        //    CMP E
-        {  
-            cmp(state, state->e);
-            state->pc += 1;
-            break;
-        }
-        case 0xbc:        //    CMP H
-        {   
-            cmp(state, state->h);
-            state->pc += 1;
-            break;
-        }
-        case 0xbd:        //    CMP L
-        {   
-            cmp(state, state->l);
-            state->pc += 1;
-            break;
-        }
-        case 0xbe:        //    CMP M
-        {   
-            cmp(state, state->memory[read_hl(state)]);
-            state->pc += 1;
-            break;
-        }
-        case 0xbf:        //    CMP A
-        {   
-            cmp(state, state->a);
-            state->pc += 1;
-            break;
-        }
-        case 0xc0:        //    RNZ
-            if (state->cc.z == 0)
-                ret(state);
-            else
-                state->pc += 1;
-            break;
-        case 0xc1:        //    POP B
-            write_bc(state, pop(state));
-            state->pc += 1;
-            break;
-        case 0xc2:        //    JNZ word
-            if (state->cc.z == 0)
-                jmp(state, ((opcode[2] << 8) | opcode[1]));
-            else
-                state->pc += 3;
-            break;
-        case 0xc3:        //    JMP word
-            jmp(state, ((opcode[2] << 8) | opcode[1]));
-            break;
-        case 0xc4:        //    CNZ
-            state->pc += 3;
-            if(state->cc.z == 0)
-                call(state, (opcode[2] << 8) | opcode[1]);
-            break;
-        case 0xc5:        //    PUSH B
-            push(state, read_bc(state));
-            state->pc += 1;
-            break;
-        case 0xc6:        //    ADI byte
-            add(state, &state->a, opcode[1], 0);
-            // printf("PARITY OF A: %02x\n", parity(state->a));
-            // printf("PARITY OF 0x76: %02x\n", parity(0x76));
-            state->pc += 2;
-            break;
-        case 0xc7:        //    RST 0
-            call(state, 0x00);
-            // state->pc += 1;
-            break;
-        case 0xc8:        //    RZ
-            if(state->cc.z)
-                ret(state);
-            else
-                state->pc += 1;
-            break;
-        case 0xc9:        //    RET
-            ret(state);
-            break;
-        case 0xca:        //    JZ word
-            if(state->cc.z)
-                jmp(state, (opcode[2] << 8) | opcode[1]);
-            else
-                state->pc += 3;
-            break;
-        case 0xcb:        //    JMP word
-            jmp(state, (opcode[2] << 8) | opcode[1]);
-            break;
-        case 0xcc:        //    CZ word
-            state->pc += 3;
-            if(state->cc.z)
-                call(state, (opcode[2] << 8) | opcode[1]);
-            break;
-        case 0xcd:        //    CALL word
-            if(FOR_CPUDIAG) {
-                if (5 ==  ((opcode[2] << 8) | opcode[1]))    
-                {    
-                    if (state->c == 9)    
-                    {    
-                        uint16_t offset = (state->d<<8) | (state->e);    
-                        char *str = &state->memory[offset + 3];  //skip the prefix bytes    
-                        bool failed = true;
-                        while (*str != '$') {
-                            printf("%c", *str++);    
-                            if(*str == 'F')
-                                failed = true;
-                        }
-                        printf("\n");   
-                        if(failed)
-                            getchar(); 
-                    }    
-                    else if (state->c == 2)    
-                    {    
-                        //saw this in the inspected code, never saw it called    
-                        printf ("print char routine called\n");    
-                    }  
-                    
-                    
-                }    
-                else if (0 ==  ((opcode[2] << 8) | opcode[1]))    
-                {    
-                    exit(0); 
-                }    
+/**
+ * @brief raises every scheduled interrupt that is due
+ * Interrupts that arrive while interrupts are disabled are dropped, as on the 
+ * real machine. Periodic events are re-armed relative to their own due time 
+ * so they never drift.
+ * @param state the State8080 object
+ * @return uint64_t the cycle count of the next scheduled event
+ */
+uint64_t emulate8080_fire_events(State8080 *state) {
+    uint64_t next = UINT64_MAX;
+    for (int i = 0; i < state->event_count; i++) {
+        Event8080 *event = &state->events[i];
+        if (event->at <= state->cycles) {
+            if (state->int_enable)
+                generate_interrupt(state, event->interrupt);
+            if (event->period == 0) {
+                state->events[i--] = state->events[--state->event_count];
+                continue;
             }
-            state->pc += 3;
-            call(state, (opcode[2] << 8) | opcode[1]);
-            break;
-        case 0xce:        //    ACI byte
-            add(state, &state->a, opcode[1], state->cc.cy);
-            state->pc += 2;
-            break;
-        case 0xcf:        //    RST 1
-            state->pc += 1;
-            call(state, 0x08);
-            break;
-        
-        case 0xd0:        //    RNC
-            if(!state->cc.cy)
-                ret(state);
-            else
-                state->pc += 1;
-            break;
-        case 0xd1:        //    POP D
-            write_de(state, pop(state));
-            state->pc += 1;
-            break;
-        case 0xd2:        //    JNC word
-            if(!state->cc.cy)
-                jmp(state, (opcode[2] << 8) | opcode[1]);
-            else
-                state->pc += 3;
-            break;
-        case 0xd3:        //    OUT byte
-            unimplemented_instruction(state);
-            state->pc += 2;
-            break;
-        case 0xd4:        //    CNC word
-            state->pc += 3;
-            if(!state->cc.cy)
-                call(state, (opcode[2] << 8) | opcode[1]);
-            break;
-        case 0xd5:        //    PUSH D
-            push(state, read_de(state));
-            state->pc += 1;
-            break;
-        case 0xd6:        //    SUI byte
-            subtract(state, &state->a, opcode[1], 0);
-            state->pc += 2;
-            break;
-        case 0xd7:        //    RST 2
-            state->pc += 1;
-            call(state, 0x10);
-            break;
-        case 0xd8:        //    RC 
-            if(state->cc.cy)
-                ret(state);
-            else
-                state->pc += 1;
-            break;
-        case 0xd9:        //    *RET
-            ret(state);
-            state->pc += 1;
-            break;
-        case 0xda:        //    JC word
-            if(state->cc.cy)
-                jmp(state, (opcode[2] << 8) | opcode[1]);
-            else
-                state->pc += 3;
-            break;
-        case 0xdb:        //    IN byte
-            unimplemented_instruction(state);
-            state->pc += 2;
-            break;
-        case 0xdc:        //    CC word
-            state->pc += 3;
-            if(state->cc.cy)
-                call(state, (opcode[2] << 8) | opcode[1]);
-            // printf("FINISHED EXECUTION OF OPERATION CC\n");
-            break;
-        case 0xdd:        //    *CALL word
-            state->pc += 3;
-            call(state, (opcode[2] << 8) | opcode[1]);
-            break;
-        case 0xde:        //    SBI byte
-            subtract(state, &state->a, opcode[1], state->cc.cy);
-            state->pc += 2;
-            break;
-        case 0xdf:        //    RST 3
-            state->pc += 1;
-            call(state, 0x18);
-            break;
-        
-        case 0xe0:        //    RPO
-            if(state->cc.p == 0)
-                ret(state);
-            else
-                state->pc += 1;
-            break;
-        case 0xe1:        //    POP H
-            write_hl(state, pop(state));
-            state->pc += 1;
-            break;
-        case 0xe2:        //    JPO word
-            state->pc += 3;
-            if(state->cc.p == 0)
-                jmp(state, (opcode[2] << 8) | opcode[1]);
-            break;
-        case 0xe3:        //    XTHL
-        {
-            uint16_t val = (state->memory[state->sp + 1] << 8) | state->memory[state->sp];
-            state->memory[state->sp + 1] = state->h;
-            state->memory[state->sp] = state->l;
-            write_hl(state, val);
-            state->pc += 1;
-            break;
-        }
-        case 0xe4:        //    CPO word
-            state->pc += 3;
-            if(state->cc.p == 0)
-                call(state, (opcode[2] << 8) | opcode[1]);
-            break;
-        case 0xe5:        //    PUSH H
-            push(state, read_hl(state));
-            state->pc += 1;
-            break;
-        case 0xe6:        //    ANI byte
-            state->a &= opcode[1];
-            update_zsp(state, state->a);
-            state->cc.cy = 0;
-            state->pc += 2;
-            break;
-        case 0xe7:        //    RST 4
-            state->pc += 1;
-            call(state, 0x20);
-            break;
-        case 0xe8:        //    RPE 
-            if(state->cc.p)
-                ret(state);
-            else
-                state->pc += 1;
-            break;
-        case 0xe9:        //    PCHL
-            state->pc = read_hl(state);
-            break;
-        case 0xea:        //    JPE word
-            if(state->cc.p)
-                jmp(state, (opcode[2] << 8) | opcode[1]);
-            else
-                state->pc += 3;
-            break;
-        case 0xeb:        //    XCHG word
-        {   uint16_t hl = read_hl(state);
-            write_hl(state, read_de(state));
-            write_de(state, hl);
-            state->pc += 1;
-            break;
+            event->at += event->period;
         }
-        case 0xec:        //    CPE word
-            state->pc += 3;
-            if(state->cc.p)
-                call(state, (opcode[2] << 8) | opcode[1]);
-            break;  
-        case 0xed:        //    *CALL word
-            state->pc += 3;
-            call(state, (opcode[2] << 8) | opcode[1]);
-            break;  
-        case 0xee:        //    XRI byte
-            state->a ^= opcode[1];
-            update_zsp(state, state->a);
-            state->cc.ac = 0;
-            state->cc.cy = 0;
-            state->pc += 2;
-            break;
-        case 0xef:        //    RST 5
-            state->pc += 1;
-            call(state, 0x28);
-            break;
+        if (event->at < next)
+            next = event->at;
+    }
+    return next;
+}
 
-        case 0xf0:        //    RP 
-            if(state->cc.s == 0)
-                ret(state);
-            else
-                state->pc += 1;
-            break;
-        case 0xf1:        //    POP PSW 
-        {   
-            uint16_t af = pop(state);
-            state->a = (af >> 8);
-            uint8_t flags = af & 0xff;
-            state->cc.s = (flags >> 7) & 1;
-            state->cc.z = (flags >> 6) & 1;
-            state->cc.ac = (flags >> 4) & 1;
-            state->cc.p = (flags >> 2) & 1;
-            state->cc.cy = (flags >> 0) & 1;
-            state->pc += 1;
-            break;
-        }
-        case 0xf2:        //    JP word 
-            if(state->cc.s == 0)
-                jmp(state, (opcode[2] << 8) | opcode[1]);
-            else
-                state->pc += 3;
-            break;
-        case 0xf3:        //    DI 
-            state->int_enable = 0;
-            state->pc += 1;
-            break;
-        case 0xf4:        //    CP word
-            state->pc += 3;
-            if(state->cc.s == 0)
-                call(state, (opcode[2] << 8) | opcode[1]);
-            break;
-        case 0xf5:        //    PUSH PSW
-        {
-            uint8_t flags = 0x00;
-            flags |= (state->cc.s << 7);
-            flags |= (state->cc.z << 6);
-            flags |= (state->cc.ac << 4);
-            flags |= (state->cc.p << 2);
-            flags |= (1 << 1);
-            flags |= (state->cc.cy << 0);
-            push(state, ((state->a << 8) | flags));
-            state->pc += 1;
-            break;
+/**
+ * @brief runs the CPU for budget cycles, raising scheduled interrupts on time
+ * The core runs in batches up to the next event.
+ * @param state the State8080 object
+ * @param budget number of cycles to run
+ * @return uint32_t number of cycles executed
+ */
+uint32_t emulate8080_run(State8080 *state, uint32_t budget) {
+    uint64_t start = state->cycles;
+    uint64_t end = start + budget;
+    while (state->cycles < end) {
+        uint64_t stop = emulate8080_fire_events(state);
+        if (stop > end)
+            stop = end;
+        if (state->halted) {
+            state->cycles = stop; // idle until the next interrupt
+            continue;
         }
-        case 0xf6:        //    ORI byte
-            state->a |= opcode[1];
-            state->cc.cy = 0;
-            update_zsp(state, state->a);
-            state->pc += 2;
-            break;
-        case 0xf7:        //    RST 6
-            state->pc += 1;
-            call(state, 0x30);
-            break;
-        case 0xf8:        //    RM
-            if(state->cc.s)
-                ret(state);
-            else
-                state->pc += 1;
-            break;
-        case 0xf9:        //    SPHL
-            state->sp = read_hl(state);
-            state->pc += 1;
-            break;
-        case 0xfa:        //    JM word
-            if(state->cc.s)
-                jmp(state, (opcode[2] << 8) | opcode[1]);
-            else
-                state->pc += 3;
-            break;
-        case 0xfb:        //    EI
-            state->int_enable = 1;
-            state->pc += 1;
-            break;
-        case 0xfc:        //    CM word
-            state->pc += 3;
-            if(state->cc.s)
-                call(state, (opcode[2] << 8) | opcode[1]);
-            break;
-        case 0xfd:        //    *CALL word
-            state->pc += 3;
-            call(state, (opcode[2] << 8) | opcode[1]);
-            break;
-        case 0xfe:        //    CPI byte
-            cmp(state, opcode[1]);
-            state->pc += 2;
-            break;  
-        case 0xff:        //    RST 7
-            state->pc += 1;
-            call(state, 0x38);
-            break;
-
-        default: state->pc += 1; unimplemented_instruction(state); break;
-    } 
-    
-    uint8_t flags = 0;
-    flags |= state->cc.s << 7;
-    flags |= state->cc.z << 6;
-    flags |= state->cc.ac << 4;
-    flags |= state->cc.p << 2;
-    flags |= 1 << 1; // bit 1 is always 1
-    flags |= state->cc.cy << 0;
-
-    /* print out processor state */    
-    if(DEBUG) {
-        printf("\tCY=%d,P=%d,S=%d,Z=%d,AC=%d,INT_EN=%d\n", state->cc.cy, state->cc.p,    
-            state->cc.s, state->cc.z, state->cc.ac, state->int_enable);    
-        printf("\tAF $%02x%02x BC $%02x%02x DE $%02x%02x HL $%02x%02x SP %04x PC %04x\n",    
-            state->a, flags, state->b, state->c, state->d,    
-            state->e, state->h, state->l, state->sp, state->pc);    
+        run_until(state, stop - state->cycles);
     }
-    // printf("MEMORY: %02x", state->memory[state->pc]);
-    return 0;
+    return state->cycles - start;
 }
 
-State8080 *Init8080(void) {
+
+/**
+ * @brief creates a CPU running from the given 64K of memory
+ * 
+ * @param memory the address space, owned by the caller
+ * @return State8080* 
+ */
+State8080 *Init8080WithMemory(uint8_t *memory) {
     State8080 *state = malloc(sizeof(State8080));
     state->a = 0;
     state->b = 0;
@@ -1765,16 +819,29 @@ State8080 *Init8080(void) {
     state->e = 0;
     state->h = 0;
     state->l = 0;
-    state->cc.z = 0;
-    state->cc.s = 0;
-    state->cc.p = 0;
-    state->cc.ac = 0;
-    state->cc.cy = 0;
-    state->cc.pad = 0;
+    state->sp = 0;
+    state->pc = 0;
+    state->f = FLAG_ONE;
     state->int_enable = 0;
-	state->memory = malloc(0x10000); //allocate 16K
+	state->memory = memory;
     state->cycles = 0;
+    state->halted = 0;
+    state->event_count = 0;
+    state->port_in = NULL;
+    state->port_out = NULL;
+    state->io_context = NULL;
+    state->dirty_map = NULL;
+    state->dirty_base = 0;
+    state->address_mask = 0xffff; // flat 64K of RAM until the machine maps it
+    state->rom_end = 0;
+    state->write_hook = NULL;
+    state->hook_context = NULL;
+    state->untraced = 0;
 	return state;
 }
 
+State8080 *Init8080(void) {
+    return Init8080WithMemory(calloc(0x10000, 1)); //allocate 64K, zeroed so runs are reproducible
+}
+
 
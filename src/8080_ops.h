@@ -0,0 +1,1187 @@
+/*  Instruction bodies of the 8080, shared by both execution cores in 8080.h.
+    This file is included inside a function with three macros defined:
+        OP(n)   starts the body of opcode n (a case label or a goto label)
+        NEXT    ends the body (break out of the switch, or dispatch the next op)
+        HALT    ends the body of HLT and the batch, so the CPU idles in
+                emulate8080_run until the next interrupt
+    `opcode` points at the instruction in memory and its cycles have
+    already been added to state->cycles.
+*/
+
+        OP(0x00) state->pc += 1; NEXT; //    NOP
+        OP(0x01)        //    LXI B, word
+        {
+            uint16_t value = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
+            write_bc(state, value);
+            state->pc += 3;
+            NEXT;
+        }
+        OP(0x02)        //    STAX B
+            stax_b(state);
+            state->pc += 1;
+            NEXT;
+            
+        OP(0x03)        //    INX B
+            state->c++;
+            if(state->c == 0)
+                state->b++;
+            state->pc += 1;
+            NEXT;
+        OP(0x04)        //    INR B
+            state->b = inr(state, state->b);
+            state->pc += 1;
+            NEXT;
+        OP(0x05)        //    DCR B
+            state->b = dcr(state, state->b);
+            state->pc += 1;
+            NEXT;
+        OP(0x06)        //    MVI B, byte
+            state->b = opcode[1];
+            state->pc += 2;
+            NEXT;
+        OP(0x07)        //    RLC
+            set_carry(state, state->a >> 7); // set carry bit to high order bit (rotating left)
+            state->a = (state->a << 1) | (state->a >> 7);
+            state->pc += 1;
+            NEXT;
+        OP(0x08) state->pc += 1; NEXT; //    *NOP
+        OP(0x09)        //    DAD B
+            dad_b(state);
+            state->pc += 1;
+            NEXT;
+        OP(0x0a)        //    LDAX B
+            state->a = read_memory(state, read_bc(state));
+            state->pc += 1;
+            NEXT;
+        OP(0x0b)        //    DCX B
+            write_bc(state, read_bc(state) - 1);
+            state->pc += 1;
+            NEXT;
+        OP(0x0c)        //    INR C
+            state->c = inr(state, state->c);
+            state->pc += 1;
+            NEXT;
+        OP(0x0d)        //    DCR C
+            state->c = dcr(state, state->c);
+            state->pc += 1;
+            NEXT;
+        OP(0x0e)        //    MVI C, byte
+            state->c = opcode[1];
+            state->pc += 2;
+            NEXT;
+        OP(0x0f)        //    RRC
+            set_carry(state, state->a & 1);
+            state->a = (state->a >> 1) | (state->a << 7);
+            state->pc += 1;
+            NEXT;
+        
+        OP(0x10) state->pc += 1; NEXT; //    NOP
+        OP(0x11)        //    LXI D, word
+        {
+            uint16_t value = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
+            write_de(state, value);
+            state->pc += 3;
+            NEXT;
+        }   
+        OP(0x12)        //    STAX D
+            stax_d(state);
+            state->pc += 1;
+            NEXT;
+        OP(0x13)        //    INX D
+            write_de(state, read_de(state) + 1);
+            state->pc += 1;
+            NEXT;
+        OP(0x14)        //    INR D
+            state->d = inr(state, state->d);
+            state->pc += 1;
+            NEXT;
+        OP(0x15)        //    DCR D
+            state->d = dcr(state, state->d);
+            state->pc += 1;
+            NEXT;
+        OP(0x16)        //    MVI D, byte
+            state->d = opcode[1];
+            state->pc += 2;
+            NEXT;
+        OP(0x17)        //    RAL
+        {
+            bool cy = state->f & FLAG_CY;
+            set_carry(state, state->a >> 7);
+            state->a = (state->a << 1) | cy;
+            state->pc += 1;
+            NEXT;
+        }    
+        OP(0x18) state->pc += 1; NEXT; //    *NOP
+        OP(0x19)        //    DAD D
+            dad_d(state);
+            state->pc += 1;
+            NEXT;
+        OP(0x1a)        //    LDAX D
+            state->a = read_memory(state, read_de(state));
+            state->pc += 1;
+            NEXT;
+        OP(0x1b)        //    DCX D
+            write_de(state, read_de(state) - 1);
+            state->pc += 1;
+            NEXT;
+        OP(0x1c)        //    INR E
+            state->e = inr(state, state->e);
+            state->pc += 1;
+            NEXT;
+        OP(0x1d)        //    DCR E
+            state->e = dcr(state, state->e);
+            state->pc += 1;
+            NEXT;
+        OP(0x1e)        //    MVI E, byte
+            state->e = opcode[1];
+            state->pc += 2;
+            NEXT;
+        OP(0x1f)        //    RAR
+        {
+            bool cy = state->f & FLAG_CY;
+            set_carry(state, state->a & 1);
+            state->a = (state->a >> 1) | (cy << 7);
+            state->pc += 1;
+            NEXT;
+        }    
+        OP(0x20) state->pc += 1; NEXT; //    *NOP
+        OP(0x21)        //    LXI H, word
+        {
+            uint16_t value = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
+            write_hl(state, value);
+            state->pc += 3;
+            NEXT;
+        }    
+        OP(0x22)        //    SHLD word
+        {
+            uint16_t address = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
+            write_memory(state, address, state->l);
+            write_memory(state, address + 1, state->h);
+            state->pc += 3;
+            NEXT;
+        }    
+        OP(0x23)        //    INX H
+            // printf("PREVIOUS HL %04x\n", read_hl(state));
+            write_hl(state, read_hl(state) + 1);
+            // printf("AFTER INX HL %04x\n", read_hl(state));
+            state->pc += 1;
+            NEXT;
+        OP(0x24)        //    INR H
+            state->h = inr(state, state->h);
+            state->pc += 1;
+            NEXT;
+        OP(0x25)        //    DCR H
+            state->h = dcr(state, state->h);
+            state->pc += 1;
+            NEXT;
+        OP(0x26)        //    MVI H, byte
+            state->h = opcode[1];
+            state->pc += 2;
+            NEXT;
+        OP(0x27)        //    DAA
+        {
+            bool cy = state->f & FLAG_CY;
+            uint8_t correction = 0;
+
+            uint8_t lsb = state->a & 0x0F;
+            uint8_t msb = state->a >> 4;
+
+            if ((state->f & FLAG_AC) || lsb > 9) {
+                correction += 0x06;
+            }
+
+            if ((state->f & FLAG_CY) || msb > 9 || (msb >= 9 && lsb > 9)) {
+                correction += 0x60;
+                cy = 1;
+            }
+
+            add(state, &state->a, correction, 0);
+
+            set_carry(state, cy);
+            state->pc += 1;
+            NEXT;
+        }
+        OP(0x28) state->pc += 1; NEXT; //    *NOP
+        OP(0x29)        //    DAD H 
+            dad_h(state);
+            state->pc += 1;
+            NEXT;
+        OP(0x2a)        //    LHLD word
+        {
+            uint16_t address = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
+            state->l = read_memory(state, address);
+            state->h = read_memory(state, address + 1);
+            state->pc += 3;
+            NEXT;
+        }    
+        OP(0x2b)        //    DCX H
+            write_hl(state, read_hl(state) - 1);
+            state->pc += 1;
+            NEXT;
+        OP(0x2c)        //    INR L
+            state->l = inr(state, state->l);
+            state->pc += 1;
+            NEXT;
+        OP(0x2d)        //    DCR L
+            state->l = dcr(state, state->l);
+            state->pc += 1;
+            NEXT;
+        OP(0x2e)        //    MVI L, byte
+            state->l = opcode[1];
+            state->pc += 2;
+            NEXT;
+        OP(0x2f)        //    CMA
+            state->a = ~state->a;
+            state->pc += 1;
+            NEXT;
+        
+        OP(0x30) state->pc += 1; NEXT; //    *NOP
+        OP(0x31)        //    LXI SP, word
+        {
+            uint16_t value = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
+            write_sp(state, value);
+            state->pc += 3;
+            NEXT;
+        }    
+        OP(0x32)        //    STA, word
+        {
+            uint16_t address = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
+            write_memory(state, address, state->a);
+            state->pc += 3;
+            NEXT;
+        }    
+        OP(0x33)        //    INX SP
+            state->sp++;
+            state->pc += 1;
+            NEXT;
+        OP(0x34)        //    INR M 
+            write_memory(state, read_hl(state), inr(state, read_memory(state, read_hl(state))));
+            state->pc += 1;
+            NEXT;
+        OP(0x35)        //    DCR M
+            write_memory(state, read_hl(state), dcr(state, read_memory(state, read_hl(state))));
+            state->pc += 1;
+            NEXT;
+        OP(0x36)        //    MVI M, byte
+            write_memory(state, read_hl(state), opcode[1]);
+            state->pc += 2;
+            NEXT;
+        OP(0x37)        //    STC
+            state->f |= FLAG_CY;
+            state->pc += 1;
+            NEXT;
+        OP(0x38)        //    *NOP
+            state->pc += 1;
+            NEXT;
+        OP(0x39)        //    DAD SP
+            dad_sp(state);
+            state->pc += 1;
+            NEXT;
+        OP(0x3a)        //    LDA word
+        {
+            uint16_t address = opcode[1] + (opcode[2] << 8); // combine the two bytes in the correct order
+            state->a = read_memory(state, address);
+            state->pc += 3;
+            NEXT;
+        }    
+        OP(0x3b)        //    DCX SP 
+            state->sp--;
+            state->pc += 1;
+            NEXT;
+        OP(0x3c)        //    INR A
+            state->a = inr(state, state->a);
+            state->pc += 1;
+            NEXT;
+        OP(0x3d)        //    DCR A
+            state->a = dcr(state, state->a);
+            state->pc += 1;
+            NEXT;
+        OP(0x3e)        //    MVI A, byte
+            state->a = opcode[1];
+            state->pc += 2;
+            NEXT;
+        OP(0x3f)        //    CMC
+            state->f ^= FLAG_CY;
+            state->pc += 1;
+            NEXT;
+
+        OP(0x40)        //    MOV B, B
+            state->b = state->b;
+            state->pc += 1;
+            NEXT;
+        OP(0x41)        //    MOV B, C
+            state->b = state->c;
+            state->pc += 1;
+            NEXT;
+        OP(0x42)        //    MOV B, D
+            state->b = state->d;
+            state->pc += 1;
+            NEXT;
+        OP(0x43)        //    MOV B, E
+            state->b = state->e;
+            state->pc += 1;
+            NEXT;
+        OP(0x44)        //    MOV B, H
+            state->b = state->h;
+            state->pc += 1;
+            NEXT;
+        OP(0x45)        //    MOV B, L
+            state->b = state->l;
+            state->pc += 1;
+            NEXT;
+        OP(0x46)        //    MOV B, M
+            state->b = read_memory(state, read_hl(state));
+            state->pc += 1;
+            NEXT;
+        OP(0x47)        //    MOV B, A
+            state->b = state->a;
+            state->pc += 1;
+            NEXT;
+        OP(0x48)        //    MOV C, B
+            state->c = state->b;
+            state->pc += 1;
+            NEXT;
+        OP(0x49)        //    MOV C, C
+            state->c = state->c;
+            state->pc += 1;
+            NEXT;
+        OP(0x4a)        //    MOV C, D
+            state->c = state->d;
+            state->pc += 1;
+            NEXT;
+        OP(0x4b)        //    MOV C, E
+            state->c = state->e;
+            state->pc += 1;
+            NEXT;
+        OP(0x4c)        //    MOV C, H
+            state->c = state->h;
+            state->pc += 1;
+            NEXT;
+        OP(0x4d)        //    MOV C, L
+            state->c = state->l;
+            state->pc += 1;
+            NEXT;
+        OP(0x4e)        //    MOV C, M
+            state->c = read_memory(state, read_hl(state));
+            state->pc += 1;
+            NEXT;
+        OP(0x4f)        //    MOV C, A
+            state->c = state->a;
+            state->pc += 1;
+            NEXT;
+
+        OP(0x50)        //    MOV D, B
+            state->d = state->b;
+            state->pc += 1;
+            NEXT;
+        OP(0x51)        //    MOV D, C
+            state->d = state->c;
+            state->pc += 1;
+            NEXT;
+        OP(0x52)        //    MOV D, D
+            state->d = state->d;
+            state->pc += 1;
+            NEXT;
+        OP(0x53)        //    MOV D, E
+            state->d = state->e;
+            state->pc += 1;
+            NEXT;
+        OP(0x54)        //    MOV D, H
+            state->d = state->h;
+            state->pc += 1;
+            NEXT;
+        OP(0x55)        //    MOV D, L
+            state->d = state->l;
+            state->pc += 1;
+            NEXT;
+        OP(0x56)        //    MOV D, M
+            state->d = read_memory(state, read_hl(state));
+            state->pc += 1;
+            NEXT;
+        OP(0x57)        //    MOV D, A
+            state->d = state->a;
+            state->pc += 1;
+            NEXT;
+        OP(0x58)        //    MOV E, B
+            state->e = state->b;
+            state->pc += 1;
+            NEXT;
+        OP(0x59)        //    MOV E, C
+            state->e = state->c;
+            state->pc += 1;
+            NEXT;
+        OP(0x5a)        //    MOV E, D
+            state->e = state->d;
+            state->pc += 1;
+            NEXT;
+        OP(0x5b)        //    MOV E, E
+            state->e = state->e;
+            state->pc += 1;
+            NEXT;
+        OP(0x5c)        //    MOV E, H
+            state->e = state->h;
+            state->pc += 1;
+            NEXT;
+        OP(0x5d)        //    MOV E, L
+            state->e = state->l;
+            state->pc += 1;
+            NEXT;
+        OP(0x5e)        //    MOV E, M
+            state->e = read_memory(state, read_hl(state));
+            state->pc += 1;
+            NEXT;
+        OP(0x5f)        //    MOV E, A
+            state->e = state->a;
+            state->pc += 1;
+            NEXT;
+
+        OP(0x60)        //    MOV H, B
+            state->h = state->b;
+            state->pc += 1;
+            NEXT;
+        OP(0x61)        //    MOV H, C
+            state->h = state->c;
+            state->pc += 1;
+            NEXT;
+        OP(0x62)        //    MOV H, D
+            state->h = state->d;
+            state->pc += 1;
+            NEXT;
+        OP(0x63)        //    MOV H, E
+            state->h = state->e;
+            state->pc += 1;
+            NEXT;
+        OP(0x64)        //    MOV H, H
+            state->h = state->h;
+            state->pc += 1;
+            NEXT;
+        OP(0x65)        //    MOV H, L
+            state->h = state->l;
+            state->pc += 1;
+            NEXT;
+        OP(0x66)        //    MOV H, M
+            state->h = read_memory(state, read_hl(state));
+            state->pc += 1;
+            NEXT;
+        OP(0x67)        //    MOV H, A
+            state->h = state->a;
+            state->pc += 1;
+            NEXT;
+        OP(0x68)        //    MOV L, B
+            state->l = state->b;
+            state->pc += 1;
+            NEXT;
+        OP(0x69)        //    MOV L, C
+            state->l = state->c;
+            state->pc += 1;
+            NEXT;
+        OP(0x6a)        //    MOV L, D
+            state->l = state->d;
+            state->pc += 1;
+            NEXT;
+        OP(0x6b)        //    MOV L, E
+            state->l = state->e;
+            state->pc += 1;
+            NEXT;
+        OP(0x6c)        //    MOV L, H
+            state->l = state->h;
+            state->pc += 1;
+            NEXT;
+        OP(0x6d)        //    MOV L, L
+            state->l = state->l;
+            state->pc += 1;
+            NEXT;
+        OP(0x6e)        //    MOV L, M
+            state->l = read_memory(state, read_hl(state));
+            state->pc += 1;
+            NEXT;
+        OP(0x6f)        //    MOV L, A
+            state->l = state->a;
+            state->pc += 1;
+            NEXT;
+        
+        OP(0x70)        //    MOV M, B
+            write_memory(state, read_hl(state), state->b);
+            state->pc += 1;
+            NEXT;
+        OP(0x71)        //    MOV M, C
+            write_memory(state, read_hl(state), state->c);
+            state->pc += 1;
+            NEXT;
+        OP(0x72)        //    MOV M, D
+            write_memory(state, read_hl(state), state->d);
+            state->pc += 1;
+            NEXT;
+        OP(0x73)        //    MOV M, E
+            write_memory(state, read_hl(state), state->e);
+            state->pc += 1;
+            NEXT;
+        OP(0x74)        //    MOV M, H
+            write_memory(state, read_hl(state), state->h);
+            state->pc += 1;
+            NEXT;
+        OP(0x75)        //    MOV M, L
+            write_memory(state, read_hl(state), state->l);
+            state->pc += 1;
+            NEXT;
+        OP(0x76)        //    HLT
+            state->halted = 1;
+            state->pc += 1;
+            HALT;
+        OP(0x77)        //    MOV M, A
+            write_memory(state, read_hl(state), state->a);
+            state->pc += 1;
+            NEXT;
+        OP(0x78)        //    MOV A, B
+            state->a = state->b;
+            state->pc += 1;
+            NEXT;
+        OP(0x79)        //    MOV A, C
+            state->a = state->c;
+            state->pc += 1;
+            NEXT;
+        OP(0x7a)        //    MOV A, D
+            state->a = state->d;
+            state->pc += 1;
+            NEXT;
+        OP(0x7b)        //    MOV A, E
+            state->a = state->e;
+            state->pc += 1;
+            NEXT;
+        OP(0x7c)        //    MOV A, H
+            state->a = state->h;
+            state->pc += 1;
+            NEXT;
+        OP(0x7d)        //    MOV A, L
+            state->a = state->l;
+            state->pc += 1;
+            NEXT;
+        OP(0x7e)        //    MOV A, M
+            state->a = read_memory(state, read_hl(state));
+            state->pc += 1;
+            NEXT;
+        OP(0x7f)        //    MOV A, A
+            state->a = state->a;
+            state->pc += 1;
+            NEXT;
+        
+        OP(0x80)        //    ADD B
+            add(state, &state->a, state->b, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x81)        //    ADD C
+            add(state, &state->a, state->c, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x82)        //    ADD D
+            add(state, &state->a, state->d, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x83)        //    ADD E
+            add(state, &state->a, state->e, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x84)        //    ADD H
+            add(state, &state->a, state->h, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x85)        //    ADD L
+            add(state, &state->a, state->l, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x86)        //    ADD M
+            add(state, &state->a, read_memory(state, read_hl(state)), 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x87)        //    ADD A
+            add(state, &state->a, state->a, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x88)        //    ADC B
+            add(state, &state->a, state->b, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        OP(0x89)        //    ADC C
+            add(state, &state->a, state->c, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        OP(0x8a)        //    ADC D
+            add(state, &state->a, state->d, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        OP(0x8b)        //    ADC E
+            add(state, &state->a, state->e, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        OP(0x8c)        //    ADC H
+            add(state, &state->a, state->h, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        OP(0x8d)        //    ADC L
+            add(state, &state->a, state->l, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        OP(0x8e)        //    ADC M
+            add(state, &state->a, read_memory(state, read_hl(state)), state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        OP(0x8f)        //    ADC A
+            add(state, &state->a, state->a, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        
+        OP(0x90)        //    SUB B 
+            subtract(state, &state->a, state->b, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x91)        //    SUB C 
+            subtract(state, &state->a, state->c, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x92)        //    SUB D 
+            subtract(state, &state->a, state->d, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x93)        //    SUB E
+            subtract(state, &state->a, state->e, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x94)        //    SUB H 
+            subtract(state, &state->a, state->h, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x95)        //    SUB L 
+            subtract(state, &state->a, state->l, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x96)        //    SUB M 
+            subtract(state, &state->a, read_memory(state, read_hl(state)), 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x97)        //    SUB A 
+            subtract(state, &state->a, state->a, 0);
+            state->pc += 1;
+            NEXT;
+        OP(0x98)        //    SBB B
+            subtract(state, &state->a, state->b, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        OP(0x99)        //    SBB C 
+            subtract(state, &state->a, state->c, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        OP(0x9a)        //    SBB D
+            subtract(state, &state->a, state->d, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        OP(0x9b)        //    SBB E
+            subtract(state, &state->a, state->e, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        OP(0x9c)        //    SBB H
+            subtract(state, &state->a, state->h, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;
+        OP(0x9d)        //    SBB L
+            subtract(state, &state->a, state->l, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;  
+        OP(0x9e)        //    SBB M
+            subtract(state, &state->a, read_memory(state, read_hl(state)), state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT; 
+        OP(0x9f)        //    SBB A
+            subtract(state, &state->a, state->a, state->f & FLAG_CY);
+            state->pc += 1;
+            NEXT;  
+        
+        OP(0xa0)        //    ANA B
+            ana(state, state->b);
+            state->pc += 1;
+            NEXT;
+        OP(0xa1)        //    ANA C
+            ana(state, state->c);
+            state->pc += 1;
+            NEXT;
+        OP(0xa2)        //    ANA D
+            ana(state, state->d);
+            state->pc += 1;
+            NEXT;
+        OP(0xa3)        //    ANA E
+            ana(state, state->e);
+            state->pc += 1;
+            NEXT;
+        OP(0xa4)        //    ANA H
+            ana(state, state->h);
+            state->pc += 1;
+            NEXT;
+        OP(0xa5)        //    ANA L
+            ana(state, state->l);
+            state->pc += 1;
+            NEXT;
+        OP(0xa6)        //    ANA M
+            ana(state, read_memory(state, read_hl(state)));
+            state->pc += 1;
+            NEXT;
+        OP(0xa7)        //    ANA A
+            ana(state, state->a);
+            state->pc += 1;
+            NEXT;
+        OP(0xa8)        //    XRA B
+            xra(state, state->b);
+            state->pc += 1;
+            NEXT;
+        OP(0xa9)        //    XRA C
+            xra(state, state->c);
+            state->pc += 1;
+            NEXT;
+        OP(0xaa)        //    XRA D
+            xra(state, state->d);
+            state->pc += 1;
+            NEXT;
+        OP(0xab)        //    XRA E
+            xra(state, state->e);
+            state->pc += 1;
+            NEXT;
+        OP(0xac)        //    XRA H
+            xra(state, state->h);
+            state->pc += 1;
+            NEXT;
+        OP(0xad)        //    XRA L
+            xra(state, state->l);
+            state->pc += 1;
+            NEXT;
+        OP(0xae)        //    XRA M
+            xra(state, read_memory(state, read_hl(state)));
+            state->pc += 1;
+            NEXT;
+        OP(0xaf)        //    XRA A
+            xra(state, state->a);
+            state->pc += 1;
+            NEXT;
+
+        OP(0xb0)        //    ORA B
+            ora(state, state->b);
+            state->pc += 1;
+            NEXT;
+        OP(0xb1)        //    ORA C
+            ora(state, state->c);
+            state->pc += 1;
+            NEXT;
+        OP(0xb2)        //    ORA D
+            ora(state, state->d);
+            state->pc += 1;
+            NEXT;
+        OP(0xb3)        //    ORA E
+            ora(state, state->e);
+            state->pc += 1;
+            NEXT;
+        OP(0xb4)        //    ORA H
+            ora(state, state->h);
+            state->pc += 1;
+            NEXT;
+        OP(0xb5)        //    ORA L
+            ora(state, state->l);
+            state->pc += 1;
+            NEXT;
+        OP(0xb6)        //    ORA M
+            ora(state, read_memory(state, read_hl(state)));
+            state->pc += 1;
+            NEXT;
+        OP(0xb7)        //    ORA A
+            ora(state, state->a);
+            state->pc += 1;
+            NEXT;
+        OP(0xb8)        //    CMP B
+        {
+            cmp(state, state->b);
+            state->pc += 1;
+            NEXT;
+        }    
+        OP(0xb9)        //    CMP C
+        {   
+            cmp(state, state->c);
+            state->pc += 1;
+            NEXT;
+        }
+        OP(0xba)        //    CMP D
+        {   
+            cmp(state, state->d);
+            state->pc += 1;
+            NEXT;
+        }
+        OP(0xbb)        //    CMP E
+        {  
+            cmp(state, state->e);
+            state->pc += 1;
+            NEXT;
+        }
+        OP(0xbc)        //    CMP H
+        {   
+            cmp(state, state->h);
+            state->pc += 1;
+            NEXT;
+        }
+        OP(0xbd)        //    CMP L
+        {   
+            cmp(state, state->l);
+            state->pc += 1;
+            NEXT;
+        }
+        OP(0xbe)        //    CMP M
+        {   
+            cmp(state, read_memory(state, read_hl(state)));
+            state->pc += 1;
+            NEXT;
+        }
+        OP(0xbf)        //    CMP A
+        {   
+            cmp(state, state->a);
+            state->pc += 1;
+            NEXT;
+        }
+        OP(0xc0)        //    RNZ
+            if (!(state->f & FLAG_Z))
+                ret(state);
+            else
+                state->pc += 1;
+            NEXT;
+        OP(0xc1)        //    POP B
+            write_bc(state, pop(state));
+            state->pc += 1;
+            NEXT;
+        OP(0xc2)        //    JNZ word
+            if (!(state->f & FLAG_Z))
+                jmp(state, ((opcode[2] << 8) | opcode[1]));
+            else
+                state->pc += 3;
+            NEXT;
+        OP(0xc3)        //    JMP word
+            jmp(state, ((opcode[2] << 8) | opcode[1]));
+            NEXT;
+        OP(0xc4)        //    CNZ
+            state->pc += 3;
+            if(!(state->f & FLAG_Z))
+                call(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;
+        OP(0xc5)        //    PUSH B
+            push(state, read_bc(state));
+            state->pc += 1;
+            NEXT;
+        OP(0xc6)        //    ADI byte
+            add(state, &state->a, opcode[1], 0);
+            state->pc += 2;
+            NEXT;
+        OP(0xc7)        //    RST 0
+            call(state, 0x00);
+            // state->pc += 1;
+            NEXT;
+        OP(0xc8)        //    RZ
+            if (state->f & FLAG_Z)
+                ret(state);
+            else
+                state->pc += 1;
+            NEXT;
+        OP(0xc9)        //    RET
+            ret(state);
+            NEXT;
+        OP(0xca)        //    JZ word
+            if (state->f & FLAG_Z)
+                jmp(state, (opcode[2] << 8) | opcode[1]);
+            else
+                state->pc += 3;
+            NEXT;
+        OP(0xcb)        //    JMP word
+            jmp(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;
+        OP(0xcc)        //    CZ word
+            state->pc += 3;
+            if (state->f & FLAG_Z)
+                call(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;
+        OP(0xcd)        //    CALL word
+            if(FOR_CPUDIAG) {
+                if (5 ==  ((opcode[2] << 8) | opcode[1]))    
+                {    
+                    if (state->c == 9)    
+                    {    
+                        uint16_t offset = (state->d<<8) | (state->e);    
+                        char *str = &state->memory[offset + 3];  //skip the prefix bytes    
+                        bool failed = true;
+                        while (*str != '$') {
+                            printf("%c", *str++);    
+                            if(*str == 'F')
+                                failed = true;
+                        }
+                        printf("\n");   
+                        if(failed)
+                            getchar(); 
+                    }    
+                    else if (state->c == 2)    
+                    {    
+                        //saw this in the inspected code, never saw it called    
+                        printf ("print char routine called\n");    
+                    }  
+                    
+                    
+                }    
+                else if (0 ==  ((opcode[2] << 8) | opcode[1]))    
+                {    
+                    exit(0); 
+                }    
+            }
+            state->pc += 3;
+            call(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;
+        OP(0xce)        //    ACI byte
+            add(state, &state->a, opcode[1], state->f & FLAG_CY);
+            state->pc += 2;
+            NEXT;
+        OP(0xcf)        //    RST 1
+            state->pc += 1;
+            call(state, 0x08);
+            NEXT;
+        
+        OP(0xd0)        //    RNC
+            if(!(state->f & FLAG_CY))
+                ret(state);
+            else
+                state->pc += 1;
+            NEXT;
+        OP(0xd1)        //    POP D
+            write_de(state, pop(state));
+            state->pc += 1;
+            NEXT;
+        OP(0xd2)        //    JNC word
+            if(!(state->f & FLAG_CY))
+                jmp(state, (opcode[2] << 8) | opcode[1]);
+            else
+                state->pc += 3;
+            NEXT;
+        OP(0xd3)        //    OUT byte
+            if (state->port_out)
+                state->port_out(state->io_context, opcode[1], state->a);
+            else
+                unimplemented_instruction(state);
+            state->pc += 2;
+            NEXT;
+        OP(0xd4)        //    CNC word
+            state->pc += 3;
+            if(!(state->f & FLAG_CY))
+                call(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;
+        OP(0xd5)        //    PUSH D
+            push(state, read_de(state));
+            state->pc += 1;
+            NEXT;
+        OP(0xd6)        //    SUI byte
+            subtract(state, &state->a, opcode[1], 0);
+            state->pc += 2;
+            NEXT;
+        OP(0xd7)        //    RST 2
+            state->pc += 1;
+            call(state, 0x10);
+            NEXT;
+        OP(0xd8)        //    RC 
+            if (state->f & FLAG_CY)
+                ret(state);
+            else
+                state->pc += 1;
+            NEXT;
+        OP(0xd9)        //    *RET
+            ret(state);
+            state->pc += 1;
+            NEXT;
+        OP(0xda)        //    JC word
+            if (state->f & FLAG_CY)
+                jmp(state, (opcode[2] << 8) | opcode[1]);
+            else
+                state->pc += 3;
+            NEXT;
+        OP(0xdb)        //    IN byte
+            if (state->port_in)
+                state->a = state->port_in(state->io_context, opcode[1]);
+            else
+                unimplemented_instruction(state);
+            state->pc += 2;
+            NEXT;
+        OP(0xdc)        //    CC word
+            state->pc += 3;
+            if (state->f & FLAG_CY)
+                call(state, (opcode[2] << 8) | opcode[1]);
+            // printf("FINISHED EXECUTION OF OPERATION CC\n");
+            NEXT;
+        OP(0xdd)        //    *CALL word
+            state->pc += 3;
+            call(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;
+        OP(0xde)        //    SBI byte
+            subtract(state, &state->a, opcode[1], state->f & FLAG_CY);
+            state->pc += 2;
+            NEXT;
+        OP(0xdf)        //    RST 3
+            state->pc += 1;
+            call(state, 0x18);
+            NEXT;
+        
+        OP(0xe0)        //    RPO
+            if(!(state->f & FLAG_P))
+                ret(state);
+            else
+                state->pc += 1;
+            NEXT;
+        OP(0xe1)        //    POP H
+            write_hl(state, pop(state));
+            state->pc += 1;
+            NEXT;
+        OP(0xe2)        //    JPO word
+            state->pc += 3;
+            if(!(state->f & FLAG_P))
+                jmp(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;
+        OP(0xe3)        //    XTHL
+        {
+            uint16_t val = (read_memory(state, state->sp + 1) << 8) | read_memory(state, state->sp);
+            write_memory(state, state->sp + 1, state->h);
+            write_memory(state, state->sp, state->l);
+            write_hl(state, val);
+            state->pc += 1;
+            NEXT;
+        }
+        OP(0xe4)        //    CPO word
+            state->pc += 3;
+            if(!(state->f & FLAG_P))
+                call(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;
+        OP(0xe5)        //    PUSH H
+            push(state, read_hl(state));
+            state->pc += 1;
+            NEXT;
+        OP(0xe6)        //    ANI byte
+            ana(state, opcode[1]);
+            state->pc += 2;
+            NEXT;
+        OP(0xe7)        //    RST 4
+            state->pc += 1;
+            call(state, 0x20);
+            NEXT;
+        OP(0xe8)        //    RPE 
+            if (state->f & FLAG_P)
+                ret(state);
+            else
+                state->pc += 1;
+            NEXT;
+        OP(0xe9)        //    PCHL
+            state->pc = read_hl(state);
+            NEXT;
+        OP(0xea)        //    JPE word
+            if (state->f & FLAG_P)
+                jmp(state, (opcode[2] << 8) | opcode[1]);
+            else
+                state->pc += 3;
+            NEXT;
+        OP(0xeb)        //    XCHG word
+        {   uint16_t hl = read_hl(state);
+            write_hl(state, read_de(state));
+            write_de(state, hl);
+            state->pc += 1;
+            NEXT;
+        }
+        OP(0xec)        //    CPE word
+            state->pc += 3;
+            if (state->f & FLAG_P)
+                call(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;  
+        OP(0xed)        //    *CALL word
+            state->pc += 3;
+            call(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;  
+        OP(0xee)        //    XRI byte
+            xra(state, opcode[1]);
+            state->pc += 2;
+            NEXT;
+        OP(0xef)        //    RST 5
+            state->pc += 1;
+            call(state, 0x28);
+            NEXT;
+
+        OP(0xf0)        //    RP 
+            if(!(state->f & FLAG_S))
+                ret(state);
+            else
+                state->pc += 1;
+            NEXT;
+        OP(0xf1)        //    POP PSW 
+        {   
+            uint16_t af = pop(state);
+            state->a = (af >> 8);
+            state->f = (af & (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P | FLAG_CY)) | FLAG_ONE;
+            state->pc += 1;
+            NEXT;
+        }
+        OP(0xf2)        //    JP word 
+            if(!(state->f & FLAG_S))
+                jmp(state, (opcode[2] << 8) | opcode[1]);
+            else
+                state->pc += 3;
+            NEXT;
+        OP(0xf3)        //    DI 
+            state->int_enable = 0;
+            state->pc += 1;
+            NEXT;
+        OP(0xf4)        //    CP word
+            state->pc += 3;
+            if(!(state->f & FLAG_S))
+                call(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;
+        OP(0xf5)        //    PUSH PSW
+        {
+            push(state, (state->a << 8) | state->f);
+            state->pc += 1;
+            NEXT;
+        }
+        OP(0xf6)        //    ORI byte
+            ora(state, opcode[1]);
+            state->pc += 2;
+            NEXT;
+        OP(0xf7)        //    RST 6
+            state->pc += 1;
+            call(state, 0x30);
+            NEXT;
+        OP(0xf8)        //    RM
+            if (state->f & FLAG_S)
+                ret(state);
+            else
+                state->pc += 1;
+            NEXT;
+        OP(0xf9)        //    SPHL
+            state->sp = read_hl(state);
+            state->pc += 1;
+            NEXT;
+        OP(0xfa)        //    JM word
+            if (state->f & FLAG_S)
+                jmp(state, (opcode[2] << 8) | opcode[1]);
+            else
+                state->pc += 3;
+            NEXT;
+        OP(0xfb)        //    EI
+            state->int_enable = 1;
+            state->pc += 1;
+            NEXT;
+        OP(0xfc)        //    CM word
+            state->pc += 3;
+            if (state->f & FLAG_S)
+                call(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;
+        OP(0xfd)        //    *CALL word
+            state->pc += 3;
+            call(state, (opcode[2] << 8) | opcode[1]);
+            NEXT;
+        OP(0xfe)        //    CPI byte
+            cmp(state, opcode[1]);
+            state->pc += 2;
+            NEXT;  
+        OP(0xff)        //    RST 7
+            state->pc += 1;
+            call(state, 0x38);
+            NEXT;
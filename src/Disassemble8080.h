@@ -1,300 +1,361 @@
-
 #include <stdio.h>
-#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
-/*  codebuffer is a valid pointer to 8080 assembly code    
-    pc (program counter) is the current offset into the code    
-    returns the number of bytes of the op   
+/*  8080 disassembler.
+    disassemble8080 decodes one instruction from a table into a caller
+    buffer and returns its length, without touching stdio, so traces,
+    the debugger and tools can format instructions wherever they need
+    them. The table also records which instructions transfer control to
+    a fixed address, for tools that label jump and call targets.
+    Disassemble8080Op is the printing wrapper the emulator has always used.
 */
 
-int Disassemble8080Op(unsigned char *codebuffer, int pc) {
-    unsigned char *code = &codebuffer[pc];
-    int opbytes = 1; // set # of bytes for operation to 1 by default
-    printf("%04x ", pc); // print the program counter addressl
-
-    switch (*code) 
-    {
-        // dissasemble hex code into operations in assembly
-
-        case 0x00: printf("NOP"); break;
-        case 0x01: printf("LXI    B #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x02: printf("STAX   B"); break;
-        case 0x03: printf("INX    B"); break;
-        case 0x04: printf("INR    B"); break;
-        case 0x05: printf("DCR    B"); break;
-        case 0x06: printf("MVI    B #$%02x", code[1]), opbytes = 2; break;
-        case 0x07: printf("RLC"); break;
-        case 0x08: printf("*NOP"); break;
-        case 0x09: printf("DAD    B"); break;
-        case 0x0a: printf("LDAX   B"); break;
-        case 0x0b: printf("DCX    B"); break;
-        case 0x0c: printf("INR    C"); break;
-        case 0x0d: printf("DCR    C"); break;
-        case 0x0e: printf("MVI    C #$%02x", code[1]); opbytes = 2; break;
-        case 0x0f: printf("RRC"); break;
-
-        case 0x10: printf("*NOP"); break;
-        case 0x11: printf("LXI    D #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x12: printf("STAX   D"); break;
-        case 0x13: printf("INX    D"); break;
-        case 0x14: printf("INR    D"); break;
-        case 0x15: printf("DCR    D"); break;
-        case 0x16: printf("MVI    D #$%02x", code[1]); opbytes = 2; break;
-        case 0x17: printf("RAL"); break;
-        case 0x18: printf("*NOP"); break;
-        case 0x19: printf("DAD    D"); break;
-        case 0x1a: printf("LDAX   D"); break;
-        case 0x1b: printf("DCX    D"); break; 
-        case 0x1c: printf("INR    E"); break;
-        case 0x1d: printf("DCR    E"); break;
-        case 0x1e: printf("MVI    E #$%02x", code[1]); opbytes = 2; break;
-        case 0x1f: printf("RAR"); break;
-
-        case 0x20: printf("*NOP"); break;
-        case 0x21: printf("LXI    H #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x22: printf("SHLD   $%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x23: printf("INX    H"); break;
-        case 0x24: printf("INR    H"); break;
-        case 0x25: printf("DCR    H"); break;
-        case 0x26: printf("MVI    H #$%02x", code[1]); opbytes = 2; break;
-        case 0x27: printf("DAA"); break;
-        case 0x28: printf("*NOP"); break;
-        case 0x29: printf("DAD    H"); break;
-        case 0x2a: printf("LHLD   #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x2b: printf("DCX    H"); break; 
-        case 0x2c: printf("INR    L"); break;
-        case 0x2d: printf("DCR    L"); break;
-        case 0x2e: printf("MVI    L #$%02x", code[1]); opbytes = 2; break;
-        case 0x2f: printf("CMA"); break;
-
-        case 0x30: printf("*NOP"); break;
-        case 0x31: printf("LXI    SP #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x32: printf("STA    #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x33: printf("INX    SP"); break;
-        case 0x34: printf("INR    M"); break;
-        case 0x35: printf("DCR    M"); break;
-        case 0x36: printf("MVI    M #$%02x", code[1]); opbytes = 2; break;
-        case 0x37: printf("STC"); break;
-        case 0x38: printf("*NOP"); break;
-        case 0x39: printf("DAD    SP"); break;
-        case 0x3a: printf("LDA    #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0x3b: printf("DCX    SP"); break;
-        case 0x3c: printf("INR    A"); break;
-        case 0x3d: printf("DCR    A"); break;
-        case 0x3e: printf("MVI    A #$%02x", code[1]); opbytes = 2; break;
-        case 0x3f: printf("CMC"); break;
-
-        case 0x40: printf("MOV    B, B"); break;
-        case 0x41: printf("MOV    B, C"); break;
-        case 0x42: printf("MOV    B, D"); break;
-        case 0x43: printf("MOV    B, E"); break;
-        case 0x44: printf("MOV    B, H"); break;
-        case 0x45: printf("MOV    B, L"); break;
-        case 0x46: printf("MOV    B, M"); break;
-        case 0x47: printf("MOV    B, A"); break;
-        case 0x48: printf("MOV    C, B"); break;
-        case 0x49: printf("MOV    C, C"); break;
-        case 0x4a: printf("MOV    C, D"); break;
-        case 0x4b: printf("MOV    C, E"); break;
-        case 0x4c: printf("MOV    C, H"); break;
-        case 0x4d: printf("MOV    C, L"); break;
-        case 0x4e: printf("MOV    C, M"); break;
-        case 0x4f: printf("MOV    C, A"); break;
-
-        case 0x50: printf("MOV    D, B"); break;
-        case 0x51: printf("MOV    D, C"); break;
-        case 0x52: printf("MOV    D, D"); break;
-        case 0x53: printf("MOV    D, E"); break;
-        case 0x54: printf("MOV    D, H"); break;
-        case 0x55: printf("MOV    D, L"); break;
-        case 0x56: printf("MOV    D, M"); break;
-        case 0x57: printf("MOV    D, A"); break;
-        case 0x58: printf("MOV    E, B"); break;
-        case 0x59: printf("MOV    E, C"); break;
-        case 0x5a: printf("MOV    E, D"); break;
-        case 0x5b: printf("MOV    E, E"); break;
-        case 0x5c: printf("MOV    E, H"); break;
-        case 0x5d: printf("MOV    E, L"); break;
-        case 0x5e: printf("MOV    E, M"); break;
-        case 0x5f: printf("MOV    E, A"); break;
-
-        case 0x60: printf("MOV    H, B"); break;
-        case 0x61: printf("MOV    H, C"); break;
-        case 0x62: printf("MOV    H, D"); break;
-        case 0x63: printf("MOV    H, E"); break;
-        case 0x64: printf("MOV    H, H"); break;
-        case 0x65: printf("MOV    H, L"); break;
-        case 0x66: printf("MOV    H, M"); break;
-        case 0x67: printf("MOV    H, A"); break;
-        case 0x68: printf("MOV    L, B"); break;
-        case 0x69: printf("MOV    L, C"); break;
-        case 0x6a: printf("MOV    L, D"); break;
-        case 0x6b: printf("MOV    L, E"); break;
-        case 0x6c: printf("MOV    L, H"); break;
-        case 0x6d: printf("MOV    L, L"); break;
-        case 0x6e: printf("MOV    L, M"); break;
-        case 0x6f: printf("MOV    L, A"); break;
-
-        case 0x70: printf("MOV    M, B"); break;
-        case 0x71: printf("MOV    M, C"); break;
-        case 0x72: printf("MOV    M, D"); break;
-        case 0x73: printf("MOV    M, E"); break;
-        case 0x74: printf("MOV    M, H"); break;
-        case 0x75: printf("MOV    M, L"); break;
-        case 0x76: printf("HLT"); break;
-        case 0x77: printf("MOV    M, A"); break;
-        case 0x78: printf("MOV    A, B"); break;
-        case 0x79: printf("MOV    A, C"); break;
-        case 0x7a: printf("MOV    A, D"); break;
-        case 0x7b: printf("MOV    A, E"); break;
-        case 0x7c: printf("MOV    A, H"); break;
-        case 0x7d: printf("MOV    A, L"); break;
-        case 0x7e: printf("MOV    A, M"); break;
-        case 0x7f: printf("MOV    A, A"); break;
+#define DISASM_TEXT_SIZE 20 // longest instruction text, "LXI    SP #$ffff", with its terminator
 
-        case 0x80: printf("ADD    B"); break;
-        case 0x81: printf("ADD    C"); break;
-        case 0x82: printf("ADD    D"); break;
-        case 0x83: printf("ADD    E"); break;
-        case 0x84: printf("ADD    H"); break;
-        case 0x85: printf("ADD    L"); break;
-        case 0x86: printf("ADD    M"); break;
-        case 0x87: printf("ADD    A"); break;
-        case 0x88: printf("ADC    B"); break;
-        case 0x89: printf("ADC    C"); break;
-        case 0x8a: printf("ADC    D"); break;
-        case 0x8b: printf("ADC    E"); break;
-        case 0x8c: printf("ADC    H"); break;
-        case 0x8d: printf("ADC    L"); break;
-        case 0x8e: printf("ADC    M"); break;
-        case 0x8f: printf("ADC    A"); break;
+typedef enum DisasmFlow {
+    DISASM_NONE,
+    DISASM_JUMP, // JMP and conditional jumps to a fixed address
+    DISASM_CALL, // CALL and conditional calls to a fixed address
+    DISASM_RST // call to the restart vector in bits 3-5
+} DisasmFlow;
 
-        case 0x90: printf("SUB    B"); break;
-        case 0x91: printf("SUB    C"); break;
-        case 0x92: printf("SUB    D"); break;
-        case 0x93: printf("SUB    E"); break;
-        case 0x94: printf("SUB    H"); break;
-        case 0x95: printf("SUB    L"); break;
-        case 0x96: printf("SUB    M"); break;
-        case 0x97: printf("SUB    A"); break;
-        case 0x98: printf("SBB    B"); break;
-        case 0x99: printf("SBB    C"); break;
-        case 0x9a: printf("SBB    D"); break;
-        case 0x9b: printf("SBB    E"); break;
-        case 0x9c: printf("SBB    H"); break;
-        case 0x9d: printf("SBB    L"); break;
-        case 0x9e: printf("SBB    M"); break;
-        case 0x9f: printf("SBB    A"); break;
-
-        case 0xa0: printf("ANA    B"); break;
-        case 0xa1: printf("ANA    C"); break;
-        case 0xa2: printf("ANA    D"); break;
-        case 0xa3: printf("ANA    E"); break;
-        case 0xa4: printf("ANA    H"); break;
-        case 0xa5: printf("ANA    L"); break;
-        case 0xa6: printf("ANA    M"); break;
-        case 0xa7: printf("ANA    A"); break;
-        case 0xa8: printf("XRA    B"); break;
-        case 0xa9: printf("XRA    C"); break;
-        case 0xaa: printf("XRA    D"); break;
-        case 0xab: printf("XRA    E"); break;
-        case 0xac: printf("XRA    H"); break;
-        case 0xad: printf("XRA    L"); break;
-        case 0xae: printf("XRA    M"); break;
-        case 0xaf: printf("XRA    A"); break;
-
-        case 0xb0: printf("ORA    B"); break;
-        case 0xb1: printf("ORA    C"); break;
-        case 0xb2: printf("ORA    D"); break;
-        case 0xb3: printf("ORA    E"); break;
-        case 0xb4: printf("ORA    H"); break;
-        case 0xb5: printf("ORA    L"); break;
-        case 0xb6: printf("ORA    M"); break;
-        case 0xb7: printf("ORA    A"); break;
-        case 0xb8: printf("CMP    B"); break;
-        case 0xb9: printf("CMP    C"); break;
-        case 0xba: printf("CMP    D"); break;
-        case 0xbb: printf("CMP    E"); break;
-        case 0xbc: printf("CMP    H"); break;
-        case 0xbd: printf("CMP    L"); break;
-        case 0xbe: printf("CMP    M"); break;
-        case 0xbf: printf("CMP    A"); break;
-
-        case 0xc0: printf("RNZ"); break;
-        case 0xc1: printf("POP    B"); break;
-        case 0xc2: printf("JNZ    #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xc3: printf("JMP    #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xc4: printf("CNZ    #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xc5: printf("PUSH   B"); break;
-        case 0xc6: printf("ADI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xc7: printf("RST    0"); break;
-        case 0xc8: printf("RZ"); break;
-        case 0xc9: printf("RET"); break;
-        case 0xca: printf("JZ     #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xcb: printf("*JMP   #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xcc: printf("CZ     #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xcd: printf("CALL   #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xce: printf("ACI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xcf: printf("RST    1"); break;
-
-        case 0xd0: printf("RNC"); break;
-        case 0xd1: printf("POP    D"); break;
-        case 0xd2: printf("JNC    #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xd3: printf("OUT    #$%02x", code[1]); opbytes = 2; break;
-        case 0xd4: printf("CNC    #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xd5: printf("PUSH   D"); break;
-        case 0xd6: printf("SUI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xd7: printf("RST    2"); break;
-        case 0xd8: printf("RC"); break;
-        case 0xd9: printf("*RET"); break;
-        case 0xda: printf("JC     #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xdb: printf("IN     #$%02x", code[1]); opbytes = 2; break;
-        case 0xdc: printf("CC     #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xdd: printf("*CALL  #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xde: printf("SBI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xdf: printf("RST    3"); break;
-
-        case 0xe0: printf("RPO"); break;
-        case 0xe1: printf("POP    H"); break;
-        case 0xe2: printf("JPO    #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xe3: printf("XTHL"); break;
-        case 0xe4: printf("CPO    #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xe5: printf("PUSH   H"); break;
-        case 0xe6: printf("ANI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xe7: printf("RST    4"); break;
-        case 0xe8: printf("RPE"); break;
-        case 0xe9: printf("PCHL"); break;
-        case 0xea: printf("JPE    #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xeb: printf("XCHG"); break;
-        case 0xec: printf("CPE    #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xed: printf("*CALL  #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xee: printf("XRI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xef: printf("RST    5"); break;
+/*  The text up to the operand, the instruction length in bytes (the
+    operand is a byte for 2, a little-endian word for 3) and the flow.
+    Undocumented opcodes are marked with a *.
+*/
+typedef struct DisasmOp {
+    const char *text;
+    uint8_t length;
+    uint8_t flow;
+} DisasmOp;
 
-        case 0xf0: printf("RP"); break;
-        case 0xf1: printf("POP    PSW"); break;
-        case 0xf2: printf("JP     #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xf3: printf("DI"); break;
-        case 0xf4: printf("CP     #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xf5: printf("PUSH   PSW"); break;
-        case 0xf6: printf("ORI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xf7: printf("RST    6"); break;
-        case 0xf8: printf("RM"); break;
-        case 0xf9: printf("SPHL"); break;
-        case 0xfa: printf("JM     #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xfb: printf("EI"); break;
-        case 0xfc: printf("CM     #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xfd: printf("*CALL  #$%02x%02x", code[2], code[1]); opbytes = 3; break;
-        case 0xfe: printf("CPI    #$%02x", code[1]); opbytes = 2; break;
-        case 0xff: printf("RST    7"); break;
+static const DisasmOp DISASM_OPS[256] = {
+    // 0x00
+    { "NOP",           1, DISASM_NONE },
+    { "LXI    B #$",   3, DISASM_NONE },
+    { "STAX   B",      1, DISASM_NONE },
+    { "INX    B",      1, DISASM_NONE },
+    { "INR    B",      1, DISASM_NONE },
+    { "DCR    B",      1, DISASM_NONE },
+    { "MVI    B #$",   2, DISASM_NONE },
+    { "RLC",           1, DISASM_NONE },
+    { "*NOP",          1, DISASM_NONE },
+    { "DAD    B",      1, DISASM_NONE },
+    { "LDAX   B",      1, DISASM_NONE },
+    { "DCX    B",      1, DISASM_NONE },
+    { "INR    C",      1, DISASM_NONE },
+    { "DCR    C",      1, DISASM_NONE },
+    { "MVI    C #$",   2, DISASM_NONE },
+    { "RRC",           1, DISASM_NONE },
+    // 0x10
+    { "*NOP",          1, DISASM_NONE },
+    { "LXI    D #$",   3, DISASM_NONE },
+    { "STAX   D",      1, DISASM_NONE },
+    { "INX    D",      1, DISASM_NONE },
+    { "INR    D",      1, DISASM_NONE },
+    { "DCR    D",      1, DISASM_NONE },
+    { "MVI    D #$",   2, DISASM_NONE },
+    { "RAL",           1, DISASM_NONE },
+    { "*NOP",          1, DISASM_NONE },
+    { "DAD    D",      1, DISASM_NONE },
+    { "LDAX   D",      1, DISASM_NONE },
+    { "DCX    D",      1, DISASM_NONE },
+    { "INR    E",      1, DISASM_NONE },
+    { "DCR    E",      1, DISASM_NONE },
+    { "MVI    E #$",   2, DISASM_NONE },
+    { "RAR",           1, DISASM_NONE },
+    // 0x20
+    { "*NOP",          1, DISASM_NONE },
+    { "LXI    H #$",   3, DISASM_NONE },
+    { "SHLD   $",      3, DISASM_NONE },
+    { "INX    H",      1, DISASM_NONE },
+    { "INR    H",      1, DISASM_NONE },
+    { "DCR    H",      1, DISASM_NONE },
+    { "MVI    H #$",   2, DISASM_NONE },
+    { "DAA",           1, DISASM_NONE },
+    { "*NOP",          1, DISASM_NONE },
+    { "DAD    H",      1, DISASM_NONE },
+    { "LHLD   #$",     3, DISASM_NONE },
+    { "DCX    H",      1, DISASM_NONE },
+    { "INR    L",      1, DISASM_NONE },
+    { "DCR    L",      1, DISASM_NONE },
+    { "MVI    L #$",   2, DISASM_NONE },
+    { "CMA",           1, DISASM_NONE },
+    // 0x30
+    { "*NOP",          1, DISASM_NONE },
+    { "LXI    SP #$",  3, DISASM_NONE },
+    { "STA    #$",     3, DISASM_NONE },
+    { "INX    SP",     1, DISASM_NONE },
+    { "INR    M",      1, DISASM_NONE },
+    { "DCR    M",      1, DISASM_NONE },
+    { "MVI    M #$",   2, DISASM_NONE },
+    { "STC",           1, DISASM_NONE },
+    { "*NOP",          1, DISASM_NONE },
+    { "DAD    SP",     1, DISASM_NONE },
+    { "LDA    #$",     3, DISASM_NONE },
+    { "DCX    SP",     1, DISASM_NONE },
+    { "INR    A",      1, DISASM_NONE },
+    { "DCR    A",      1, DISASM_NONE },
+    { "MVI    A #$",   2, DISASM_NONE },
+    { "CMC",           1, DISASM_NONE },
+    // 0x40
+    { "MOV    B, B",   1, DISASM_NONE },
+    { "MOV    B, C",   1, DISASM_NONE },
+    { "MOV    B, D",   1, DISASM_NONE },
+    { "MOV    B, E",   1, DISASM_NONE },
+    { "MOV    B, H",   1, DISASM_NONE },
+    { "MOV    B, L",   1, DISASM_NONE },
+    { "MOV    B, M",   1, DISASM_NONE },
+    { "MOV    B, A",   1, DISASM_NONE },
+    { "MOV    C, B",   1, DISASM_NONE },
+    { "MOV    C, C",   1, DISASM_NONE },
+    { "MOV    C, D",   1, DISASM_NONE },
+    { "MOV    C, E",   1, DISASM_NONE },
+    { "MOV    C, H",   1, DISASM_NONE },
+    { "MOV    C, L",   1, DISASM_NONE },
+    { "MOV    C, M",   1, DISASM_NONE },
+    { "MOV    C, A",   1, DISASM_NONE },
+    // 0x50
+    { "MOV    D, B",   1, DISASM_NONE },
+    { "MOV    D, C",   1, DISASM_NONE },
+    { "MOV    D, D",   1, DISASM_NONE },
+    { "MOV    D, E",   1, DISASM_NONE },
+    { "MOV    D, H",   1, DISASM_NONE },
+    { "MOV    D, L",   1, DISASM_NONE },
+    { "MOV    D, M",   1, DISASM_NONE },
+    { "MOV    D, A",   1, DISASM_NONE },
+    { "MOV    E, B",   1, DISASM_NONE },
+    { "MOV    E, C",   1, DISASM_NONE },
+    { "MOV    E, D",   1, DISASM_NONE },
+    { "MOV    E, E",   1, DISASM_NONE },
+    { "MOV    E, H",   1, DISASM_NONE },
+    { "MOV    E, L",   1, DISASM_NONE },
+    { "MOV    E, M",   1, DISASM_NONE },
+    { "MOV    E, A",   1, DISASM_NONE },
+    // 0x60
+    { "MOV    H, B",   1, DISASM_NONE },
+    { "MOV    H, C",   1, DISASM_NONE },
+    { "MOV    H, D",   1, DISASM_NONE },
+    { "MOV    H, E",   1, DISASM_NONE },
+    { "MOV    H, H",   1, DISASM_NONE },
+    { "MOV    H, L",   1, DISASM_NONE },
+    { "MOV    H, M",   1, DISASM_NONE },
+    { "MOV    H, A",   1, DISASM_NONE },
+    { "MOV    L, B",   1, DISASM_NONE },
+    { "MOV    L, C",   1, DISASM_NONE },
+    { "MOV    L, D",   1, DISASM_NONE },
+    { "MOV    L, E",   1, DISASM_NONE },
+    { "MOV    L, H",   1, DISASM_NONE },
+    { "MOV    L, L",   1, DISASM_NONE },
+    { "MOV    L, M",   1, DISASM_NONE },
+    { "MOV    L, A",   1, DISASM_NONE },
+    // 0x70
+    { "MOV    M, B",   1, DISASM_NONE },
+    { "MOV    M, C",   1, DISASM_NONE },
+    { "MOV    M, D",   1, DISASM_NONE },
+    { "MOV    M, E",   1, DISASM_NONE },
+    { "MOV    M, H",   1, DISASM_NONE },
+    { "MOV    M, L",   1, DISASM_NONE },
+    { "HLT",           1, DISASM_NONE },
+    { "MOV    M, A",   1, DISASM_NONE },
+    { "MOV    A, B",   1, DISASM_NONE },
+    { "MOV    A, C",   1, DISASM_NONE },
+    { "MOV    A, D",   1, DISASM_NONE },
+    { "MOV    A, E",   1, DISASM_NONE },
+    { "MOV    A, H",   1, DISASM_NONE },
+    { "MOV    A, L",   1, DISASM_NONE },
+    { "MOV    A, M",   1, DISASM_NONE },
+    { "MOV    A, A",   1, DISASM_NONE },
+    // 0x80
+    { "ADD    B",      1, DISASM_NONE },
+    { "ADD    C",      1, DISASM_NONE },
+    { "ADD    D",      1, DISASM_NONE },
+    { "ADD    E",      1, DISASM_NONE },
+    { "ADD    H",      1, DISASM_NONE },
+    { "ADD    L",      1, DISASM_NONE },
+    { "ADD    M",      1, DISASM_NONE },
+    { "ADD    A",      1, DISASM_NONE },
+    { "ADC    B",      1, DISASM_NONE },
+    { "ADC    C",      1, DISASM_NONE },
+    { "ADC    D",      1, DISASM_NONE },
+    { "ADC    E",      1, DISASM_NONE },
+    { "ADC    H",      1, DISASM_NONE },
+    { "ADC    L",      1, DISASM_NONE },
+    { "ADC    M",      1, DISASM_NONE },
+    { "ADC    A",      1, DISASM_NONE },
+    // 0x90
+    { "SUB    B",      1, DISASM_NONE },
+    { "SUB    C",      1, DISASM_NONE },
+    { "SUB    D",      1, DISASM_NONE },
+    { "SUB    E",      1, DISASM_NONE },
+    { "SUB    H",      1, DISASM_NONE },
+    { "SUB    L",      1, DISASM_NONE },
+    { "SUB    M",      1, DISASM_NONE },
+    { "SUB    A",      1, DISASM_NONE },
+    { "SBB    B",      1, DISASM_NONE },
+    { "SBB    C",      1, DISASM_NONE },
+    { "SBB    D",      1, DISASM_NONE },
+    { "SBB    E",      1, DISASM_NONE },
+    { "SBB    H",      1, DISASM_NONE },
+    { "SBB    L",      1, DISASM_NONE },
+    { "SBB    M",      1, DISASM_NONE },
+    { "SBB    A",      1, DISASM_NONE },
+    // 0xa0
+    { "ANA    B",      1, DISASM_NONE },
+    { "ANA    C",      1, DISASM_NONE },
+    { "ANA    D",      1, DISASM_NONE },
+    { "ANA    E",      1, DISASM_NONE },
+    { "ANA    H",      1, DISASM_NONE },
+    { "ANA    L",      1, DISASM_NONE },
+    { "ANA    M",      1, DISASM_NONE },
+    { "ANA    A",      1, DISASM_NONE },
+    { "XRA    B",      1, DISASM_NONE },
+    { "XRA    C",      1, DISASM_NONE },
+    { "XRA    D",      1, DISASM_NONE },
+    { "XRA    E",      1, DISASM_NONE },
+    { "XRA    H",      1, DISASM_NONE },
+    { "XRA    L",      1, DISASM_NONE },
+    { "XRA    M",      1, DISASM_NONE },
+    { "XRA    A",      1, DISASM_NONE },
+    // 0xb0
+    { "ORA    B",      1, DISASM_NONE },
+    { "ORA    C",      1, DISASM_NONE },
+    { "ORA    D",      1, DISASM_NONE },
+    { "ORA    E",      1, DISASM_NONE },
+    { "ORA    H",      1, DISASM_NONE },
+    { "ORA    L",      1, DISASM_NONE },
+    { "ORA    M",      1, DISASM_NONE },
+    { "ORA    A",      1, DISASM_NONE },
+    { "CMP    B",      1, DISASM_NONE },
+    { "CMP    C",      1, DISASM_NONE },
+    { "CMP    D",      1, DISASM_NONE },
+    { "CMP    E",      1, DISASM_NONE },
+    { "CMP    H",      1, DISASM_NONE },
+    { "CMP    L",      1, DISASM_NONE },
+    { "CMP    M",      1, DISASM_NONE },
+    { "CMP    A",      1, DISASM_NONE },
+    // 0xc0
+    { "RNZ",           1, DISASM_NONE },
+    { "POP    B",      1, DISASM_NONE },
+    { "JNZ    #$",     3, DISASM_JUMP },
+    { "JMP    #$",     3, DISASM_JUMP },
+    { "CNZ    #$",     3, DISASM_CALL },
+    { "PUSH   B",      1, DISASM_NONE },
+    { "ADI    #$",     2, DISASM_NONE },
+    { "RST    0",      1, DISASM_RST },
+    { "RZ",            1, DISASM_NONE },
+    { "RET",           1, DISASM_NONE },
+    { "JZ     #$",     3, DISASM_JUMP },
+    { "*JMP   #$",     3, DISASM_JUMP },
+    { "CZ     #$",     3, DISASM_CALL },
+    { "CALL   #$",     3, DISASM_CALL },
+    { "ACI    #$",     2, DISASM_NONE },
+    { "RST    1",      1, DISASM_RST },
+    // 0xd0
+    { "RNC",           1, DISASM_NONE },
+    { "POP    D",      1, DISASM_NONE },
+    { "JNC    #$",     3, DISASM_JUMP },
+    { "OUT    #$",     2, DISASM_NONE },
+    { "CNC    #$",     3, DISASM_CALL },
+    { "PUSH   D",      1, DISASM_NONE },
+    { "SUI    #$",     2, DISASM_NONE },
+    { "RST    2",      1, DISASM_RST },
+    { "RC",            1, DISASM_NONE },
+    { "*RET",          1, DISASM_NONE },
+    { "JC     #$",     3, DISASM_JUMP },
+    { "IN     #$",     2, DISASM_NONE },
+    { "CC     #$",     3, DISASM_CALL },
+    { "*CALL  #$",     3, DISASM_CALL },
+    { "SBI    #$",     2, DISASM_NONE },
+    { "RST    3",      1, DISASM_RST },
+    // 0xe0
+    { "RPO",           1, DISASM_NONE },
+    { "POP    H",      1, DISASM_NONE },
+    { "JPO    #$",     3, DISASM_JUMP },
+    { "XTHL",          1, DISASM_NONE },
+    { "CPO    #$",     3, DISASM_CALL },
+    { "PUSH   H",      1, DISASM_NONE },
+    { "ANI    #$",     2, DISASM_NONE },
+    { "RST    4",      1, DISASM_RST },
+    { "RPE",           1, DISASM_NONE },
+    { "PCHL",          1, DISASM_NONE },
+    { "JPE    #$",     3, DISASM_JUMP },
+    { "XCHG",          1, DISASM_NONE },
+    { "CPE    #$",     3, DISASM_CALL },
+    { "*CALL  #$",     3, DISASM_CALL },
+    { "XRI    #$",     2, DISASM_NONE },
+    { "RST    5",      1, DISASM_RST },
+    // 0xf0
+    { "RP",            1, DISASM_NONE },
+    { "POP    PSW",    1, DISASM_NONE },
+    { "JP     #$",     3, DISASM_JUMP },
+    { "DI",            1, DISASM_NONE },
+    { "CP     #$",     3, DISASM_CALL },
+    { "PUSH   PSW",    1, DISASM_NONE },
+    { "ORI    #$",     2, DISASM_NONE },
+    { "RST    6",      1, DISASM_RST },
+    { "RM",            1, DISASM_NONE },
+    { "SPHL",          1, DISASM_NONE },
+    { "JM     #$",     3, DISASM_JUMP },
+    { "EI",            1, DISASM_NONE },
+    { "CM     #$",     3, DISASM_CALL },
+    { "*CALL  #$",     3, DISASM_CALL },
+    { "CPI    #$",     2, DISASM_NONE },
+    { "RST    7",      1, DISASM_RST },
+};
 
- 
-        default: printf("INVALID OPERATION"); break;
+static const char DISASM_HEX[16] = "0123456789abcdef";
 
+/**
+ * @brief disassembles one instruction into a buffer
+ *
+ * @param code the instruction bytes, at least 3 readable bytes
+ * @param text destination, at least DISASM_TEXT_SIZE bytes, NUL terminated
+ * @return int the length of the instruction in bytes
+ */
+static inline int disassemble8080(const uint8_t *code, char *text) {
+    const DisasmOp *op = &DISASM_OPS[code[0]];
+    const char *s = op->text;
+    while (*s)
+        *text++ = *s++;
+    for (int i = op->length - 1; i > 0; i--) {
+        *text++ = DISASM_HEX[code[i] >> 4];
+        *text++ = DISASM_HEX[code[i] & 15];
     }
-    printf("\n");
-    return opbytes;
+    *text = '\0';
+    return op->length;
 }
 
+/**
+ * @brief returns the fixed address an instruction jumps or calls to
+ *
+ * @param code the instruction bytes
+ * @param target set to the destination for jumps, calls and restarts
+ * @return DisasmFlow DISASM_NONE if control does not go to a fixed address
+ */
+static inline DisasmFlow disassemble8080_target(const uint8_t *code, uint16_t *target) {
+    DisasmFlow flow = DISASM_OPS[code[0]].flow;
+    if (flow == DISASM_RST)
+        *target = code[0] & 0x38;
+    else if (flow != DISASM_NONE)
+        *target = (code[2] << 8) | code[1];
+    return flow;
+}
 
-
+/**
+ * @brief prints the address and disassembly of one instruction on a line
+ *
+ * @param codebuffer the 8080 memory, 64K
+ * @param pc the address of the instruction; operands past 0xffff wrap to 0
+ *        like the CPU's fetches
+ * @return int the length of the instruction in bytes
+ */
+int Disassemble8080Op(unsigned char *codebuffer, int pc) {
+    char text[DISASM_TEXT_SIZE];
+    const uint8_t code[3] = { codebuffer[pc & 0xffff], codebuffer[(pc + 1) & 0xffff], codebuffer[(pc + 2) & 0xffff] };
+    int length = disassemble8080(code, text);
+    printf("%04x %s\n", pc, text);
+    return length;
+}
@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+
+/*  Sound effects mixer.
+    The samples are read once at start-up and converted to the mixer
+    format, 16-bit mono at AUDIO_RATE. Audio is rendered on the emulation
+    thread, one block of AUDIO_FRAME_SAMPLES per emulated frame: the
+    machine records every sound latch change with its cycle within the
+    frame, and each one takes effect at the matching sample of the block,
+    so effects land where the game triggered them however the frame was
+    paced. Voices overlap; the UFO (port 3 bit 0) is a held sound that
+    loops from the write that sets the bit to the one that clears it.
+
+    Finished blocks go through a single-producer, single-consumer FIFO to
+    the device callback, which only copies samples out. If the device
+    falls behind (turbo) whole blocks are dropped, so the sound never
+    lags the picture; if it runs dry it plays silence. The same blocks
+    can be written to a file instead of, or as well as, the device.
+
+    Latency is measured from the end of the frame that started an effect
+    to its first sample leaving the device: the audio already in the FIFO
+    ahead of it, its offset in the block and one device buffer.
+*/
+
+#define AUDIO_RATE 44100
+#define AUDIO_FRAME_SAMPLES (AUDIO_RATE / 60) // one emulated frame
+#define AUDIO_SOUNDS 9 // audio/0.wav to audio/8.wav
+#define AUDIO_UFO 0 // looped while its latch bit is set
+#define AUDIO_VOICES 16
+#define AUDIO_FIFO 8192 // samples between emulation and device, must be a power of two
+#define AUDIO_FIFO_TARGET (4 * AUDIO_FRAME_SAMPLES) // blocks are dropped above this
+
+/*  A write that changed a sound latch. */
+typedef struct SoundEvent {
+    uint32_t cycle; // cycles into the frame
+    uint8_t bank; // 1 for port 3, 2 for port 5
+    uint8_t value;
+    uint8_t previous;
+} SoundEvent;
+
+typedef struct Sample {
+    int16_t *data; // NULL if the file could not be loaded
+    uint32_t length; // in samples
+} Sample;
+
+typedef struct Voice {
+    int sound; // -1 when free
+    uint32_t position;
+    bool loop;
+} Voice;
+
+typedef struct Mixer {
+    Sample samples[AUDIO_SOUNDS];
+    Voice voices[AUDIO_VOICES];
+    int16_t frame[AUDIO_FRAME_SAMPLES]; // the last rendered block
+
+    bool streaming; // blocks are queued for a device
+    int16_t fifo[AUDIO_FIFO];
+    atomic_uint head; // samples written, advanced by the emulation thread
+    atomic_uint tail; // samples read, advanced by the device callback
+    atomic_uint underruns; // callbacks that ran out of samples
+    uint32_t dropped; // blocks not queued because the device was behind
+    double output_delay; // seconds of one device buffer, set by the front end
+    FrameStats latency; // event to output
+} Mixer;
+
+static inline uint32_t get_le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline uint16_t get_le16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+/**
+ * @brief loads a PCM WAV file (8 or 16-bit, any rate and channel count) and
+ * converts it to 16-bit mono at AUDIO_RATE
+ *
+ * @param sample the Sample object
+ * @param path the file
+ * @return true
+ * @return false after printing an error, the sample is left empty
+ */
+bool audio_load_wav(Sample *sample, const char *path) {
+    sample->data = NULL;
+    sample->length = 0;
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "error: could not open %s\n", path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *file = malloc(size > 0 ? size : 1);
+    bool read = size > 12 && fread(file, size, 1, f) == 1;
+    fclose(f);
+    if (!read || memcmp(file, "RIFF", 4) != 0 || memcmp(file + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "error: %s is not a WAV file\n", path);
+        free(file);
+        return false;
+    }
+
+    uint16_t format = 0, channels = 0, bits = 0;
+    uint32_t rate = 0, data_size = 0;
+    const uint8_t *data = NULL;
+    for (long offset = 12; offset + 8 <= size; ) {
+        uint32_t chunk = get_le32(file + offset + 4);
+        const uint8_t *body = file + offset + 8;
+        if (chunk > size - offset - 8)
+            chunk = size - offset - 8;
+        if (memcmp(file + offset, "fmt ", 4) == 0 && chunk >= 16) {
+            format = get_le16(body);
+            channels = get_le16(body + 2);
+            rate = get_le32(body + 4);
+            bits = get_le16(body + 14);
+        }
+        else if (memcmp(file + offset, "data", 4) == 0) {
+            data = body;
+            data_size = chunk;
+        }
+        offset += 8 + chunk + (chunk & 1);
+    }
+    if (format != 1 || (bits != 8 && bits != 16) || channels == 0 || rate == 0 || data == NULL) {
+        fprintf(stderr, "error: %s is not 8 or 16-bit PCM\n", path);
+        free(file);
+        return false;
+    }
+
+    // mix down to mono, then resample linearly
+    uint32_t frame_size = channels * bits / 8;
+    uint32_t frames = data_size / frame_size;
+    float *mono = malloc((frames + 1) * sizeof(float));
+    for (uint32_t i = 0; i < frames; i++) {
+        float sum = 0;
+        for (int c = 0; c < channels; c++) {
+            const uint8_t *p = data + i * frame_size + c * bits / 8;
+            sum += bits == 8 ? (p[0] - 128) * 256 : (int16_t) get_le16(p);
+        }
+        mono[i] = sum / channels;
+    }
+    mono[frames] = frames ? mono[frames - 1] : 0;
+
+    sample->length = (uint64_t) frames * AUDIO_RATE / rate;
+    sample->data = malloc((sample->length ? sample->length : 1) * sizeof(int16_t));
+    for (uint32_t i = 0; i < sample->length; i++) {
+        double position = (double) i * rate / AUDIO_RATE;
+        uint32_t index = position;
+        float fraction = position - index;
+        sample->data[i] = mono[index] + (mono[index + 1] - mono[index]) * fraction;
+    }
+    free(mono);
+    free(file);
+    return true;
+}
+
+/**
+ * @brief creates a silent mixer with no samples
+ *
+ * @param mixer the Mixer object
+ */
+void mixer_init(Mixer *mixer) {
+    memset(mixer, 0, sizeof(Mixer));
+    for (int v = 0; v < AUDIO_VOICES; v++)
+        mixer->voices[v].sound = -1;
+    atomic_init(&mixer->head, 0);
+    atomic_init(&mixer->tail, 0);
+    atomic_init(&mixer->underruns, 0);
+    mixer->latency.name = "audio latency (event to output)";
+    mixer->latency.unit = "sounds";
+}
+
+/**
+ * @brief frees the samples
+ */
+void mixer_free(Mixer *mixer) {
+    for (int s = 0; s < AUDIO_SOUNDS; s++)
+        free(mixer->samples[s].data);
+}
+
+/**
+ * @brief starts a sound, or starts or stops a held one
+ */
+static void mixer_voice(Mixer *mixer, int sound, bool start) {
+    bool loop = sound == AUDIO_UFO;
+    Voice *free_voice = NULL, *oldest = NULL;
+    for (int v = 0; v < AUDIO_VOICES; v++) {
+        Voice *voice = &mixer->voices[v];
+        if (voice->sound == sound && voice->loop) {
+            if (!start)
+                voice->sound = -1;
+            return; // a held sound keeps playing
+        }
+        if (voice->sound < 0 && free_voice == NULL)
+            free_voice = voice;
+        if (!voice->loop && (oldest == NULL || voice->position > oldest->position))
+            oldest = voice;
+    }
+    if (!start || mixer->samples[sound].data == NULL)
+        return;
+    Voice *voice = free_voice ? free_voice : oldest; // steal the voice furthest along
+    if (voice == NULL)
+        return;
+    *voice = (Voice) { sound, 0, loop };
+}
+
+/**
+ * @brief applies a sound latch change
+ * Port 3 bit 0 holds the UFO sound for as long as it is set, the other bits 
+ * start one-shot effects on their rising edge: port 3 bits 1-3 play 1.wav 
+ * to 3.wav, port 5 bits 0-4 play 4.wav to 8.wav.
+ * @return int number of effects started
+ */
+static int mixer_event(Mixer *mixer, const SoundEvent *event) {
+    uint8_t started = event->value & ~event->previous;
+    int count = 0;
+    if (event->bank == 1) {
+        if ((event->value ^ event->previous) & 0x1) {
+            mixer_voice(mixer, AUDIO_UFO, event->value & 0x1);
+            count += started & 0x1;
+        }
+        for (int bit = 1; bit <= 3; bit++)
+            if (started & (1 << bit)) {
+                mixer_voice(mixer, bit, true);
+                count++;
+            }
+    }
+    else {
+        for (int bit = 0; bit <= 4; bit++)
+            if (started & (1 << bit)) {
+                mixer_voice(mixer, 4 + bit, true);
+                count++;
+            }
+    }
+    return count;
+}
+
+/**
+ * @brief mixes every active voice into part of the block
+ */
+static void mixer_mix(Mixer *mixer, int32_t *mix, int from, int to) {
+    for (int v = 0; v < AUDIO_VOICES; v++) {
+        Voice *voice = &mixer->voices[v];
+        if (voice->sound < 0)
+            continue;
+        const Sample *sample = &mixer->samples[voice->sound];
+        for (int i = from; i < to; i++) {
+            if (voice->position >= sample->length) {
+                if (!voice->loop || sample->length == 0) {
+                    voice->sound = -1;
+                    break;
+                }
+                voice->position = 0;
+            }
+            mix[i] += sample->data[voice->position++];
+        }
+    }
+}
+
+/**
+ * @brief queues a block for the device, unless the device is behind
+ *
+ * @param queued set to the samples that were already queued ahead of it
+ * @return true
+ * @return false if the block was dropped
+ */
+static bool mixer_push(Mixer *mixer, const int16_t *block, int count, uint32_t *queued) {
+    unsigned head = atomic_load_explicit(&mixer->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&mixer->tail, memory_order_acquire);
+    *queued = head - tail;
+    if (*queued + count > AUDIO_FIFO_TARGET) {
+        mixer->dropped++;
+        return false;
+    }
+    for (int i = 0; i < count; i++)
+        mixer->fifo[(head + i) & (AUDIO_FIFO - 1)] = block[i];
+    atomic_store_explicit(&mixer->head, head + count, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief renders the audio of one emulated frame into mixer->frame, with 
+ * each sound latch change applied at the sample matching its cycle, and 
+ * queues it for the device when streaming
+ *
+ * @param mixer the Mixer object
+ * @param events the latch changes of the frame, in order
+ * @param count number of events
+ * @param frame_cycles length of the frame in cycles
+ * @return const int16_t* the block, AUDIO_FRAME_SAMPLES samples
+ */
+const int16_t *mixer_render_frame(Mixer *mixer, const SoundEvent *events, int count, uint32_t frame_cycles) {
+    int32_t mix[AUDIO_FRAME_SAMPLES] = {0};
+    int offsets[count > 0 ? count : 1];
+    int position = 0;
+    for (int e = 0; e < count; e++) {
+        uint64_t offset = (uint64_t) events[e].cycle * AUDIO_FRAME_SAMPLES / frame_cycles;
+        offsets[e] = offset < AUDIO_FRAME_SAMPLES ? offset : AUDIO_FRAME_SAMPLES - 1;
+        mixer_mix(mixer, mix, position, offsets[e]);
+        position = offsets[e];
+        if (!mixer_event(mixer, &events[e]))
+            offsets[e] = -1; // nothing started, no latency to measure
+    }
+    mixer_mix(mixer, mix, position, AUDIO_FRAME_SAMPLES);
+    for (int i = 0; i < AUDIO_FRAME_SAMPLES; i++)
+        mixer->frame[i] = mix[i] > INT16_MAX ? INT16_MAX : mix[i] < INT16_MIN ? INT16_MIN : mix[i];
+
+    uint32_t queued;
+    // a dropped block is never heard, so its events have no latency
+    if (mixer->streaming && mixer_push(mixer, mixer->frame, AUDIO_FRAME_SAMPLES, &queued)) {
+        for (int e = 0; e < count; e++)
+            if (offsets[e] >= 0)
+                stats_add(&mixer->latency, (double) (queued + offsets[e]) / AUDIO_RATE + mixer->output_delay);
+    }
+    return mixer->frame;
+}
+
+/**
+ * @brief copies queued samples to the device, called by its callback
+ * Plays silence for whatever the emulation has not produced yet.
+ * @param mixer the Mixer object
+ * @param out destination
+ * @param count samples wanted
+ */
+void mixer_pull(Mixer *mixer, int16_t *out, int count) {
+    unsigned tail = atomic_load_explicit(&mixer->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&mixer->head, memory_order_acquire);
+    int available = head - tail < (unsigned) count ? (int) (head - tail) : count;
+    for (int i = 0; i < available; i++)
+        out[i] = mixer->fifo[(tail + i) & (AUDIO_FIFO - 1)];
+    if (available < count) {
+        memset(out + available, 0, (count - available) * sizeof(int16_t));
+        atomic_fetch_add_explicit(&mixer->underruns, 1, memory_order_relaxed);
+    }
+    atomic_store_explicit(&mixer->tail, tail + available, memory_order_release);
+}
+
+/**
+ * @brief prints the event to output latency and the blocks lost either way
+ */
+void mixer_print_stats(Mixer *mixer) {
+    stats_print(&mixer->latency);
+    printf("audio: %u blocks dropped (device behind), %u underruns (device starved)\n",
+        mixer->dropped, atomic_load(&mixer->underruns));
+}
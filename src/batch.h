@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*  Batch runner.
+    A small thread pool runs a task over a range of items: the caller and
+    the worker threads claim items one at a time from a shared counter
+    until the range is done, so uneven items balance themselves. On top of
+    it, batch_run steps many independent machines, each on whichever
+    thread claims it, with per-instance input supplied by a callback.
+*/
+
+typedef void (*PoolTask)(void *context, int item);
+
+typedef struct ThreadPool {
+    pthread_t *workers;
+    int worker_count; // threads besides the caller
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    uint64_t generation; // bumped for every pool_for
+    int busy; // workers still inside the current pool_for
+    bool stop;
+    PoolTask task;
+    void *context;
+    int items;
+    atomic_int next; // next unclaimed item
+} ThreadPool;
+
+/**
+ * @brief runs items of the current task until none are left
+ */
+static void pool_drain(ThreadPool *pool) {
+    int item;
+    while ((item = atomic_fetch_add(&pool->next, 1)) < pool->items)
+        pool->task(pool->context, item);
+}
+
+static void *pool_worker(void *arg) {
+    ThreadPool *pool = arg;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == seen && !pool->stop)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->stop)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_drain(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * @brief starts a pool
+ *
+ * @param pool the ThreadPool object
+ * @param threads total threads to run tasks on, including the caller
+ */
+void pool_init(ThreadPool *pool, int threads) {
+    pool->worker_count = threads > 1 ? threads - 1 : 0;
+    pool->workers = malloc((pool->worker_count + 1) * sizeof(pthread_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->generation = 0;
+    pool->busy = 0;
+    pool->stop = false;
+    pool->items = 0;
+    atomic_init(&pool->next, 0);
+    for (int i = 0; i < pool->worker_count; i++)
+        pthread_create(&pool->workers[i], NULL, pool_worker, pool);
+}
+
+/**
+ * @brief runs task(context, item) for every item in 0..items-1 across the
+ * pool and returns when all of them are done
+ *
+ * @param pool the ThreadPool object
+ * @param items number of items
+ * @param task the task
+ * @param context passed to the task
+ */
+void pool_for(ThreadPool *pool, int items, PoolTask task, void *context) {
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    pool->items = items;
+    atomic_store(&pool->next, 0);
+    pool->busy = pool->worker_count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_drain(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief stops the worker threads and frees the pool
+ *
+ * @param pool the ThreadPool object
+ */
+void pool_free(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->worker_count; i++)
+        pthread_join(pool->workers[i], NULL);
+    free(pool->workers);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+}
+
+/************************ MACHINE BATCHES ************************/
+
+/*  Sets the input ports of one instance before it runs a frame. */
+typedef void (*BatchInput)(Machine *machine, int instance, long frame, void *context);
+
+typedef struct Batch {
+    Machine *machines;
+    long frames;
+    BatchInput input; // NULL to leave the ports alone
+    void *input_context;
+} Batch;
+
+static void batch_task(void *context, int instance) {
+    Batch *batch = context;
+    Machine *machine = &batch->machines[instance];
+    for (long frame = 0; frame < batch->frames; frame++) {
+        if (batch->input)
+            batch->input(machine, instance, frame, batch->input_context);
+        machine_run_frame(machine);
+    }
+}
+
+/**
+ * @brief runs every machine for a number of frames on the pool
+ *
+ * @param pool the ThreadPool object
+ * @param machines the instances
+ * @param count number of instances
+ * @param frames frames to run each instance for
+ * @param input per-instance input, may be NULL
+ * @param input_context passed to input
+ */
+void batch_run(ThreadPool *pool, Machine *machines, int count, long frames, BatchInput input, void *input_context) {
+    Batch batch = { machines, frames, input, input_context };
+    pool_for(pool, count, batch_task, &batch);
+}
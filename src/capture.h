@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+/*  Audio and video capture.
+    Every emulated frame can be archived: the upright framebuffer as a Y4M
+    stream (4:4:4, 60 fps) or as a numbered PNG sequence, and the mixed
+    audio block as a 16-bit mono WAV file. The emulation thread only
+    copies the frame into a free slot of a bounded queue; a writer thread
+    encodes and writes the slots in order. If the video queue is full the
+    picture is dropped and counted, so capture never stalls emulation,
+    unless the capture is lossless, in which case the emulation waits for
+    the writer. The Y4M stream repeats the previous picture in its place,
+    and the PNG sequence skips its number, so video keeps the frame timing.
+    Audio is never dropped: its blocks are small and go through a longer
+    queue of their own, which the writer drains before every picture.
+*/
+
+#define CAPTURE_QUEUE 32 // pictures in flight, about half a second
+#define CAPTURE_AUDIO_QUEUE 600 // audio blocks in flight, ten seconds
+
+typedef struct CaptureSlot {
+    uint32_t pixels[SCREEN_HEIGHT * SCREEN_WIDTH]; // ARGB
+    uint64_t frame; // index of the emulated frame
+} CaptureSlot;
+
+typedef struct Capture {
+    FILE *y4m; // NULL unless capturing video to Y4M
+    const char *png_pattern; // printf pattern for PNG files, NULL unless capturing PNGs
+    FILE *wav; // NULL unless capturing audio
+    bool lossless; // wait for the writer instead of dropping frames
+
+    CaptureSlot *slots;
+    uint64_t queued; // slots handed to the writer
+    uint64_t written; // slots the writer is done with
+    int16_t (*audio)[AUDIO_FRAME_SAMPLES]; // one block per frame, NULL unless capturing audio
+    uint64_t audio_queued, audio_written; // the same for audio blocks
+    pthread_mutex_t lock;
+    pthread_cond_t work; // signalled when a slot is queued or on close
+    pthread_cond_t space; // signalled when a slot is freed
+    bool stop;
+    pthread_t writer;
+
+    uint64_t frames; // offered to capture_submit
+    uint64_t dropped; // pictures not queued
+    uint64_t video_frames; // frames in the Y4M stream, repeats included
+    uint64_t audio_samples;
+    uint64_t bytes; // written to files
+    double write_time; // writer thread time spent encoding and writing
+    bool failed;
+} Capture;
+
+/************************ ENCODERS ************************/
+
+static void put_le32(uint8_t *p, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        p[i] = value >> (8 * i);
+}
+
+static void put_be32(uint8_t *p, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        p[i] = value >> (24 - 8 * i);
+}
+
+/**
+ * @brief writes the 44 byte WAV header, with the sizes for a number of samples
+ */
+static void wav_header(uint8_t header[44], uint32_t samples) {
+    uint32_t data = samples * 2;
+    memcpy(header, "RIFF", 4);
+    put_le32(header + 4, 36 + data);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le32(header + 16, 16);
+    put_le32(header + 20, 1 | (1 << 16)); // PCM, mono
+    put_le32(header + 24, AUDIO_RATE);
+    put_le32(header + 28, AUDIO_RATE * 2);
+    put_le32(header + 32, 2 | (16 << 16)); // block align, bits per sample
+    memcpy(header + 36, "data", 4);
+    put_le32(header + 40, data);
+}
+
+/**
+ * @brief writes a frame to the Y4M stream, full planes of Y, Cb and Cr
+ * (BT.601, studio range)
+ * @param pixels the picture, NULL to repeat the previous one
+ */
+static size_t write_y4m_frame(FILE *f, const uint32_t *pixels) {
+    static uint8_t planes[3][SCREEN_HEIGHT * SCREEN_WIDTH];
+    for (int i = 0; pixels && i < SCREEN_HEIGHT * SCREEN_WIDTH; i++) {
+        int r = (pixels[i] >> 16) & 0xff, g = (pixels[i] >> 8) & 0xff, b = pixels[i] & 0xff;
+        planes[0][i] = 16 + ((66 * r + 129 * g + 25 * b + 128) >> 8);
+        planes[1][i] = 128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8);
+        planes[2][i] = 128 + ((112 * r - 94 * g - 18 * b + 128) >> 8);
+    }
+    fputs("FRAME\n", f);
+    fwrite(planes, sizeof(planes), 1, f);
+    return 6 + sizeof(planes);
+}
+
+/**
+ * @brief writes one PNG chunk
+ * @return false if its buffer could not be allocated
+ */
+static bool png_chunk(FILE *f, const char *type, const uint8_t *data, uint32_t size, size_t *bytes) {
+    // the CRC covers the type and the data
+    uint8_t *body = malloc(size + 4);
+    if (body == NULL)
+        return false;
+    uint8_t word[4];
+    put_be32(word, size);
+    fwrite(word, 4, 1, f);
+    memcpy(body, type, 4);
+    if (size)
+        memcpy(body + 4, data, size);
+    fwrite(body, size + 4, 1, f);
+    put_be32(word, crc32(body, size + 4));
+    fwrite(word, 4, 1, f);
+    free(body);
+    *bytes += size + 12;
+    return true;
+}
+
+/**
+ * @brief writes a frame as an 8-bit RGB PNG
+ * The image is stored in uncompressed deflate blocks: no zlib needed, and
+ * the writer stays fast; archive tools can recompress.
+ */
+static size_t write_png(const char *path, const uint32_t *pixels) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+        return 0;
+    enum { ROW = 1 + SCREEN_WIDTH * 3, RAW = ROW * SCREEN_HEIGHT, BLOCK = 65535 };
+    static uint8_t raw[RAW];
+    static uint8_t zlib[2 + RAW + (RAW / BLOCK + 1) * 5 + 4];
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        uint8_t *row = raw + y * ROW;
+        row[0] = 0; // no filter
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            uint32_t pixel = pixels[y * SCREEN_WIDTH + x];
+            row[1 + x * 3] = pixel >> 16;
+            row[2 + x * 3] = pixel >> 8;
+            row[3 + x * 3] = pixel;
+        }
+    }
+
+    size_t n = 0;
+    zlib[n++] = 0x78; // deflate, 32K window
+    zlib[n++] = 0x01;
+    uint32_t a = 1, b = 0; // Adler-32
+    for (size_t offset = 0; offset < RAW; offset += BLOCK) {
+        uint16_t length = RAW - offset < BLOCK ? RAW - offset : BLOCK;
+        zlib[n++] = offset + length == RAW; // final block flag, stored
+        zlib[n++] = length;
+        zlib[n++] = length >> 8;
+        zlib[n++] = ~length;
+        zlib[n++] = (uint16_t) ~length >> 8;
+        memcpy(zlib + n, raw + offset, length);
+        n += length;
+        for (size_t i = offset; i < offset + length; i++) {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    put_be32(zlib + n, (b << 16) | a);
+    n += 4;
+
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    uint8_t ihdr[13] = { 0 };
+    put_be32(ihdr, SCREEN_WIDTH);
+    put_be32(ihdr + 4, SCREEN_HEIGHT);
+    ihdr[8] = 8; // bit depth
+    ihdr[9] = 2; // RGB
+    size_t bytes = sizeof(SIGNATURE);
+    fwrite(SIGNATURE, sizeof(SIGNATURE), 1, f);
+    bool ok = png_chunk(f, "IHDR", ihdr, sizeof(ihdr), &bytes) &&
+        png_chunk(f, "IDAT", zlib, n, &bytes) &&
+        png_chunk(f, "IEND", NULL, 0, &bytes);
+    ok &= !ferror(f);
+    fclose(f);
+    return ok ? bytes : 0;
+}
+
+/************************ WRITER ************************/
+
+/**
+ * @brief repeats the last picture in the Y4M stream until it holds a number
+ * of frames
+ */
+static void capture_fill_y4m(Capture *capture, uint64_t frames) {
+    for (; capture->video_frames < frames; capture->video_frames++)
+        capture->bytes += write_y4m_frame(capture->y4m, NULL);
+}
+
+/**
+ * @brief encodes and writes one slot, on the writer thread
+ */
+static void capture_write(Capture *capture, const CaptureSlot *slot) {
+    if (capture->y4m) {
+        capture_fill_y4m(capture, slot->frame); // pictures dropped since the last one
+        capture->bytes += write_y4m_frame(capture->y4m, slot->pixels);
+        capture->video_frames++;
+    }
+    if (capture->png_pattern) {
+        char path[1024];
+        snprintf(path, sizeof(path), capture->png_pattern, (unsigned long long) slot->frame);
+        size_t bytes = write_png(path, slot->pixels);
+        if (bytes == 0 && !capture->failed) {
+            fprintf(stderr, "error: could not write %s\n", path);
+            capture->failed = true;
+        }
+        capture->bytes += bytes;
+    }
+}
+
+static void *capture_writer(void *arg) {
+    Capture *capture = arg;
+    pthread_mutex_lock(&capture->lock);
+    for (;;) {
+        while (capture->written == capture->queued && capture->audio_written == capture->audio_queued &&
+            !capture->stop)
+            pthread_cond_wait(&capture->work, &capture->lock);
+        if (capture->audio_written < capture->audio_queued) {
+            // audio first: a picture takes far longer, and audio is never dropped
+            const int16_t *block = capture->audio[capture->audio_written % CAPTURE_AUDIO_QUEUE];
+            pthread_mutex_unlock(&capture->lock);
+
+            double start = now_seconds();
+            fwrite(block, sizeof(int16_t) * AUDIO_FRAME_SAMPLES, 1, capture->wav);
+            capture->bytes += sizeof(int16_t) * AUDIO_FRAME_SAMPLES;
+            capture->audio_samples += AUDIO_FRAME_SAMPLES;
+            capture->write_time += now_seconds() - start;
+
+            pthread_mutex_lock(&capture->lock);
+            capture->audio_written++;
+            pthread_cond_signal(&capture->space);
+            continue;
+        }
+        if (capture->written == capture->queued)
+            break; // stopped and drained
+        CaptureSlot *slot = &capture->slots[capture->written % CAPTURE_QUEUE];
+        pthread_mutex_unlock(&capture->lock);
+
+        double start = now_seconds();
+        capture_write(capture, slot);
+        capture->write_time += now_seconds() - start;
+
+        pthread_mutex_lock(&capture->lock);
+        capture->written++;
+        pthread_cond_signal(&capture->space);
+    }
+    pthread_mutex_unlock(&capture->lock);
+    return NULL;
+}
+
+/************************ CAPTURE API ************************/
+
+/**
+ * @brief checks that a PNG pattern is safe to hand to snprintf with the frame
+ * index: exactly one integer conversion of unsigned long long, such as
+ * %06llu, and no other % except %%
+ */
+static bool png_pattern_valid(const char *pattern) {
+    int conversions = 0;
+    for (const char *p = pattern; *p; p++) {
+        if (*p != '%')
+            continue;
+        if (*++p == '%')
+            continue;
+        p += strspn(p, "-+ #0");
+        p += strspn(p, "0123456789");
+        if (*p == '.') {
+            p++;
+            p += strspn(p, "0123456789");
+        }
+        if (strncmp(p, "ll", 2) != 0 || *(p + 2) == '\0' || !strchr("diouxX", *(p + 2)))
+            return false;
+        p += 2;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+/**
+ * @brief opens the capture files and starts the writer thread
+ *
+ * @param capture the Capture object
+ * @param video_path a .y4m file, a printf pattern for PNG files such as
+ *        frames/%06llu.png, or NULL
+ * @param audio_path a .wav file, or NULL
+ * @param lossless wait for the writer instead of dropping frames
+ * @return true
+ * @return false after printing an error
+ */
+bool capture_open(Capture *capture, const char *video_path, const char *audio_path, bool lossless) {
+    memset(capture, 0, sizeof(Capture));
+    capture->lossless = lossless;
+    if (video_path && strchr(video_path, '%')) {
+        if (!png_pattern_valid(video_path)) {
+            fprintf(stderr, "error: %s needs exactly one %%llu style conversion for the frame number\n", video_path);
+            return false;
+        }
+        capture->png_pattern = video_path;
+    }
+    else if (video_path) {
+        capture->y4m = fopen(video_path, "wb");
+        if (capture->y4m == NULL) {
+            fprintf(stderr, "error: could not create %s\n", video_path);
+            return false;
+        }
+        int header = fprintf(capture->y4m, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+        capture->bytes += header > 0 ? header : 0;
+    }
+    if (audio_path) {
+        capture->wav = fopen(audio_path, "wb");
+        if (capture->wav == NULL) {
+            fprintf(stderr, "error: could not create %s\n", audio_path);
+            if (capture->y4m)
+                fclose(capture->y4m);
+            return false;
+        }
+        uint8_t header[44];
+        wav_header(header, 0); // sizes are patched on close
+        fwrite(header, sizeof(header), 1, capture->wav);
+        capture->bytes += sizeof(header);
+    }
+    if (video_path)
+        capture->slots = malloc(CAPTURE_QUEUE * sizeof(CaptureSlot));
+    if (audio_path)
+        capture->audio = malloc(CAPTURE_AUDIO_QUEUE * sizeof(*capture->audio));
+    pthread_mutex_init(&capture->lock, NULL);
+    pthread_cond_init(&capture->work, NULL);
+    pthread_cond_init(&capture->space, NULL);
+    pthread_create(&capture->writer, NULL, capture_writer, capture);
+    return true;
+}
+
+/**
+ * @brief queues a frame for the writer
+ * The copies happen outside the lock. A full video queue makes this wait
+ * only in lossless mode; a full audio queue always does.
+ * @param capture the Capture object
+ * @param pixels the upright ARGB framebuffer
+ * @param audio the frame's AUDIO_FRAME_SAMPLES samples, NULL for silence
+ * @return true
+ * @return false if the picture was dropped
+ */
+bool capture_submit(Capture *capture, const uint32_t *pixels, const int16_t *audio) {
+    uint64_t frame = capture->frames++;
+    bool video = capture->slots != NULL;
+    pthread_mutex_lock(&capture->lock);
+    while ((video && capture->lossless && capture->queued - capture->written == CAPTURE_QUEUE) ||
+        (capture->audio && capture->audio_queued - capture->audio_written == CAPTURE_AUDIO_QUEUE))
+        pthread_cond_wait(&capture->space, &capture->lock);
+    bool full = video && capture->queued - capture->written == CAPTURE_QUEUE;
+    uint64_t index = capture->queued, audio_index = capture->audio_queued;
+    pthread_mutex_unlock(&capture->lock);
+
+    // only this thread advances the queued counts, so the slots stay ours until then
+    if (video && !full) {
+        CaptureSlot *slot = &capture->slots[index % CAPTURE_QUEUE];
+        slot->frame = frame;
+        memcpy(slot->pixels, pixels, sizeof(slot->pixels));
+    }
+    if (capture->audio) {
+        int16_t *block = capture->audio[audio_index % CAPTURE_AUDIO_QUEUE];
+        if (audio)
+            memcpy(block, audio, sizeof(int16_t) * AUDIO_FRAME_SAMPLES);
+        else
+            memset(block, 0, sizeof(int16_t) * AUDIO_FRAME_SAMPLES);
+    }
+
+    pthread_mutex_lock(&capture->lock);
+    capture->queued += video && !full;
+    capture->audio_queued += capture->audio != NULL;
+    pthread_cond_signal(&capture->work);
+    pthread_mutex_unlock(&capture->lock);
+    if (full)
+        capture->dropped++;
+    return !full;
+}
+
+/**
+ * @brief drains the queue, finishes the files and prints what was written
+ *
+ * @param capture the Capture object
+ * @return true
+ * @return false if a file could not be written
+ */
+bool capture_close(Capture *capture) {
+    pthread_mutex_lock(&capture->lock);
+    capture->stop = true;
+    pthread_cond_signal(&capture->work);
+    pthread_mutex_unlock(&capture->lock);
+    pthread_join(capture->writer, NULL);
+
+    if (capture->y4m) {
+        if (capture->video_frames > 0)
+            capture_fill_y4m(capture, capture->frames); // pictures dropped at the end
+        capture->failed |= ferror(capture->y4m) != 0;
+        capture->failed |= fclose(capture->y4m) != 0;
+    }
+    if (capture->wav) {
+        uint8_t header[44];
+        wav_header(header, capture->audio_samples);
+        fseek(capture->wav, 0, SEEK_SET);
+        fwrite(header, sizeof(header), 1, capture->wav);
+        capture->failed |= ferror(capture->wav) != 0;
+        capture->failed |= fclose(capture->wav) != 0;
+    }
+    if (capture->slots)
+        printf("capture: %llu of %llu pictures written, %llu dropped%s\n",
+            (unsigned long long) capture->written, (unsigned long long) capture->frames,
+            (unsigned long long) capture->dropped, capture->y4m ? " and repeated in the Y4M stream" : "");
+    if (capture->audio)
+        printf("capture: %llu audio samples written\n", (unsigned long long) capture->audio_samples);
+    printf("capture: %.1f MB at %.1f MB/s writer throughput\n", capture->bytes / 1e6,
+        capture->write_time > 0 ? capture->bytes / 1e6 / capture->write_time : 0.0);
+    if (capture->failed)
+        fprintf(stderr, "error: capture files could not be written completely\n");
+
+    free(capture->slots);
+    free(capture->audio);
+    pthread_mutex_destroy(&capture->lock);
+    pthread_cond_destroy(&capture->work);
+    pthread_cond_destroy(&capture->space);
+    return !capture->failed;
+}
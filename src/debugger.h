@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+/*  Console debugger.
+    PC breakpoints, read and write watchpoints, single-stepping, register
+    and memory dumps and disassembly, driven from a prompt on stdin:
+        c                 continue
+        s [n]             step n instructions (default 1)
+        b [addr]          set a breakpoint, or list breakpoints and watchpoints
+        w addr [r|w|rw]   watch an address for reads and/or writes (default w)
+        d addr            delete the breakpoint and watchpoints at addr
+        r                 registers
+        x addr [len]      dump len (decimal) bytes of memory, default 64
+        u [addr] [n]      disassemble n instructions (default pc, 10)
+        q                 quit the emulator
+    An empty line repeats the last command. Addresses are hex.
+
+    The debugger only costs anything while armed (a breakpoint or watchpoint
+    is set, or it was asked to stop): the machine then runs the debug loop,
+    one instruction at a time with the checks between them, instead of
+    handing whole batches to the core. Write watchpoints use the store
+    hook, installed only while one is set; read watchpoints are found by
+    decoding the memory operands of the next instruction.
+*/
+
+#define DEBUG_LINE 128
+
+typedef struct Debugger {
+    uint8_t breakpoint[0x10000 / 8]; // one bit per address
+    uint8_t read_watch[0x10000 / 8];
+    uint8_t write_watch[0x10000 / 8];
+    int breakpoint_count;
+    int read_watch_count;
+    int write_watch_count;
+    bool pause; // stop before the next instruction
+    long steps; // instructions left to step, 0 when not stepping
+    bool quit; // the user asked to leave the emulator
+    bool write_hit; // a watched store happened during the last instruction
+    uint16_t hit_address;
+    uint8_t hit_old;
+    uint8_t hit_new;
+    const uint8_t *memory; // of the CPU the store hook is installed on
+    char last[DEBUG_LINE]; // repeated on an empty line
+} Debugger;
+
+static inline bool debug_bit(const uint8_t *bits, uint16_t address) {
+    return bits[address >> 3] & (1 << (address & 7));
+}
+
+static inline void debug_set_bit(uint8_t *bits, int *count, uint16_t address, bool on) {
+    if (debug_bit(bits, address) == on)
+        return;
+    bits[address >> 3] ^= 1 << (address & 7);
+    *count += on ? 1 : -1;
+}
+
+/**
+ * @brief returns whether the machine has to run the debug loop
+ */
+static inline bool debugger_armed(const Debugger *debugger) {
+    return debugger->pause || debugger->steps > 0 || debugger->breakpoint_count > 0 ||
+        debugger->read_watch_count > 0 || debugger->write_watch_count > 0;
+}
+
+static void debugger_write_hook(void *context, uint16_t address, uint8_t value) {
+    Debugger *debugger = context;
+    if (!debug_bit(debugger->write_watch, address) || debugger->write_hit)
+        return;
+    debugger->write_hit = true;
+    debugger->hit_address = address;
+    debugger->hit_old = debugger->memory[address]; // the hook runs before the store
+    debugger->hit_new = value;
+}
+
+/**
+ * @brief installs the store hook on the CPU while a write watchpoint is set
+ */
+static void debugger_sync(Debugger *debugger, State8080 *cpu) {
+    if (debugger->write_watch_count > 0) {
+        debugger->memory = cpu->memory;
+        cpu->write_hook = debugger_write_hook;
+        cpu->hook_context = debugger;
+    }
+    else if (cpu->write_hook == debugger_write_hook) {
+        cpu->write_hook = NULL;
+        cpu->hook_context = NULL;
+    }
+}
+
+/**
+ * @brief returns whether the conditional branch encoded in bits 3-5 of an
+ * opcode is taken
+ */
+static bool debug_condition(const State8080 *cpu, uint8_t opcode) {
+    static const uint8_t FLAG[4] = { FLAG_Z, FLAG_CY, FLAG_P, FLAG_S };
+    int condition = (opcode >> 3) & 7;
+    bool set = cpu->f & FLAG[condition >> 1];
+    return condition & 1 ? set : !set;
+}
+
+/**
+ * @brief lists the memory the next instruction will read as data
+ *
+ * @param cpu the State8080 object
+ * @param reads filled with up to two mapped addresses
+ * @return int number of addresses
+ */
+static int debug_data_reads(const State8080 *cpu, uint16_t reads[2]) {
+    const uint8_t *code = &cpu->memory[cpu->pc];
+    uint16_t word = (code[2] << 8) | code[1];
+    uint16_t hl = (cpu->h << 8) | cpu->l;
+    int count = 0;
+    switch (code[0]) {
+        case 0x0a: reads[count++] = (cpu->b << 8) | cpu->c; break; // LDAX B
+        case 0x1a: reads[count++] = (cpu->d << 8) | cpu->e; break; // LDAX D
+        case 0x2a: reads[count++] = word; reads[count++] = word + 1; break; // LHLD
+        case 0x3a: reads[count++] = word; break; // LDA
+        case 0x34: case 0x35: // INR M, DCR M
+        case 0x46: case 0x4e: case 0x56: case 0x5e: case 0x66: case 0x6e: case 0x7e: // MOV r,M
+        case 0x86: case 0x8e: case 0x96: case 0x9e: case 0xa6: case 0xae: case 0xb6: case 0xbe: // ALU M
+            reads[count++] = hl;
+            break;
+        case 0xc0: case 0xc8: case 0xd0: case 0xd8: case 0xe0: case 0xe8: case 0xf0: case 0xf8: // Rcc
+            if (!debug_condition(cpu, code[0]))
+                break;
+            // fall through
+        case 0xc1: case 0xd1: case 0xe1: case 0xf1: case 0xc9: case 0xd9: case 0xe3: // POP, RET, XTHL
+            reads[count++] = cpu->sp;
+            reads[count++] = cpu->sp + 1;
+            break;
+    }
+    for (int i = 0; i < count; i++)
+        reads[i] &= cpu->address_mask;
+    return count;
+}
+
+/**
+ * @brief prints the registers and the next instruction
+ */
+void debugger_print_registers(const State8080 *cpu) {
+    uint8_t f = cpu->f;
+    printf("AF %02x%02x BC %02x%02x DE %02x%02x HL %02x%02x SP %04x PC %04x  %c%c%c%c%c  %s%s cycle %llu\n",
+        cpu->a, f, cpu->b, cpu->c, cpu->d, cpu->e, cpu->h, cpu->l, cpu->sp, cpu->pc,
+        f & FLAG_S ? 'S' : '-', f & FLAG_Z ? 'Z' : '-', f & FLAG_AC ? 'A' : '-',
+        f & FLAG_P ? 'P' : '-', f & FLAG_CY ? 'C' : '-',
+        cpu->int_enable ? "EI" : "DI", cpu->halted ? " HALT" : "", (unsigned long long) cpu->cycles);
+    printf("=> ");
+    Disassemble8080Op(cpu->memory, cpu->pc);
+}
+
+static void debugger_dump(State8080 *cpu, uint16_t address, int length) {
+    for (int row = 0; row < length; row += 16) {
+        printf("%04x ", (uint16_t) (address + row));
+        for (int i = 0; i < 16; i++)
+            printf(i < length - row ? " %02x" : "   ", read_memory(cpu, address + row + i));
+        printf("  ");
+        for (int i = 0; i < 16 && i < length - row; i++) {
+            uint8_t c = read_memory(cpu, address + row + i);
+            putchar(isprint(c) ? c : '.');
+        }
+        printf("\n");
+    }
+}
+
+static void debugger_list(const Debugger *debugger) {
+    for (int address = 0; address < 0x10000; address++) {
+        bool r = debug_bit(debugger->read_watch, address), w = debug_bit(debugger->write_watch, address);
+        if (debug_bit(debugger->breakpoint, address))
+            printf("breakpoint %04x\n", address);
+        if (r || w)
+            printf("watchpoint %04x %s%s\n", address, r ? "r" : "", w ? "w" : "");
+    }
+}
+
+static bool parse_address(const char *text, uint16_t *address) {
+    if (text == NULL) {
+        printf("missing address\n");
+        return false;
+    }
+    if (text[0] == '$')
+        text++;
+    char *end;
+    unsigned long value = strtoul(text, &end, 16);
+    if (end == text || *end != '\0' || value > 0xffff) {
+        printf("bad address: %s\n", text);
+        return false;
+    }
+    *address = value;
+    return true;
+}
+
+/**
+ * @brief reads and runs commands until one resumes execution
+ *
+ * @param debugger the Debugger object
+ * @param cpu the State8080 object
+ */
+void debugger_prompt(Debugger *debugger, State8080 *cpu) {
+    char line[DEBUG_LINE];
+    debugger_print_registers(cpu);
+    for (;;) {
+        printf("(debug) ");
+        fflush(stdout);
+        if (fgets(line, sizeof(line), stdin) == NULL) {
+            // no console: drop everything and let the emulator run
+            printf("\n");
+            memset(debugger, 0, sizeof(Debugger));
+            debugger_sync(debugger, cpu);
+            return;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0')
+            strcpy(line, debugger->last);
+        else
+            strcpy(debugger->last, line);
+
+        char *command = strtok(line, " \t");
+        char *arg1 = strtok(NULL, " \t");
+        char *arg2 = strtok(NULL, " \t");
+        uint16_t address;
+        if (command == NULL)
+            continue;
+
+        switch (command[0]) {
+            case 'c':
+                return;
+            case 's':
+                debugger->steps = arg1 ? atol(arg1) : 1;
+                if (debugger->steps < 1)
+                    debugger->steps = 1;
+                return;
+            case 'b':
+                if (arg1 == NULL)
+                    debugger_list(debugger);
+                else if (parse_address(arg1, &address))
+                    debug_set_bit(debugger->breakpoint, &debugger->breakpoint_count, address, true);
+                break;
+            case 'w':
+                if (parse_address(arg1, &address)) {
+                    const char *mode = arg2 ? arg2 : "w";
+                    address &= cpu->address_mask;
+                    debug_set_bit(debugger->read_watch, &debugger->read_watch_count, address, strchr(mode, 'r') != NULL);
+                    debug_set_bit(debugger->write_watch, &debugger->write_watch_count, address, strchr(mode, 'w') != NULL);
+                    debugger_sync(debugger, cpu);
+                }
+                break;
+            case 'd':
+                if (parse_address(arg1, &address)) {
+                    debug_set_bit(debugger->breakpoint, &debugger->breakpoint_count, address, false);
+                    address &= cpu->address_mask;
+                    debug_set_bit(debugger->read_watch, &debugger->read_watch_count, address, false);
+                    debug_set_bit(debugger->write_watch, &debugger->write_watch_count, address, false);
+                    debugger_sync(debugger, cpu);
+                }
+                break;
+            case 'r':
+                debugger_print_registers(cpu);
+                break;
+            case 'x':
+                if (parse_address(arg1, &address))
+                    debugger_dump(cpu, address, arg2 ? atoi(arg2) : 64);
+                break;
+            case 'u':
+            {
+                int pc = cpu->pc;
+                if (arg1 && parse_address(arg1, &address))
+                    pc = address;
+                int count = arg2 ? atoi(arg2) : 10;
+                for (int i = 0; i < count && pc < 0x10000; i++) {
+                    printf("%c ", pc == cpu->pc ? '>' : debug_bit(debugger->breakpoint, pc) ? '*' : ' ');
+                    pc += Disassemble8080Op(cpu->memory, pc);
+                }
+                break;
+            }
+            case 'q':
+                debugger->quit = true;
+                return;
+            default:
+                printf("commands: c, s [n], b [addr], w addr [r|w|rw], d addr, r, x addr [len], u [addr] [n], q\n");
+        }
+    }
+}
+
+/**
+ * @brief runs the CPU one instruction at a time until the cycle counter
+ * reaches end, stopping at the prompt for breakpoints, watchpoints and steps
+ * Returns early if the user quits. Once nothing is armed any more the rest
+ * of the run goes to the core in one batch.
+ * @param debugger the Debugger object
+ * @param cpu the State8080 object
+ * @param end the cycle count to run to
+ */
+void debugger_run(Debugger *debugger, State8080 *cpu, uint64_t end) {
+    while (cpu->cycles < end && !debugger->quit) {
+        if (!debugger_armed(debugger)) {
+            emulate8080_run(cpu, end - cpu->cycles);
+            return;
+        }
+        // take due interrupts first so a stop shows the instruction that runs next
+        emulate8080_fire_events(cpu);
+
+        bool stop = debugger->pause;
+        if (!cpu->halted) {
+            if (debug_bit(debugger->breakpoint, cpu->pc)) {
+                printf("breakpoint at %04x\n", cpu->pc);
+                stop = true;
+            }
+            uint16_t reads[2];
+            int count = debugger->read_watch_count > 0 ? debug_data_reads(cpu, reads) : 0;
+            for (int i = 0; i < count; i++) {
+                if (debug_bit(debugger->read_watch, reads[i])) {
+                    printf("read watchpoint %04x = %02x\n", reads[i], cpu->memory[reads[i]]);
+                    stop = true;
+                    break;
+                }
+            }
+        }
+        if (stop) {
+            debugger->pause = false;
+            debugger->steps = 0;
+            debugger_prompt(debugger, cpu);
+            if (debugger->quit)
+                return;
+        }
+
+        uint16_t pc = cpu->pc;
+        debugger->write_hit = false;
+        emulate8080_run(cpu, 1);
+        if (debugger->write_hit) {
+            printf("write watchpoint %04x = %02x (was %02x) by the instruction at %04x\n",
+                debugger->hit_address, debugger->hit_new, debugger->hit_old, pc);
+            debugger->pause = true;
+        }
+        if (debugger->steps > 0 && --debugger->steps == 0)
+            debugger->pause = true;
+    }
+}
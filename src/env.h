@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*  Agent environment.
+    A reinforcement learning style wrapper around Machine:
+        env_reset(env)                          start a new game
+        env_step(env, action, frames, obs, f)   hold an action for some frames
+    The reward is the score gained, read as BCD from RAM, and an episode is
+    done when the game returns to attract mode. Observations are the screen
+    downsampled by a factor f (1, 2, 4 or 8), one byte per pixel (0 or 255,
+    a pixel is lit if any pixel it covers is), written straight into the
+    caller's buffer. env_step_batch steps many environments on a ThreadPool.
+
+    Every environment resets from one shared snapshot taken right after a
+    coin was inserted and a one player game started, so a reset is a
+    save state load rather than a replay of the attract mode.
+*/
+
+#define ENV_GAME_MODE 0x20ef // 1 while a game is played
+#define ENV_SCORE_LOW 0x20f8 // player 1 score, BCD, two low digits
+#define ENV_SCORE_HIGH 0x20f9 // two high digits
+#define ENV_LIVES 0x21ff // player 1 ships remaining
+#define ENV_START_TIMEOUT 1200 // frames to wait for a game to start
+
+typedef enum EnvAction {
+    ACTION_NOOP,
+    ACTION_FIRE,
+    ACTION_LEFT,
+    ACTION_RIGHT,
+    ACTION_LEFT_FIRE,
+    ACTION_RIGHT_FIRE,
+    ACTION_COUNT
+} EnvAction;
+
+// in_port_1 bits held for each action
+static const uint8_t ENV_ACTION_PORT[ACTION_COUNT] = {
+    0, 1 << 4, 1 << 5, 1 << 6, (1 << 5) | (1 << 4), (1 << 6) | (1 << 4)
+};
+
+typedef struct EnvStart {
+    uint8_t image[SAVESTATE_MAX_SIZE]; // save state at the start of a game
+    size_t size;
+    bool started; // false if the ROM never entered a game
+} EnvStart;
+
+typedef struct Env {
+    Machine machine;
+    const EnvStart *start;
+    uint32_t score;
+    uint8_t lives;
+    bool playing; // a game has been seen running this episode
+    bool done;
+    uint64_t frames; // this episode
+} Env;
+
+typedef struct StepResult {
+    int32_t reward;
+    bool done;
+    uint32_t score;
+    uint8_t lives;
+} StepResult;
+
+/**
+ * @brief returns the player 1 score
+ */
+static inline uint32_t env_score(const uint8_t *memory) {
+    uint8_t low = memory[ENV_SCORE_LOW], high = memory[ENV_SCORE_HIGH];
+    return (high >> 4) * 1000 + (high & 15) * 100 + (low >> 4) * 10 + (low & 15);
+}
+
+/**
+ * @brief returns the size in bytes of an observation at a downsample factor
+ */
+static inline size_t env_observation_size(int factor) {
+    return (size_t) (SCREEN_WIDTH / factor) * (SCREEN_HEIGHT / factor);
+}
+
+// lowest bit of each group of `factor` bits in a VRAM byte
+static const uint8_t ENV_GROUP_MASK[9] = { 0, 0xff, 0x55, 0, 0x11, 0, 0, 0, 0x01 };
+
+/**
+ * @brief decodes VRAM into a downsampled observation
+ * Rows run top to bottom like the framebuffer. Only set VRAM bits are
+ * visited, so a mostly dark screen is cheap.
+ * @param memory the 8080 memory
+ * @param obs destination, env_observation_size(factor) bytes
+ * @param factor downsample factor, 1, 2, 4 or 8
+ */
+void env_observe(const uint8_t *memory, uint8_t *obs, int factor) {
+    const uint8_t *vram = memory + VRAM_START;
+    int width = SCREEN_WIDTH / factor;
+    memset(obs, 0, env_observation_size(factor));
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+        uint8_t *column = obs + x / factor;
+        for (int row = 0; row < BLOCK_ROWS; row++) {
+            uint8_t bits = vram[x * BLOCK_ROWS + row];
+            // OR each group of `factor` vertical pixels into its lowest bit
+            for (int shift = 1; shift < factor; shift <<= 1)
+                bits |= bits >> shift;
+            bits &= ENV_GROUP_MASK[factor];
+            while (bits) {
+                int b = __builtin_ctz(bits);
+                bits &= bits - 1;
+                int y = SCREEN_HEIGHT - 1 - (row * 8 + b);
+                column[(y / factor) * width] = 255;
+            }
+        }
+    }
+}
+
+/**
+ * @brief powers on a machine and plays it up to the start of a one player
+ * game, the state every environment resets to
+ *
+ * @param start the EnvStart object
+ * @param rom the ROM image
+ */
+void env_prepare(EnvStart *start, const SharedRom *rom) {
+    Machine machine;
+    machine_init(&machine, rom);
+    long frame;
+    for (frame = 0; frame < ENV_START_TIMEOUT; frame++) {
+        // coin after the boot sequence, then 1P start
+        uint8_t port_1 = 0;
+        if (frame >= 60 && frame < 64)
+            port_1 = 1;
+        else if (frame >= 120 && frame < 124)
+            port_1 = 1 << 2;
+        machine.in_port_1 = port_1;
+        machine_run_frame(&machine);
+        if (frame >= 124 && machine.cpu->memory[ENV_GAME_MODE] == 1)
+            break;
+    }
+    machine.in_port_1 = 0;
+    start->started = frame < ENV_START_TIMEOUT;
+    start->size = machine_save(&machine, start->image);
+    machine_free(&machine);
+}
+
+/**
+ * @brief creates an environment
+ *
+ * @param env the Env object
+ * @param rom the ROM image
+ * @param start the shared reset state from env_prepare
+ */
+void env_init(Env *env, const SharedRom *rom, const EnvStart *start) {
+    machine_init(&env->machine, rom);
+    env->start = start;
+}
+
+/**
+ * @brief starts a new episode
+ *
+ * @param env the Env object
+ * @param obs if not NULL, receives the first observation
+ * @param factor observation downsample factor
+ */
+void env_reset(Env *env, uint8_t *obs, int factor) {
+    machine_load(&env->machine, env->start->image, env->start->size);
+    const uint8_t *memory = env->machine.cpu->memory;
+    env->score = env_score(memory);
+    env->lives = memory[ENV_LIVES];
+    env->playing = memory[ENV_GAME_MODE] == 1;
+    env->done = false;
+    env->frames = 0;
+    if (obs)
+        env_observe(memory, obs, factor);
+}
+
+/**
+ * @brief holds an action for a number of frames, stopping early if the
+ * episode ends
+ *
+ * @param env the Env object
+ * @param action one of EnvAction
+ * @param frames frames to hold the action for
+ * @param obs if not NULL, receives the observation after the last frame
+ * @param factor observation downsample factor
+ * @return StepResult
+ */
+StepResult env_step(Env *env, int action, int frames, uint8_t *obs, int factor) {
+    Machine *machine = &env->machine;
+    const uint8_t *memory = machine->cpu->memory;
+    uint32_t score_before = env->score;
+
+    for (int i = 0; i < frames && !env->done; i++) {
+        machine->in_port_1 = ENV_ACTION_PORT[(unsigned) action < ACTION_COUNT ? action : ACTION_NOOP];
+        machine_run_frame(machine);
+        env->frames++;
+
+        bool playing = memory[ENV_GAME_MODE] == 1;
+        env->done = env->playing && !playing;
+        env->playing |= playing;
+    }
+    env->score = env_score(memory);
+    env->lives = memory[ENV_LIVES];
+    if (obs)
+        env_observe(memory, obs, factor);
+
+    return (StepResult) { (int32_t) env->score - (int32_t) score_before, env->done, env->score, env->lives };
+}
+
+typedef struct EnvBatch {
+    Env *envs;
+    const uint8_t *actions;
+    int frames;
+    StepResult *results;
+    uint8_t *observations;
+    int factor;
+} EnvBatch;
+
+static void env_batch_task(void *context, int i) {
+    EnvBatch *batch = context;
+    uint8_t *obs = batch->observations ? batch->observations + i * env_observation_size(batch->factor) : NULL;
+    batch->results[i] = env_step(&batch->envs[i], batch->actions[i], batch->frames, obs, batch->factor);
+}
+
+/**
+ * @brief steps every environment with its own action on the pool
+ *
+ * @param pool the ThreadPool object
+ * @param envs the environments
+ * @param count number of environments
+ * @param actions one action per environment
+ * @param frames frames to hold each action for
+ * @param results one StepResult per environment
+ * @param observations NULL, or count observations laid out back to back
+ * @param factor observation downsample factor
+ */
+void env_step_batch(ThreadPool *pool, Env *envs, int count, const uint8_t *actions, int frames,
+    StepResult *results, uint8_t *observations, int factor) {
+    EnvBatch batch = { envs, actions, frames, results, observations, factor };
+    pool_for(pool, count, env_batch_task, &batch);
+}
@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+/*  Keyboard and gamepad input.
+    Keys and controller buttons are bound to actions, and every action is a
+    bit of input port 1 or 2. The front end drains the whole SDL event queue
+    at the frame boundary, right before the frame is emulated, so input that
+    arrived while the previous frame was paced is seen by the very next
+    frame. A press and release within one frame still shows for that frame.
+    The first controller plays player 1, the second player 2; the left stick
+    works like the d-pad.
+*/
+
+typedef enum InputAction {
+    ACTION_COIN,
+    ACTION_P1_START,
+    ACTION_P1_FIRE,
+    ACTION_P1_LEFT,
+    ACTION_P1_RIGHT,
+    ACTION_P2_START,
+    ACTION_P2_FIRE,
+    ACTION_P2_LEFT,
+    ACTION_P2_RIGHT,
+    ACTION_TILT,
+    INPUT_ACTIONS
+} InputAction;
+
+typedef struct InputBit {
+    const char *name; // as used by --bind
+    uint8_t port; // 1 or 2
+    uint8_t mask;
+} InputBit;
+
+static const InputBit INPUT_BITS[INPUT_ACTIONS] = {
+    [ACTION_COIN] = { "coin", 1, 0x01 },
+    [ACTION_P1_START] = { "p1-start", 1, 0x04 },
+    [ACTION_P1_FIRE] = { "p1-fire", 1, 0x10 },
+    [ACTION_P1_LEFT] = { "p1-left", 1, 0x20 },
+    [ACTION_P1_RIGHT] = { "p1-right", 1, 0x40 },
+    [ACTION_P2_START] = { "p2-start", 1, 0x02 },
+    [ACTION_P2_FIRE] = { "p2-fire", 2, 0x10 },
+    [ACTION_P2_LEFT] = { "p2-left", 2, 0x20 },
+    [ACTION_P2_RIGHT] = { "p2-right", 2, 0x40 },
+    [ACTION_TILT] = { "tilt", 2, 0x04 },
+};
+
+#define INPUT_MAX_BINDINGS 64
+#define INPUT_PADS 2
+#define INPUT_AXIS_DEADZONE 12000
+
+typedef struct KeyBinding {
+    SDL_Keycode key;
+    InputAction action;
+    bool down;
+} KeyBinding;
+
+typedef struct PadBinding {
+    int button; // SDL_GameControllerButton
+    InputAction action; // for the first controller, the P2 action is used for the second
+    bool down[INPUT_PADS];
+} PadBinding;
+
+typedef struct Input {
+    KeyBinding keys[INPUT_MAX_BINDINGS];
+    int key_count;
+    PadBinding buttons[INPUT_MAX_BINDINGS];
+    int button_count;
+
+    SDL_GameController *pads[INPUT_PADS];
+    SDL_JoystickID pad_ids[INPUT_PADS];
+    bool stick_left[INPUT_PADS], stick_right[INPUT_PADS];
+
+    uint16_t tapped; // actions pressed since the last sample, bit per action
+    double first_press; // first press since the last sample, now_seconds() clock, 0 if none
+    double sampled_press; // first_press as of the last sample
+    uint32_t events; // drained in the current frame
+    uint32_t max_events; // most events drained in one frame
+    FrameStats latency; // event timestamp to the frame that sees it
+} Input;
+
+static const KeyBinding DEFAULT_KEYS[] = {
+    { SDLK_c, ACTION_COIN },
+    { SDLK_1, ACTION_P1_START },
+    { SDLK_SPACE, ACTION_P1_FIRE },
+    { SDLK_a, ACTION_P1_LEFT },
+    { SDLK_d, ACTION_P1_RIGHT },
+    { SDLK_2, ACTION_P2_START },
+    { SDLK_k, ACTION_P2_FIRE },
+    { SDLK_j, ACTION_P2_LEFT },
+    { SDLK_l, ACTION_P2_RIGHT },
+};
+
+static const PadBinding DEFAULT_BUTTONS[] = {
+    { SDL_CONTROLLER_BUTTON_BACK, ACTION_COIN },
+    { SDL_CONTROLLER_BUTTON_START, ACTION_P1_START },
+    { SDL_CONTROLLER_BUTTON_A, ACTION_P1_FIRE },
+    { SDL_CONTROLLER_BUTTON_B, ACTION_P1_FIRE },
+    { SDL_CONTROLLER_BUTTON_DPAD_LEFT, ACTION_P1_LEFT },
+    { SDL_CONTROLLER_BUTTON_DPAD_RIGHT, ACTION_P1_RIGHT },
+};
+
+/**
+ * @brief sets up the default bindings
+ */
+void input_init(Input *input) {
+    memset(input, 0, sizeof(Input));
+    input->key_count = sizeof(DEFAULT_KEYS) / sizeof(DEFAULT_KEYS[0]);
+    memcpy(input->keys, DEFAULT_KEYS, sizeof(DEFAULT_KEYS));
+    input->button_count = sizeof(DEFAULT_BUTTONS) / sizeof(DEFAULT_BUTTONS[0]);
+    memcpy(input->buttons, DEFAULT_BUTTONS, sizeof(DEFAULT_BUTTONS));
+    input->latency.name = "input latency (event to emulated frame)";
+    input->latency.unit = "events";
+}
+
+/**
+ * @brief adds or replaces a binding
+ *
+ * @param input the Input object
+ * @param binding KEY=ACTION, where KEY is an SDL key name such as Left or
+ *        Space, or pad:BUTTON with an SDL controller button name such as
+ *        pad:dpleft, and ACTION one of the INPUT_BITS names
+ * @return true
+ * @return false if the binding could not be parsed
+ */
+bool input_bind(Input *input, const char *binding) {
+    const char *equals = strrchr(binding, '=');
+    if (equals == NULL || equals == binding)
+        return false;
+    char name[64];
+    size_t length = equals - binding;
+    if (length >= sizeof(name))
+        return false;
+    memcpy(name, binding, length);
+    name[length] = '\0';
+
+    int action = 0;
+    while (action < INPUT_ACTIONS && strcmp(INPUT_BITS[action].name, equals + 1) != 0)
+        action++;
+    if (action == INPUT_ACTIONS)
+        return false;
+
+    if (strncmp(name, "pad:", 4) == 0) {
+        int button = SDL_GameControllerGetButtonFromString(name + 4);
+        if (button == SDL_CONTROLLER_BUTTON_INVALID)
+            return false;
+        int b = 0;
+        while (b < input->button_count && input->buttons[b].button != button)
+            b++;
+        if (b == INPUT_MAX_BINDINGS)
+            return false;
+        input->buttons[b] = (PadBinding) { button, action, { false } };
+        if (b == input->button_count)
+            input->button_count++;
+        return true;
+    }
+
+    SDL_Keycode key = SDL_GetKeyFromName(name);
+    if (key == SDLK_UNKNOWN)
+        return false;
+    int k = 0;
+    while (k < input->key_count && input->keys[k].key != key)
+        k++;
+    if (k == INPUT_MAX_BINDINGS)
+        return false;
+    input->keys[k] = (KeyBinding) { key, action, false };
+    if (k == input->key_count)
+        input->key_count++;
+    return true;
+}
+
+/**
+ * @brief returns which of the two players a controller instance plays, -1
+ * if it is not open
+ */
+static int input_pad(Input *input, SDL_JoystickID id) {
+    for (int p = 0; p < INPUT_PADS; p++)
+        if (input->pads[p] && input->pad_ids[p] == id)
+            return p;
+    return -1;
+}
+
+/**
+ * @brief returns the action of a controller, mapped to player 2 for the
+ * second controller
+ */
+static InputAction pad_action(InputAction action, int pad) {
+    if (pad == 1 && action >= ACTION_P1_START && action <= ACTION_P1_RIGHT)
+        return action + (ACTION_P2_START - ACTION_P1_START);
+    return action;
+}
+
+/**
+ * @brief notes a press for the latency measurement
+ */
+static void input_press(Input *input, InputAction action, Uint32 timestamp) {
+    input->tapped |= 1 << action;
+    double age = (SDL_GetTicks() - timestamp) / 1e3;
+    stats_add(&input->latency, age);
+    if (input->first_press == 0)
+        input->first_press = now_seconds() - age;
+}
+
+/**
+ * @brief applies an event to the input state
+ *
+ * @param input the Input object
+ * @param event the event
+ * @return true if the event was for the game inputs
+ * @return false if the front end should handle it
+ */
+bool input_event(Input *input, const SDL_Event *event) {
+    input->events++;
+    switch (event->type) {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP: {
+        bool down = event->type == SDL_KEYDOWN;
+        bool bound = false;
+        for (int k = 0; k < input->key_count; k++) {
+            if (input->keys[k].key != event->key.keysym.sym)
+                continue;
+            bound = true;
+            if (down && !event->key.repeat)
+                input_press(input, input->keys[k].action, event->key.timestamp);
+            input->keys[k].down = down;
+        }
+        return bound;
+    }
+    case SDL_CONTROLLERDEVICEADDED:
+        for (int p = 0; p < INPUT_PADS; p++) {
+            if (input->pads[p])
+                continue;
+            input->pads[p] = SDL_GameControllerOpen(event->cdevice.which);
+            if (input->pads[p]) {
+                input->pad_ids[p] = SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(input->pads[p]));
+                printf("controller %d: %s\n", p + 1, SDL_GameControllerName(input->pads[p]));
+            }
+            break;
+        }
+        return true;
+    case SDL_CONTROLLERDEVICEREMOVED: {
+        int p = input_pad(input, event->cdevice.which);
+        if (p >= 0) {
+            SDL_GameControllerClose(input->pads[p]);
+            input->pads[p] = NULL;
+            for (int b = 0; b < input->button_count; b++)
+                input->buttons[b].down[p] = false;
+            input->stick_left[p] = input->stick_right[p] = false;
+        }
+        return true;
+    }
+    case SDL_CONTROLLERBUTTONDOWN:
+    case SDL_CONTROLLERBUTTONUP: {
+        int p = input_pad(input, event->cbutton.which);
+        if (p < 0)
+            return true;
+        bool down = event->type == SDL_CONTROLLERBUTTONDOWN;
+        for (int b = 0; b < input->button_count; b++) {
+            if (input->buttons[b].button != event->cbutton.button)
+                continue;
+            if (down)
+                input_press(input, pad_action(input->buttons[b].action, p), event->cbutton.timestamp);
+            input->buttons[b].down[p] = down;
+        }
+        return true;
+    }
+    case SDL_CONTROLLERAXISMOTION: {
+        int p = input_pad(input, event->caxis.which);
+        if (p >= 0 && event->caxis.axis == SDL_CONTROLLER_AXIS_LEFTX) {
+            input->stick_left[p] = event->caxis.value < -INPUT_AXIS_DEADZONE;
+            input->stick_right[p] = event->caxis.value > INPUT_AXIS_DEADZONE;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+/**
+ * @brief writes the state of the bound actions into the input ports, at the
+ * frame boundary; bits no action is bound to are left alone
+ *
+ * @param input the Input object
+ * @param port_1 input port 1
+ * @param port_2 input port 2
+ */
+void input_sample(Input *input, uint8_t *port_1, uint8_t *port_2) {
+    bool active[INPUT_ACTIONS] = { false };
+    for (int k = 0; k < input->key_count; k++)
+        active[input->keys[k].action] |= input->keys[k].down;
+    for (int p = 0; p < INPUT_PADS; p++) {
+        for (int b = 0; b < input->button_count; b++)
+            active[pad_action(input->buttons[b].action, p)] |= input->buttons[b].down[p];
+        active[pad_action(ACTION_P1_LEFT, p)] |= input->stick_left[p];
+        active[pad_action(ACTION_P1_RIGHT, p)] |= input->stick_right[p];
+    }
+
+    uint8_t ports[3] = { 0, *port_1, *port_2 };
+    for (int a = 0; a < INPUT_ACTIONS; a++) {
+        bool on = active[a] || (input->tapped & (1 << a));
+        ports[INPUT_BITS[a].port] = on ? ports[INPUT_BITS[a].port] | INPUT_BITS[a].mask
+            : ports[INPUT_BITS[a].port] & ~INPUT_BITS[a].mask;
+    }
+    *port_1 = ports[1];
+    *port_2 = ports[2];
+    input->tapped = 0;
+    input->sampled_press = input->first_press;
+    input->first_press = 0;
+    if (input->events > input->max_events)
+        input->max_events = input->events;
+    input->events = 0;
+}
+
+/**
+ * @brief prints the input latency and the largest event burst
+ */
+void input_print_stats(Input *input) {
+    stats_print(&input->latency);
+    printf("input: at most %u events drained in one frame\n", input->max_events);
+}
+
+/**
+ * @brief closes the controllers
+ */
+void input_free(Input *input) {
+    for (int p = 0; p < INPUT_PADS; p++)
+        if (input->pads[p])
+            SDL_GameControllerClose(input->pads[p]);
+}
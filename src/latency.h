@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*  Input-to-photon latency.
+    When a bit of input port 1 or 2 goes up, a probe follows that change
+    through the machine:
+        event    the key or button event (or the frame start for movies)
+        read     the end of the first frame in which the ROM ran IN on the
+                 port, seen through Machine.port_reads
+        VRAM     the end of the first frame whose VRAM differs from a shadow
+                 machine that ran the same frames without the change, so
+                 only pixels caused by the input count, not the aliens that
+                 march every frame anyway
+        present  the end of render() for that frame
+    One probe runs at a time; changes while it is running are skipped. The
+    shadow costs one save state when the probe starts and one extra frame
+    of emulation per frame until the change shows. That is cheap next to a
+    paced window, where probes are always on, but not next to a headless
+    benchmark: there they need --latency, and their time is counted apart.
+*/
+
+#define LATENCY_BIN_MS 2
+#define LATENCY_BINS 50 // the last bin also counts everything slower
+#define LATENCY_TIMEOUT 120 // frames before a probe gives up
+
+typedef struct LatencyHistogram {
+    const char *name;
+    uint32_t bins[LATENCY_BINS];
+    uint64_t count;
+    double total;
+    double max;
+} LatencyHistogram;
+
+typedef enum LatencyStage {
+    LATENCY_IDLE,
+    LATENCY_READ, // waiting for the ROM to read the port
+    LATENCY_VRAM, // waiting for VRAM to differ from the shadow
+    LATENCY_PRESENT // waiting for the frame to be shown
+} LatencyStage;
+
+typedef struct Latency {
+    Machine shadow; // the machine as if the change had not happened
+    uint8_t image[SAVESTATE_MAX_SIZE];
+    bool presenting; // frames are shown, probes end at present rather than at VRAM
+
+    LatencyStage stage;
+    int port; // 1 or 2
+    uint8_t bits; // the bits that went up
+    int frames; // frames run since the probe started
+    double event_time, read_time, vram_time;
+
+    LatencyHistogram event_to_read, read_to_vram, vram_to_present, event_to_present;
+    uint64_t probes, unread, invisible, skipped;
+    uint64_t visible, visible_frames; // probes that reached VRAM, and their frames from the event
+    double time; // spent saving state and running the shadow
+} Latency;
+
+/**
+ * @brief adds one latency to a histogram
+ */
+static void histogram_add(LatencyHistogram *histogram, double seconds) {
+    double ms = seconds > 0 ? seconds * 1e3 : 0;
+    int bin = ms / LATENCY_BIN_MS;
+    histogram->bins[bin < LATENCY_BINS ? bin : LATENCY_BINS - 1]++;
+    histogram->count++;
+    histogram->total += ms;
+    if (ms > histogram->max)
+        histogram->max = ms;
+}
+
+/**
+ * @brief prints the average, maximum and percentiles and one bar per
+ * non-empty bin
+ */
+static void histogram_print(const LatencyHistogram *histogram) {
+    if (histogram->count == 0)
+        return;
+    uint32_t peak = 0;
+    int percentile[3] = { -1, -1, -1 };
+    const double fractions[3] = { 0.5, 0.95, 0.99 };
+    uint64_t seen = 0;
+    for (int b = 0; b < LATENCY_BINS; b++) {
+        if (histogram->bins[b] > peak)
+            peak = histogram->bins[b];
+        seen += histogram->bins[b];
+        for (int p = 0; p < 3; p++)
+            if (percentile[p] < 0 && seen >= histogram->count * fractions[p])
+                percentile[p] = b;
+    }
+    printf("%s: %llu, avg %.1f ms, max %.1f ms, p50 < %d ms, p95 < %d ms, p99 < %d ms\n",
+        histogram->name, (unsigned long long) histogram->count, histogram->total / histogram->count,
+        histogram->max, (percentile[0] + 1) * LATENCY_BIN_MS, (percentile[1] + 1) * LATENCY_BIN_MS,
+        (percentile[2] + 1) * LATENCY_BIN_MS);
+    for (int b = 0; b < LATENCY_BINS; b++) {
+        if (histogram->bins[b] == 0)
+            continue;
+        char bar[41];
+        int length = (histogram->bins[b] * 40 + peak - 1) / peak;
+        memset(bar, '#', length);
+        bar[length] = '\0';
+        if (b == LATENCY_BINS - 1)
+            printf("  %3d+    ms %-40s %u\n", b * LATENCY_BIN_MS, bar, histogram->bins[b]);
+        else
+            printf("  %3d-%-3d ms %-40s %u\n", b * LATENCY_BIN_MS, (b + 1) * LATENCY_BIN_MS, bar, histogram->bins[b]);
+    }
+}
+
+/**
+ * @brief sets up the tracker and its shadow machine
+ *
+ * @param latency the Latency object
+ * @param rom the ROM image, for the shadow machine
+ * @param presenting whether frames are shown; headless probes end at VRAM
+ */
+void latency_init(Latency *latency, const SharedRom *rom, bool presenting) {
+    memset(latency, 0, sizeof(Latency));
+    machine_init(&latency->shadow, rom);
+    latency->shadow.cpu->untraced = 1; // its instructions would interleave with the real ones
+    latency->presenting = presenting;
+    latency->event_to_read.name = "latency event to IN";
+    latency->read_to_vram.name = "latency IN to VRAM";
+    latency->vram_to_present.name = "latency VRAM to present";
+    latency->event_to_present.name = presenting ? "latency event to present" : "latency event to VRAM";
+}
+
+/**
+ * @brief drops the running probe, when the machine jumps to another state
+ */
+void latency_cancel(Latency *latency) {
+    latency->stage = LATENCY_IDLE;
+}
+
+/**
+ * @brief called right before a frame is emulated, with the input ports the
+ * previous frame ran with; starts a probe if a bit went up
+ *
+ * @param latency the Latency object
+ * @param machine the machine, with this frame's input in its ports
+ * @param port_1 input port 1 of the previous frame
+ * @param port_2 input port 2 of the previous frame
+ * @param event_time when the input event happened, now_seconds() clock
+ */
+void latency_frame_start(Latency *latency, Machine *machine, uint8_t port_1, uint8_t port_2, double event_time) {
+    uint8_t up_1 = machine->in_port_1 & ~port_1, up_2 = machine->in_port_2 & ~port_2;
+    if (latency->stage != LATENCY_IDLE) {
+        if (up_1 | up_2)
+            latency->skipped++;
+        // the shadow follows every other input change
+        uint8_t *shadow_port = latency->port == 1 ? &latency->shadow.in_port_1 : &latency->shadow.in_port_2;
+        uint8_t live = latency->port == 1 ? machine->in_port_1 : machine->in_port_2;
+        latency->shadow.in_port_1 = machine->in_port_1;
+        latency->shadow.in_port_2 = machine->in_port_2;
+        *shadow_port = live & ~latency->bits;
+        return;
+    }
+    if ((up_1 | up_2) == 0)
+        return;
+
+    double start = now_seconds();
+    size_t size = machine_save(machine, latency->image);
+    machine_load(&latency->shadow, latency->image, size);
+    latency->time += now_seconds() - start;
+    latency->port = up_1 ? 1 : 2;
+    latency->bits = up_1 ? up_1 : up_2;
+    if (latency->port == 1)
+        latency->shadow.in_port_1 &= ~latency->bits;
+    else
+        latency->shadow.in_port_2 &= ~latency->bits;
+    latency->stage = LATENCY_READ;
+    latency->frames = 0;
+    latency->event_time = event_time;
+    latency->probes++;
+}
+
+/**
+ * @brief called after a frame was emulated; runs the shadow and looks for
+ * the read and the first VRAM difference
+ *
+ * @param latency the Latency object
+ * @param machine the machine
+ */
+void latency_frame_end(Latency *latency, Machine *machine) {
+    if (latency->stage != LATENCY_READ && latency->stage != LATENCY_VRAM)
+        return;
+    double now = now_seconds();
+    machine_run_frame(&latency->shadow);
+    latency->time += now_seconds() - now;
+    latency->frames++;
+
+    if (latency->stage == LATENCY_READ && (machine->port_reads & (1 << latency->port))) {
+        latency->read_time = now;
+        histogram_add(&latency->event_to_read, now - latency->event_time);
+        latency->stage = LATENCY_VRAM;
+    }
+    if (latency->stage == LATENCY_VRAM &&
+        memcmp(machine->cpu->memory + VRAM_START, latency->shadow.cpu->memory + VRAM_START, VRAM_SIZE) != 0) {
+        latency->vram_time = now;
+        latency->visible++;
+        latency->visible_frames += latency->frames;
+        histogram_add(&latency->read_to_vram, now - latency->read_time);
+        if (latency->presenting)
+            latency->stage = LATENCY_PRESENT;
+        else {
+            histogram_add(&latency->event_to_present, now - latency->event_time);
+            latency->stage = LATENCY_IDLE;
+        }
+        return;
+    }
+    if (latency->frames >= LATENCY_TIMEOUT) {
+        if (latency->stage == LATENCY_READ)
+            latency->unread++;
+        else
+            latency->invisible++;
+        latency->stage = LATENCY_IDLE;
+    }
+}
+
+/**
+ * @brief called when a frame has been shown
+ *
+ * @param latency the Latency object
+ * @param now when the present finished, now_seconds() clock
+ */
+void latency_present(Latency *latency, double now) {
+    if (latency->stage != LATENCY_PRESENT)
+        return;
+    histogram_add(&latency->vram_to_present, now - latency->vram_time);
+    histogram_add(&latency->event_to_present, now - latency->event_time);
+    latency->stage = LATENCY_IDLE;
+}
+
+/**
+ * @brief prints the histograms and how many probes did not finish
+ */
+void latency_print_stats(Latency *latency) {
+    if (latency->probes == 0)
+        return;
+    printf("latency: %llu probes, %llu never read, %llu read without a visible change, %llu changes skipped while busy\n",
+        (unsigned long long) latency->probes, (unsigned long long) latency->unread,
+        (unsigned long long) latency->invisible, (unsigned long long) latency->skipped);
+    printf("latency: probes took %.3f s\n", latency->time);
+    if (latency->visible)
+        printf("latency: VRAM changed %.2f emulated frames after the input on average\n",
+            (double) latency->visible_frames / latency->visible);
+    histogram_print(&latency->event_to_read);
+    histogram_print(&latency->read_to_vram);
+    histogram_print(&latency->vram_to_present);
+    histogram_print(&latency->event_to_present);
+}
+
+/**
+ * @brief releases the shadow machine, if latency_init made one
+ */
+void latency_free(Latency *latency) {
+    if (latency->shadow.cpu)
+        machine_free(&latency->shadow);
+}
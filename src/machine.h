@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*  The Space Invaders machine: an 8080 with the ROM loaded, the external
+    shift register, the input ports and the sound latches. Everything an
+    instance needs is inside Machine, so any number of them can run side by
+    side; the window, audio and video conversion belong to the front end.
+    Instances map the shared ROM into their address space (see memmap.h).
+
+    Only address lines A0-A13 are decoded, so 0x4000-0xFFFF mirrors the
+    16K below it: stores into the 0x6000 mirror land in RAM, stores into
+    ROM or its mirrors are dropped.
+*/
+
+#define CYCLES_PER_FRAME 33333 // 2 MHz / 60 Hz
+#define MACHINE_LATCHES 12
+#define MACHINE_ADDRESS_MASK 0x3fff
+#define MACHINE_SOUND_EVENTS 16 // sound latch changes kept per frame
+
+typedef struct Machine {
+    State8080 *cpu;
+    bool mapped; // memory comes from instance_memory_map rather than the heap
+
+    uint8_t shift0;
+    uint8_t shift1;
+    uint8_t shift_offset;
+
+    uint8_t in_port_1;
+    uint8_t in_port_2;
+    uint8_t in_port_3;
+    uint8_t out_port_2;
+    uint8_t out_port_4;
+
+    uint8_t sound1;
+    uint8_t sound2;
+    uint8_t last_sound1;
+    uint8_t last_sound2;
+
+    // sound latch changes of the frame being run, timed in cycles from
+    // frame_start; cleared when the next frame starts
+    uint64_t frame_start;
+    SoundEvent sound_events[MACHINE_SOUND_EVENTS];
+    int sound_event_count;
+    uint8_t port_reads; // bit per port read by IN in the frame being run
+
+    Debugger *debugger; // NULL, or checked once per run to pick the debug loop
+} Machine;
+
+/**
+ * @brief lists the machine latches in save state order
+ *
+ * @param machine the Machine object
+ * @param latches filled with MACHINE_LATCHES pointers
+ */
+static inline void machine_latches(Machine *machine, uint8_t *latches[MACHINE_LATCHES]) {
+    uint8_t *list[MACHINE_LATCHES] = {
+        &machine->shift0, &machine->shift1, &machine->shift_offset,
+        &machine->in_port_1, &machine->in_port_2, &machine->in_port_3,
+        &machine->out_port_2, &machine->out_port_4,
+        &machine->sound1, &machine->sound2, &machine->last_sound1, &machine->last_sound2
+    };
+    memcpy(latches, list, sizeof(list));
+}
+
+/**
+ * @brief reads data from the specified port, called by the CPU for IN
+ *
+ * @param context the Machine object
+ * @param port the port to read from
+ * @return uint8_t
+ */
+uint8_t machine_in(void *context, uint8_t port) {
+    Machine *machine = context;
+    if (!machine->cpu->untraced)
+        IO_TRACE("PORT: %d\n", port);
+    machine->port_reads |= 1 << (port & 7);
+    uint8_t a = 0;
+    switch(port)
+    {
+        case 1:
+            a = machine->in_port_1;
+            break;
+        case 2:
+            a = machine->in_port_2;
+            break;
+        case 3:
+        {
+            uint16_t v = (machine->shift1<<8) | (machine->shift0);
+            a = ((v >> (8-machine->shift_offset)) & 0xff);
+            break;
+        }
+    }
+    return a;
+}
+
+/**
+ * @brief records a sound latch change with its cycle in the frame
+ * Once the frame's slots are used up, a change is folded into the latest 
+ * event of its bank, so the mixer still ends the frame on the final latch 
+ * value; only the edges in between are lost.
+ */
+static inline void machine_sound_event(Machine *machine, uint8_t bank, uint8_t value, uint8_t previous) {
+    SoundEvent *events = machine->sound_events;
+    if (machine->sound_event_count == MACHINE_SOUND_EVENTS) {
+        for (int e = MACHINE_SOUND_EVENTS - 1; e >= 0; e--)
+            if (events[e].bank == bank) {
+                events[e].value = value;
+                return;
+            }
+        // every slot holds the other bank: fold its last change into the one before
+        events[MACHINE_SOUND_EVENTS - 2].value = events[MACHINE_SOUND_EVENTS - 1].value;
+        machine->sound_event_count--;
+    }
+    uint32_t cycle = machine->cpu->cycles - machine->frame_start;
+    machine->sound_events[machine->sound_event_count++] = (SoundEvent) { cycle, bank, value, previous };
+}
+
+/**
+ * @brief writes data to the specified port, called by the CPU for OUT
+ *
+ * @param context the Machine object
+ * @param port the port to write to
+ * @param value the data to write to the port
+ */
+void machine_out(void *context, uint8_t port, uint8_t value) {
+    Machine *machine = context;
+    if (!machine->cpu->untraced)
+        IO_TRACE("WRITE %02x TO PORT %02X\n", value, port);
+    switch(port)
+    {
+        case 2:
+            machine->shift_offset = value & 0x7;
+            break;
+        case 3:
+        {
+            uint8_t previous = machine->last_sound1;
+            machine->sound1 = machine->last_sound1 = value;
+            if (value != previous)
+                machine_sound_event(machine, 1, value, previous);
+            break;
+        }
+        case 4:
+            machine->shift0 = machine->shift1;
+            machine->shift1 = value;
+            break;
+        case 5:
+        {
+            uint8_t previous = machine->last_sound2;
+            machine->sound2 = machine->last_sound2 = value;
+            if (value != previous)
+                machine_sound_event(machine, 2, value, previous);
+            break;
+        }
+    }
+}
+
+static void machine_power_on(Machine *machine, uint8_t *memory, bool mapped) {
+    memset(machine, 0, sizeof(Machine));
+    machine->cpu = Init8080WithMemory(memory);
+    machine->mapped = mapped;
+    State8080 *cpu = machine->cpu;
+    cpu->pc = 0;
+    cpu->port_in = machine_in;
+    cpu->port_out = machine_out;
+    cpu->io_context = machine;
+    cpu->address_mask = MACHINE_ADDRESS_MASK;
+    cpu->rom_end = ROM_SIZE;
+
+    // mid-screen interrupt (RST 1) and VBlank interrupt (RST 2)
+    emulate8080_schedule(cpu, CYCLES_PER_FRAME / 2, CYCLES_PER_FRAME, 1);
+    emulate8080_schedule(cpu, CYCLES_PER_FRAME, CYCLES_PER_FRAME, 2);
+}
+
+/**
+ * @brief powers on a machine with a private heap copy of the whole 64K, the
+ * layout used before ROM sharing; kept for comparison
+ *
+ * @param machine the Machine object
+ * @param rom the ROM image
+ */
+void machine_init_copy(Machine *machine, const SharedRom *rom) {
+    uint8_t *memory = calloc(ADDRESS_SPACE, 1);
+    memcpy(memory, rom->data, rom->size);
+    machine_power_on(machine, memory, false);
+}
+
+/**
+ * @brief powers on a machine with the shared ROM mapped into its memory
+ *
+ * @param machine the Machine object
+ * @param rom the ROM image
+ */
+void machine_init(Machine *machine, const SharedRom *rom) {
+    uint8_t *memory = instance_memory_map(rom);
+    if (memory)
+        machine_power_on(machine, memory, true);
+    else
+        machine_init_copy(machine, rom);
+}
+
+/**
+ * @brief releases the memory of a machine
+ *
+ * @param machine the Machine object
+ */
+void machine_free(Machine *machine) {
+    if (machine->mapped)
+        instance_memory_unmap(machine->cpu->memory);
+    else
+        free(machine->cpu->memory);
+    free(machine->cpu);
+    machine->cpu = NULL;
+}
+
+/**
+ * @brief runs the machine until the cycle counter reaches end
+ *
+ * @param machine the Machine object
+ * @param end the cycle count to run to
+ */
+void machine_run(Machine *machine, uint64_t end) {
+    State8080 *cpu = machine->cpu;
+    if (end <= cpu->cycles)
+        return;
+    if (machine->debugger && debugger_armed(machine->debugger)) {
+        debugger_run(machine->debugger, cpu, end);
+        return;
+    }
+    if (TRACE_LEVEL < TRACE_IO || cpu->untraced) {
+        emulate8080_run(cpu, end - cpu->cycles);
+        return;
+    }
+    // step one instruction at a time so the game mode check sees every pc
+    while (cpu->cycles < end) {
+        if (cpu->pc == 0x0AC2)
+            IO_TRACE("MODE = %d\n", cpu->memory[0x20c1]);
+        emulate8080_run(cpu, 1);
+    }
+}
+
+/**
+ * @brief runs one frame, up to just past the next VBlank interrupt
+ *
+ * @param machine the Machine object
+ */
+void machine_run_frame(Machine *machine) {
+    // frames end just past a VBlank; loading a state moves the cycle count
+    uint64_t cycles = machine->cpu->cycles;
+    uint64_t frame_start = cycles - cycles % CYCLES_PER_FRAME;
+    machine->frame_start = frame_start;
+    machine->sound_event_count = 0;
+    machine->port_reads = 0;
+    machine_run(machine, frame_start + CYCLES_PER_FRAME / 2);
+    machine_run(machine, frame_start + CYCLES_PER_FRAME);
+}
+
+/**
+ * @brief snapshots the machine into a save state image
+ *
+ * @param machine the Machine object
+ * @param buf destination, at least SAVESTATE_MAX_SIZE bytes
+ * @return size_t size of the image
+ */
+size_t machine_save(Machine *machine, uint8_t *buf) {
+    uint8_t *pointers[MACHINE_LATCHES];
+    uint8_t latches[MACHINE_LATCHES];
+    machine_latches(machine, pointers);
+    for (int i = 0; i < MACHINE_LATCHES; i++)
+        latches[i] = *pointers[i];
+    return savestate_write(buf, machine->cpu, latches, MACHINE_LATCHES);
+}
+
+/**
+ * @brief restores the machine from a save state image
+ *
+ * @param machine the Machine object
+ * @param buf the save state
+ * @param size size of the image
+ * @return true
+ * @return false if the image was rejected, the machine is unchanged
+ */
+bool machine_load(Machine *machine, const uint8_t *buf, size_t size) {
+    uint8_t *pointers[MACHINE_LATCHES];
+    uint8_t latches[MACHINE_LATCHES];
+    if (!savestate_read(buf, size, machine->cpu, latches, MACHINE_LATCHES))
+        return false;
+    machine_latches(machine, pointers);
+    for (int i = 0; i < MACHINE_LATCHES; i++)
+        *pointers[i] = latches[i];
+    return true;
+}
+
+/**
+ * @brief fingerprints the whole machine state
+ *
+ * @param machine the Machine object
+ * @return uint64_t
+ */
+uint64_t machine_hash(Machine *machine) {
+    uint8_t image[SAVESTATE_MAX_SIZE];
+    return movie_hash(image, machine_save(machine, image));
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*  Memory layout of machine instances.
+    Every instance still sees a flat 64K address space, so the CPU core
+    indexes memory directly, but the space is a mapping rather than a heap
+    copy:
+        0x0000-0x1FFF  the ROM image file, mapped private and read-only
+        0x2000-0x3FFF  RAM, anonymous, the only pages an instance owns
+        0x4000-0xFFFF  anonymous, costs nothing until written
+    Private file mappings share the page cache, so all instances use the
+    same physical ROM pages. write_memory drops stores below rom_end, so a
+    write that reaches the ROM pages is a bug and faults rather than giving
+    the instance a private copy. If the page size does not divide the ROM
+    area, the ROM is copied into each instance instead, and stays writable.
+*/
+
+#define ADDRESS_SPACE 0x10000
+
+/**
+ * @brief returns whether the ROM can be mapped into instances page by page
+ */
+static inline bool rom_shareable(const SharedRom *rom) {
+    long page = sysconf(_SC_PAGESIZE);
+    return rom->fd >= 0 && page > 0 && ROM_SIZE % page == 0;
+}
+
+/**
+ * @brief creates the 64K address space of an instance
+ *
+ * @param rom the ROM image
+ * @return uint8_t* the address space, NULL if it could not be mapped
+ */
+uint8_t *instance_memory_map(const SharedRom *rom) {
+    uint8_t *memory = mmap(NULL, ADDRESS_SPACE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return NULL;
+    long page = sysconf(_SC_PAGESIZE);
+    size_t length = (rom->size + page - 1) / page * page;
+    if (!rom_shareable(rom) ||
+        mmap(memory, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, rom->fd, 0) == MAP_FAILED)
+        memcpy(memory, rom->data, rom->size);
+    return memory;
+}
+
+/**
+ * @brief releases an address space from instance_memory_map
+ */
+void instance_memory_unmap(uint8_t *memory) {
+    munmap(memory, ADDRESS_SPACE);
+}
+
+/**
+ * @brief returns the resident memory private to the process in bytes, 0 if 
+ * unknown. File pages such as the mapped ROM are left out: the kernel 
+ * counts them once per mapping, but they are shared page cache.
+ */
+size_t private_resident_bytes() {
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL)
+        return 0;
+    unsigned long size = 0, resident = 0, shared = 0;
+    if (fscanf(f, "%lu %lu %lu", &size, &resident, &shared) != 3)
+        resident = shared = 0;
+    fclose(f);
+    return (resident - shared) * sysconf(_SC_PAGESIZE);
+}
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*  Input movies.
+    A movie holds the input port values of every frame of a session from
+    power-on, run-length encoded, so replaying it reproduces the session
+    exactly. The file layout is little-endian:
+        header  "SIMV", version (u16), flags (u8), frames (u32),
+                run count (u32), final state hash (u64)
+        runs    frames (u16), in_port_1 (u8), in_port_2 (u8)
+    The hash is taken over the save state image after the last frame, and
+    is only valid when MOVIE_HAS_HASH is set.
+*/
+
+#define MOVIE_MAGIC "SIMV"
+#define MOVIE_VERSION 1
+#define MOVIE_HAS_HASH 0x01
+#define MOVIE_HEADER_SIZE 23
+#define MOVIE_RUN_SIZE 4
+
+typedef struct MovieRun {
+    uint16_t frames;
+    uint8_t port_1;
+    uint8_t port_2;
+} MovieRun;
+
+typedef struct Movie {
+    MovieRun *runs;
+    uint32_t run_count;
+    uint32_t capacity;
+    uint32_t frames;
+    uint8_t flags;
+    uint64_t hash;
+    uint32_t cursor_run; // replay position
+    uint32_t cursor_frame; // frames of cursor_run already replayed
+} Movie;
+
+/**
+ * @brief FNV-1a hash, used to fingerprint the final machine state
+ */
+uint64_t movie_hash(const uint8_t *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief appends one frame of input
+ *
+ * @param movie the Movie object
+ * @param port_1 in_port_1 during the frame
+ * @param port_2 in_port_2 during the frame
+ */
+void movie_record(Movie *movie, uint8_t port_1, uint8_t port_2) {
+    MovieRun *last = movie->run_count ? &movie->runs[movie->run_count - 1] : NULL;
+    if (last && last->port_1 == port_1 && last->port_2 == port_2 && last->frames < 0xffff)
+        last->frames++;
+    else {
+        if (movie->run_count == movie->capacity) {
+            movie->capacity = movie->capacity ? movie->capacity * 2 : 256;
+            movie->runs = realloc(movie->runs, movie->capacity * sizeof(MovieRun));
+        }
+        movie->runs[movie->run_count++] = (MovieRun) { 1, port_1, port_2 };
+    }
+    movie->frames++;
+    movie->flags &= ~MOVIE_HAS_HASH;
+}
+
+/**
+ * @brief drops the last recorded frame, used when the session steps back
+ *
+ * @param movie the Movie object
+ */
+void movie_unrecord(Movie *movie) {
+    if (movie->frames == 0)
+        return;
+    MovieRun *last = &movie->runs[movie->run_count - 1];
+    if (--last->frames == 0)
+        movie->run_count--;
+    movie->frames--;
+    movie->flags &= ~MOVIE_HAS_HASH;
+}
+
+/**
+ * @brief returns the input of the next frame of a replay
+ *
+ * @param movie the Movie object
+ * @param port_1 set to in_port_1 of the frame
+ * @param port_2 set to in_port_2 of the frame
+ * @return true
+ * @return false if the movie has ended
+ */
+bool movie_next(Movie *movie, uint8_t *port_1, uint8_t *port_2) {
+    while (movie->cursor_run < movie->run_count &&
+        movie->cursor_frame == movie->runs[movie->cursor_run].frames) {
+        movie->cursor_run++;
+        movie->cursor_frame = 0;
+    }
+    if (movie->cursor_run == movie->run_count)
+        return false;
+    MovieRun *run = &movie->runs[movie->cursor_run];
+    movie->cursor_frame++;
+    *port_1 = run->port_1;
+    *port_2 = run->port_2;
+    return true;
+}
+
+/**
+ * @brief stores the hash of the state after the last frame
+ */
+void movie_set_hash(Movie *movie, uint64_t hash) {
+    movie->hash = hash;
+    movie->flags |= MOVIE_HAS_HASH;
+}
+
+/**
+ * @brief writes a movie file
+ *
+ * @return true
+ * @return false
+ */
+bool movie_write(const char *path, const Movie *movie) {
+    uint8_t header[MOVIE_HEADER_SIZE];
+    memcpy(header, MOVIE_MAGIC, 4);
+    put_u16(header + 4, MOVIE_VERSION);
+    header[6] = movie->flags;
+    put_u32(header + 7, movie->frames);
+    put_u32(header + 11, movie->run_count);
+    put_u64(header + 15, movie->hash);
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "error: could not write movie %s\n", path);
+        return false;
+    }
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+    for (uint32_t i = 0; ok && i < movie->run_count; i++) {
+        uint8_t run[MOVIE_RUN_SIZE];
+        put_u16(run, movie->runs[i].frames);
+        run[2] = movie->runs[i].port_1;
+        run[3] = movie->runs[i].port_2;
+        ok = fwrite(run, sizeof(run), 1, f) == 1;
+    }
+    fclose(f);
+    if (!ok)
+        fprintf(stderr, "error: could not write movie %s\n", path);
+    return ok;
+}
+
+/**
+ * @brief reads a movie file, ready for replay
+ *
+ * @return true
+ * @return false if the file is missing or not a valid movie
+ */
+bool movie_read(const char *path, Movie *movie) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "error: could not open movie %s\n", path);
+        return false;
+    }
+    uint8_t header[MOVIE_HEADER_SIZE];
+    if (fread(header, sizeof(header), 1, f) != 1 || memcmp(header, MOVIE_MAGIC, 4) != 0) {
+        fprintf(stderr, "error: %s is not a movie\n", path);
+        fclose(f);
+        return false;
+    }
+    if (get_u16(header + 4) != MOVIE_VERSION) {
+        fprintf(stderr, "error: unsupported movie version %u (expected %u)\n", get_u16(header + 4), MOVIE_VERSION);
+        fclose(f);
+        return false;
+    }
+
+    memset(movie, 0, sizeof(Movie));
+    movie->flags = header[6];
+    movie->hash = get_u64(header + 15);
+    uint32_t frames = get_u32(header + 7);
+    uint32_t run_count = get_u32(header + 11);
+    // the header is not trusted with the allocation: the runs must be in the file
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, MOVIE_HEADER_SIZE, SEEK_SET);
+    if (size < 0 || run_count > (unsigned long) (size - MOVIE_HEADER_SIZE) / MOVIE_RUN_SIZE) {
+        fprintf(stderr, "error: movie %s is truncated\n", path);
+        fclose(f);
+        return false;
+    }
+    movie->runs = malloc((run_count ? run_count : 1) * sizeof(MovieRun));
+    if (movie->runs == NULL) {
+        fprintf(stderr, "error: not enough memory for movie %s\n", path);
+        fclose(f);
+        return false;
+    }
+    movie->capacity = run_count;
+
+    for (uint32_t i = 0; i < run_count; i++) {
+        uint8_t run[MOVIE_RUN_SIZE];
+        if (fread(run, sizeof(run), 1, f) != 1) {
+            fprintf(stderr, "error: movie %s is truncated\n", path);
+            fclose(f);
+            free(movie->runs);
+            movie->runs = NULL;
+            return false;
+        }
+        movie->runs[i] = (MovieRun) { get_u16(run), run[2], run[3] };
+        movie->frames += movie->runs[i].frames;
+    }
+    movie->run_count = run_count;
+    fclose(f);
+
+    if (movie->frames != frames) {
+        fprintf(stderr, "error: movie %s is corrupt\n", path);
+        free(movie->runs);
+        movie->runs = NULL;
+        movie->run_count = 0;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+/*  Frame pacing.
+    Ties the emulated cycle count to SDL's high resolution counter: cycle n
+    is due at anchor + n / (2 MHz * speed). Each frame sleeps until its last
+    cycle is due, spinning for the final stretch because SDL_Delay only has
+    millisecond resolution. speed > 1 is turbo, speed < 1 slow motion.
+*/
+
+#define CPU_HZ 2000000.0
+#define PACING_SPIN_SECONDS 0.002 // spin instead of sleeping this close to the deadline
+#define PACING_MAX_LAG 0.1 // re-anchor instead of racing to catch up when this far behind
+#define MIN_SPEED 0.125
+#define MAX_SPEED 8.0
+
+typedef struct Pacer {
+    Uint64 frequency; // counter ticks per second
+    Uint64 anchor; // counter value at anchor_cycles
+    uint64_t anchor_cycles;
+    double speed;
+    Uint64 last_frame; // counter value at the end of the previous frame
+    uint64_t last_cycles; // cycle count at the end of the previous frame
+    uint64_t resyncs; // times the pacer fell behind and re-anchored
+} Pacer;
+
+/**
+ * @brief changes the speed multiplier from the end of the previous frame on
+ *
+ * @param pacer the Pacer object
+ * @param speed the new speed multiplier, clamped to MIN_SPEED..MAX_SPEED
+ */
+void pacer_set_speed(Pacer *pacer, double speed) {
+    if (speed < MIN_SPEED)
+        speed = MIN_SPEED;
+    if (speed > MAX_SPEED)
+        speed = MAX_SPEED;
+    pacer->anchor = pacer->last_frame;
+    pacer->anchor_cycles = pacer->last_cycles;
+    pacer->speed = speed;
+}
+
+/**
+ * @brief starts pacing from the given cycle count
+ *
+ * @param pacer the Pacer object
+ * @param cycles the current cycle count
+ * @param speed the emulation speed multiplier
+ */
+void pacer_init(Pacer *pacer, uint64_t cycles, double speed) {
+    pacer->frequency = SDL_GetPerformanceFrequency();
+    pacer->resyncs = 0;
+    pacer->last_frame = SDL_GetPerformanceCounter();
+    pacer->last_cycles = cycles;
+    pacer_set_speed(pacer, speed);
+}
+
+/**
+ * @brief waits until the given cycle count is due in wall-clock time
+ *
+ * @param pacer the Pacer object
+ * @param cycles the cycle count reached by the emulation
+ * @return double seconds since the previous call, for frame time statistics
+ */
+double pacer_wait(Pacer *pacer, uint64_t cycles) {
+    double due_seconds = (cycles - pacer->anchor_cycles) / (CPU_HZ * pacer->speed);
+    Uint64 due = pacer->anchor + (Uint64) (due_seconds * pacer->frequency);
+    Uint64 now = SDL_GetPerformanceCounter();
+
+    if (now > due && (double) (now - due) / pacer->frequency > PACING_MAX_LAG) {
+        // too far behind (window dragged, debugger, slow host): start over from now
+        pacer->anchor = now;
+        pacer->anchor_cycles = cycles;
+        pacer->resyncs++;
+        due = now;
+    }
+
+    while (now < due) {
+        double remaining = (double) (due - now) / pacer->frequency;
+        if (remaining > PACING_SPIN_SECONDS)
+            SDL_Delay((Uint32) ((remaining - PACING_SPIN_SECONDS) * 1000));
+        now = SDL_GetPerformanceCounter();
+    }
+
+    double interval = (double) (now - pacer->last_frame) / pacer->frequency;
+    pacer->last_frame = now;
+    pacer->last_cycles = cycles;
+    return interval;
+}
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*  Rewind buffer.
+    Every frame the machine is captured as a save state image. Only the
+    newest image is kept whole; each older frame is stored as the XOR of
+    itself with the frame after it, run-length encoded, so a frame where
+    little RAM changed costs a few hundred bytes. Stepping back XORs the
+    newest delta into the current image, which yields the previous frame.
+
+    Deltas live in a circular byte arena. When the arena or the frame
+    limit is full, the oldest frames are dropped.
+
+    Delta encoding: a sequence of chunks
+        zero run (u16)  number of unchanged bytes to skip
+        literals (u16)  number of XOR bytes that follow
+        XOR bytes
+    A literal run ends at two unchanged bytes in a row.
+*/
+
+#define REWIND_ARENA_SIZE (4 << 20) // bytes of deltas kept
+#define REWIND_MAX_IMAGE SAVESTATE_MAX_SIZE
+#define REWIND_MAX_DELTA (REWIND_MAX_IMAGE * 2 + 8)
+
+typedef struct RewindEntry {
+    uint32_t offset; // in the arena
+    uint32_t length;
+} RewindEntry;
+
+typedef struct Rewind {
+    uint8_t *arena;
+    size_t capacity;
+    size_t write; // arena offset of the next delta
+    size_t used; // arena bytes held by entries
+    RewindEntry *entries; // ring of deltas, oldest at first
+    uint32_t max_frames;
+    uint32_t first;
+    uint32_t count;
+    uint8_t current[REWIND_MAX_IMAGE]; // the newest frame
+    size_t image_size; // 0 until the first capture
+    uint8_t scratch[REWIND_MAX_DELTA];
+    uint64_t captures;
+    uint64_t delta_bytes; // over all captures
+    FrameStats capture_stats;
+} Rewind;
+
+/**
+ * @brief allocates a rewind buffer
+ *
+ * @param rewind the Rewind object
+ * @param max_frames the most frames that can be stepped back
+ * @param capacity arena size in bytes
+ */
+void rewind_init(Rewind *rewind, uint32_t max_frames, size_t capacity) {
+    memset(rewind, 0, sizeof(Rewind));
+    rewind->arena = malloc(capacity);
+    rewind->capacity = capacity;
+    rewind->entries = malloc(max_frames * sizeof(RewindEntry));
+    rewind->max_frames = max_frames;
+    rewind->capture_stats.name = "rewind capture";
+}
+
+/**
+ * @brief run-length encodes a XOR b into out
+ *
+ * @return size_t encoded size, at most REWIND_MAX_DELTA for REWIND_MAX_IMAGE bytes
+ */
+size_t rewind_encode(const uint8_t *a, const uint8_t *b, size_t size, uint8_t *out) {
+    uint8_t *p = out;
+    size_t i = 0;
+    while (i < size) {
+        size_t zeros = 0;
+        while (i < size && a[i] == b[i] && zeros < 0xffff)
+            i++, zeros++;
+        uint8_t *header = p;
+        p += 4;
+        size_t literals = 0;
+        while (i < size && literals < 0xffff) {
+            if (a[i] == b[i] && (i + 1 == size || a[i + 1] == b[i + 1]))
+                break;
+            *p++ = a[i] ^ b[i];
+            i++, literals++;
+        }
+        put_u16(header, zeros);
+        put_u16(header + 2, literals);
+    }
+    return p - out;
+}
+
+/**
+ * @brief XORs an encoded delta into image
+ */
+void rewind_apply(uint8_t *image, const uint8_t *delta, size_t length) {
+    const uint8_t *end = delta + length;
+    uint8_t *dst = image;
+    while (delta < end) {
+        dst += get_u16(delta);
+        uint16_t literals = get_u16(delta + 2);
+        delta += 4;
+        for (uint16_t k = 0; k < literals; k++)
+            *dst++ ^= *delta++;
+    }
+}
+
+static void rewind_drop_oldest(Rewind *rewind) {
+    rewind->used -= rewind->entries[rewind->first].length;
+    rewind->first = (rewind->first + 1) % rewind->max_frames;
+    rewind->count--;
+}
+
+/**
+ * @brief records a frame
+ *
+ * @param rewind the Rewind object
+ * @param image the frame's save state image
+ * @param size size of the image; must be the same for every frame
+ */
+void rewind_push(Rewind *rewind, const uint8_t *image, size_t size) {
+    if (rewind->image_size == 0) {
+        memcpy(rewind->current, image, size);
+        rewind->image_size = size;
+        return;
+    }
+
+    // the delta takes the current frame back from the new one
+    size_t length = rewind_encode(image, rewind->current, size, rewind->scratch);
+    memcpy(rewind->current, image, size);
+    rewind->captures++;
+    rewind->delta_bytes += length;
+
+    while (rewind->count > 0 && (rewind->count == rewind->max_frames || rewind->used + length > rewind->capacity))
+        rewind_drop_oldest(rewind);
+
+    size_t head = rewind->capacity - rewind->write;
+    if (length <= head)
+        memcpy(rewind->arena + rewind->write, rewind->scratch, length);
+    else {
+        memcpy(rewind->arena + rewind->write, rewind->scratch, head);
+        memcpy(rewind->arena, rewind->scratch + head, length - head);
+    }
+
+    RewindEntry *entry = &rewind->entries[(rewind->first + rewind->count) % rewind->max_frames];
+    entry->offset = rewind->write;
+    entry->length = length;
+    rewind->count++;
+    rewind->used += length;
+    rewind->write = (rewind->write + length) % rewind->capacity;
+}
+
+/**
+ * @brief steps back one frame
+ *
+ * @param rewind the Rewind object
+ * @return const uint8_t* the previous frame's image, NULL if there is none
+ */
+const uint8_t *rewind_pop(Rewind *rewind) {
+    if (rewind->count == 0)
+        return NULL;
+
+    RewindEntry *entry = &rewind->entries[(rewind->first + rewind->count - 1) % rewind->max_frames];
+    size_t head = rewind->capacity - entry->offset;
+    if (entry->length <= head)
+        memcpy(rewind->scratch, rewind->arena + entry->offset, entry->length);
+    else {
+        memcpy(rewind->scratch, rewind->arena + entry->offset, head);
+        memcpy(rewind->scratch + head, rewind->arena, entry->length - head);
+    }
+    rewind_apply(rewind->current, rewind->scratch, entry->length);
+
+    rewind->count--;
+    rewind->used -= entry->length;
+    rewind->write = entry->offset;
+    return rewind->current;
+}
+
+/**
+ * @brief prints how much history is held, what it costs in memory and how
+ * long capturing a frame takes
+ *
+ * @param rewind the Rewind object
+ */
+void rewind_print_stats(Rewind *rewind) {
+    if (rewind->captures == 0)
+        return;
+    size_t footprint = rewind->capacity + rewind->max_frames * sizeof(RewindEntry) + sizeof(Rewind);
+    printf("rewind: %u frames (%.1f s) held in %.1f KB, %.0f bytes/frame avg, %.1f KB allocated\n",
+        rewind->count, rewind->count / 60.0, rewind->used / 1024.0,
+        (double) rewind->delta_bytes / rewind->captures, footprint / 1024.0);
+    stats_print(&rewind->capture_stats);
+}
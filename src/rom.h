@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*  ROM loading.
+    The 8 KB program can come as one concatenated image (invaders.rom) or
+    as the standard split set of four 2 KB chips, invaders.h/g/f/e at
+    0x0000/0x0800/0x1000/0x1800. Either way it is loaded once into a
+    SharedRom: a single image is mapped straight from its file, a split set
+    is assembled into an unlinked temporary file that is mapped instead, so
+    instances can map it page by page (see memmap.h).
+
+    Sizes are always checked. CRC32s are checked against the known sets
+    unless the caller asks to load an unknown ROM anyway.
+*/
+
+#define ROM_SIZE 0x2000
+#define ROM_PARTS 4
+
+typedef struct RomPart {
+    const char *file;
+    uint16_t offset;
+    uint16_t size;
+    uint32_t crc;
+} RomPart;
+
+typedef struct RomSet {
+    const char *name;
+    uint32_t crc; // of the concatenated image
+    RomPart parts[ROM_PARTS];
+} RomSet;
+
+static const RomSet ROM_SETS[] = {
+    { "Space Invaders (Midway)", 0xb64ca815, {
+        { "invaders.h", 0x0000, 0x800, 0x734f5ad8 },
+        { "invaders.g", 0x0800, 0x800, 0x6bfaca4a },
+        { "invaders.f", 0x1000, 0x800, 0x0ccead96 },
+        { "invaders.e", 0x1800, 0x800, 0x14e538b0 } } },
+};
+#define ROM_SET_COUNT (sizeof(ROM_SETS) / sizeof(ROM_SETS[0]))
+
+typedef struct SharedRom {
+    int fd; // the ROM image, mapped into every instance
+    const uint8_t *data; // the whole ROM, mapped read-only
+    size_t size;
+    FILE *assembled; // temporary file holding a split set, NULL otherwise
+    const RomSet *set; // the known set it matched, NULL if unchecked
+} SharedRom;
+
+/**
+ * @brief computes the CRC32 (IEEE 802.3, as used by zip and MAME) of a buffer
+ */
+uint32_t crc32(const uint8_t *data, size_t size) {
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+    }
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffff;
+}
+
+/**
+ * @brief maps a whole file read-only after checking its size
+ *
+ * @param path the file
+ * @param size the size the file must have
+ * @param fd set to the open file
+ * @return const uint8_t* the mapping, NULL after printing an error
+ */
+static const uint8_t *rom_map_file(const char *path, size_t size, int *fd) {
+    *fd = open(path, O_RDONLY);
+    if (*fd < 0) {
+        fprintf(stderr, "error: could not open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(*fd, &st) != 0) {
+        fprintf(stderr, "error: could not stat %s: %s\n", path, strerror(errno));
+        close(*fd);
+        *fd = -1;
+        return NULL;
+    }
+    if ((size_t) st.st_size != size) {
+        fprintf(stderr, "error: %s is %lld bytes, expected %zu\n", path, (long long) st.st_size, size);
+        close(*fd);
+        *fd = -1;
+        return NULL;
+    }
+    void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, *fd, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "error: could not map %s: %s\n", path, strerror(errno));
+        close(*fd);
+        *fd = -1;
+        return NULL;
+    }
+    return data;
+}
+
+static bool file_exists(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static char *join_path(const char *dir, const char *file) {
+    char *path = malloc(strlen(dir) + strlen(file) + 2);
+    sprintf(path, "%s%s%s", dir, dir[0] && dir[strlen(dir) - 1] != '/' ? "/" : "", file);
+    return path;
+}
+
+/**
+ * @brief identifies a concatenated image, naming the chip that differs if
+ * it is close to a known set
+ *
+ * @return const RomSet* the matching set, NULL after printing an error
+ */
+static const RomSet *rom_identify(const char *path, const uint8_t *data) {
+    uint32_t crc = crc32(data, ROM_SIZE);
+    for (size_t s = 0; s < ROM_SET_COUNT; s++)
+        if (ROM_SETS[s].crc == crc)
+            return &ROM_SETS[s];
+
+    fprintf(stderr, "error: %s has CRC32 %08x, which is not a known ROM set\n", path, crc);
+    for (size_t s = 0; s < ROM_SET_COUNT; s++) {
+        const RomPart *parts = ROM_SETS[s].parts;
+        int matching = 0;
+        for (int p = 0; p < ROM_PARTS; p++)
+            matching += crc32(data + parts[p].offset, parts[p].size) == parts[p].crc;
+        if (matching == 0)
+            continue;
+        for (int p = 0; p < ROM_PARTS; p++) {
+            uint32_t part_crc = crc32(data + parts[p].offset, parts[p].size);
+            if (part_crc != parts[p].crc)
+                fprintf(stderr, "       %04x-%04x (%s) has CRC32 %08x, %s expects %08x\n",
+                    parts[p].offset, parts[p].offset + parts[p].size - 1, parts[p].file,
+                    part_crc, ROM_SETS[s].name, parts[p].crc);
+        }
+    }
+    fprintf(stderr, "       use --no-rom-check to load it anyway\n");
+    return NULL;
+}
+
+/**
+ * @brief loads a concatenated image
+ */
+static bool rom_load_image(SharedRom *rom, const char *path, bool check) {
+    rom->data = rom_map_file(path, ROM_SIZE, &rom->fd);
+    if (rom->data == NULL)
+        return false;
+    rom->size = ROM_SIZE;
+    if (check && (rom->set = rom_identify(path, rom->data)) == NULL) {
+        munmap((void *) rom->data, ROM_SIZE);
+        close(rom->fd);
+        rom->data = NULL;
+        rom->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief loads a split set from a directory into a temporary image
+ */
+static bool rom_load_split(SharedRom *rom, const char *dir, const RomSet *set, bool check) {
+    uint8_t image[ROM_SIZE] = {0};
+    for (int p = 0; p < ROM_PARTS; p++) {
+        const RomPart *part = &set->parts[p];
+        char *path = join_path(dir, part->file);
+        int fd;
+        const uint8_t *data = rom_map_file(path, part->size, &fd);
+        if (data == NULL) {
+            free(path);
+            return false;
+        }
+        uint32_t crc = crc32(data, part->size);
+        if (check && crc != part->crc) {
+            fprintf(stderr, "error: %s has CRC32 %08x, %s expects %08x\n"
+                "       use --no-rom-check to load it anyway\n", path, crc, set->name, part->crc);
+            munmap((void *) data, part->size);
+            close(fd);
+            free(path);
+            return false;
+        }
+        memcpy(image + part->offset, data, part->size);
+        munmap((void *) data, part->size);
+        close(fd);
+        free(path);
+    }
+
+    rom->assembled = tmpfile();
+    if (rom->assembled == NULL || fwrite(image, ROM_SIZE, 1, rom->assembled) != 1 || fflush(rom->assembled) != 0) {
+        fprintf(stderr, "error: could not create the assembled ROM image: %s\n", strerror(errno));
+        if (rom->assembled)
+            fclose(rom->assembled);
+        rom->assembled = NULL;
+        return false;
+    }
+    rom->fd = fileno(rom->assembled);
+    rom->size = ROM_SIZE;
+    rom->data = mmap(NULL, ROM_SIZE, PROT_READ, MAP_SHARED, rom->fd, 0);
+    if (rom->data == MAP_FAILED) {
+        fprintf(stderr, "error: could not map the assembled ROM image: %s\n", strerror(errno));
+        fclose(rom->assembled);
+        rom->assembled = NULL;
+        rom->data = NULL;
+        rom->fd = -1;
+        rom->size = 0;
+        return false;
+    }
+    rom->set = check ? set : NULL;
+    return true;
+}
+
+/**
+ * @brief loads the ROM from a file, or from a directory holding either
+ * invaders.rom or a split set
+ *
+ * @param rom the SharedRom object
+ * @param path a ROM image or a directory
+ * @param check whether CRC32s must match a known set
+ * @return true
+ * @return false after printing what is missing or wrong
+ */
+bool rom_load(SharedRom *rom, const char *path, bool check) {
+    memset(rom, 0, sizeof(SharedRom));
+    rom->fd = -1;
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "error: ROM not found: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode))
+        return rom_load_image(rom, path, check);
+
+    char *image = join_path(path, "invaders.rom");
+    if (file_exists(image)) {
+        bool loaded = rom_load_image(rom, image, check);
+        free(image);
+        return loaded;
+    }
+    free(image);
+
+    for (size_t s = 0; s < ROM_SET_COUNT; s++) {
+        const RomSet *set = &ROM_SETS[s];
+        int found = 0;
+        for (int p = 0; p < ROM_PARTS; p++) {
+            char *part = join_path(path, set->parts[p].file);
+            found += file_exists(part);
+            free(part);
+        }
+        if (found == ROM_PARTS)
+            return rom_load_split(rom, path, set, check);
+        if (found > 0) {
+            fprintf(stderr, "error: the %s split set in %s is incomplete, missing:", set->name, path);
+            for (int p = 0; p < ROM_PARTS; p++) {
+                char *part = join_path(path, set->parts[p].file);
+                if (!file_exists(part))
+                    fprintf(stderr, " %s", set->parts[p].file);
+                free(part);
+            }
+            fprintf(stderr, "\n");
+            return false;
+        }
+    }
+    fprintf(stderr, "error: no ROM in %s: expected invaders.rom or invaders.h, .g, .f and .e\n", path[0] ? path : ".");
+    return false;
+}
+
+/**
+ * @brief unmaps the ROM; safe after a failed rom_load
+ */
+void rom_close(SharedRom *rom) {
+    if (rom->data)
+        munmap((void *) rom->data, rom->size);
+    if (rom->assembled)
+        fclose(rom->assembled);
+    else if (rom->fd >= 0)
+        close(rom->fd);
+    rom->data = NULL;
+    rom->assembled = NULL;
+    rom->fd = -1;
+}
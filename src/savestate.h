@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*  Save states.
+    A save state is a little-endian byte image:
+        header   "SI80", format version (u16), latch count (u8)
+        cpu      a b c d e h l f, sp, pc, int_enable, halted, cycles,
+                 event_count and MAX_EVENTS events (at, period, interrupt)
+        latches  machine specific bytes (shift register, ports, sound)
+        ram      0x2000-0x3FFF; the ROM below it never changes
+    The interrupt phase is kept by the scheduled events, whose `at` is an
+    absolute cycle count, so a loaded state resumes mid-frame exactly.
+    Bump SAVESTATE_VERSION whenever the layout changes.
+*/
+
+#define SAVESTATE_MAGIC "SI80"
+#define SAVESTATE_VERSION 1
+#define SAVESTATE_RAM_START 0x2000
+#define SAVESTATE_RAM_SIZE 0x2000
+#define SAVESTATE_MAX_LATCHES 32
+
+#define SAVESTATE_HEADER_SIZE 7
+#define SAVESTATE_EVENT_SIZE 13
+#define SAVESTATE_CPU_SIZE (8 + 4 + 2 + 8 + 1 + MAX_EVENTS * SAVESTATE_EVENT_SIZE)
+#define SAVESTATE_MAX_SIZE (SAVESTATE_HEADER_SIZE + SAVESTATE_CPU_SIZE + SAVESTATE_MAX_LATCHES + SAVESTATE_RAM_SIZE)
+
+static inline uint8_t *put_u16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static inline uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++)
+        p[i] = v >> (8 * i);
+    return p + 4;
+}
+
+static inline uint8_t *put_u64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++)
+        p[i] = v >> (8 * i);
+    return p + 8;
+}
+
+static inline uint16_t get_u16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get_u32(const uint8_t *p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++)
+        v |= (uint32_t) p[i] << (8 * i);
+    return v;
+}
+
+static inline uint64_t get_u64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++)
+        v |= (uint64_t) p[i] << (8 * i);
+    return v;
+}
+
+/**
+ * @brief returns the size of a save state holding latch_count latches
+ */
+static inline size_t savestate_size(uint8_t latch_count) {
+    return SAVESTATE_HEADER_SIZE + SAVESTATE_CPU_SIZE + latch_count + SAVESTATE_RAM_SIZE;
+}
+
+/**
+ * @brief serializes the CPU, the machine latches and RAM into buf
+ *
+ * @param buf destination, at least savestate_size(latch_count) bytes
+ * @param state the State8080 object
+ * @param latches machine specific bytes
+ * @param latch_count number of latches, at most SAVESTATE_MAX_LATCHES
+ * @return size_t number of bytes written
+ */
+size_t savestate_write(uint8_t *buf, const State8080 *state, const uint8_t *latches, uint8_t latch_count) {
+    uint8_t *p = buf;
+    memcpy(p, SAVESTATE_MAGIC, 4);
+    p = put_u16(p + 4, SAVESTATE_VERSION);
+    *p++ = latch_count;
+
+    *p++ = state->a;
+    *p++ = state->b;
+    *p++ = state->c;
+    *p++ = state->d;
+    *p++ = state->e;
+    *p++ = state->h;
+    *p++ = state->l;
+    *p++ = state->f;
+    p = put_u16(p, state->sp);
+    p = put_u16(p, state->pc);
+    *p++ = state->int_enable;
+    *p++ = state->halted;
+    p = put_u64(p, state->cycles);
+    *p++ = state->event_count;
+    for (int i = 0; i < MAX_EVENTS; i++) {
+        const Event8080 *event = &state->events[i];
+        bool used = i < state->event_count;
+        p = put_u64(p, used ? event->at : 0);
+        p = put_u32(p, used ? event->period : 0);
+        *p++ = used ? event->interrupt : 0;
+    }
+
+    memcpy(p, latches, latch_count);
+    p += latch_count;
+    memcpy(p, state->memory + SAVESTATE_RAM_START, SAVESTATE_RAM_SIZE);
+    p += SAVESTATE_RAM_SIZE;
+    return p - buf;
+}
+
+/**
+ * @brief restores the CPU, the machine latches and RAM from a save state
+ * Nothing is changed if the image is not a valid save state for this build.
+ * Port handlers, memory and the dirty map are kept from the current state.
+ * @param buf the save state
+ * @param size size of buf in bytes
+ * @param state the State8080 object
+ * @param latches machine specific bytes to restore
+ * @param latch_count number of latches the machine expects
+ * @return true
+ * @return false if the image was rejected
+ */
+bool savestate_read(const uint8_t *buf, size_t size, State8080 *state, uint8_t *latches, uint8_t latch_count) {
+    if (size < SAVESTATE_HEADER_SIZE || memcmp(buf, SAVESTATE_MAGIC, 4) != 0) {
+        fprintf(stderr, "not a save state\n");
+        return false;
+    }
+    if (get_u16(buf + 4) != SAVESTATE_VERSION) {
+        fprintf(stderr, "unsupported save state version %u (expected %u)\n", get_u16(buf + 4), SAVESTATE_VERSION);
+        return false;
+    }
+    if (buf[6] != latch_count || size != savestate_size(latch_count)) {
+        fprintf(stderr, "save state is for a different machine\n");
+        return false;
+    }
+
+    const uint8_t *p = buf + SAVESTATE_HEADER_SIZE;
+    uint8_t event_count = p[22];
+    if (event_count > MAX_EVENTS) {
+        fprintf(stderr, "save state is corrupt\n");
+        return false;
+    }
+
+    state->a = *p++;
+    state->b = *p++;
+    state->c = *p++;
+    state->d = *p++;
+    state->e = *p++;
+    state->h = *p++;
+    state->l = *p++;
+    state->f = *p++;
+    state->sp = get_u16(p);
+    state->pc = get_u16(p + 2);
+    p += 4;
+    state->int_enable = *p++;
+    state->halted = *p++;
+    state->cycles = get_u64(p);
+    p += 8;
+    state->event_count = *p++;
+    for (int i = 0; i < MAX_EVENTS; i++) {
+        Event8080 *event = &state->events[i];
+        event->at = get_u64(p);
+        event->period = get_u32(p + 8);
+        event->interrupt = p[12];
+        p += SAVESTATE_EVENT_SIZE;
+    }
+
+    memcpy(latches, p, latch_count);
+    p += latch_count;
+    memcpy(state->memory + SAVESTATE_RAM_START, p, SAVESTATE_RAM_SIZE);
+    return true;
+}
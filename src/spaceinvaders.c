@@ -1,50 +1,279 @@
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#ifndef NO_SDL
 #include <SDL2/SDL.h>
+#endif
 #include "8080.h"
+#include "video.h"
+#include "stats.h"
+#include "audio.h"
+#include "savestate.h"
+#include "rewind.h"
+#include "movie.h"
+#include "rom.h"
+#include "memmap.h"
+#include "debugger.h"
+#include "machine.h"
+#include "latency.h"
+#include "batch.h"
+#include "env.h"
+#include "capture.h"
+#ifndef NO_SDL
+#include "pacing.h"
+#include "input.h"
+#endif
 
 #define DISPLAY_SCALE 2
-#define WIDTH 224
-#define HEIGHT 256
+#define WIDTH SCREEN_WIDTH
+#define HEIGHT SCREEN_HEIGHT
 
 int game_running = false;
+bool headless = false; // run without window/audio, as fast as possible
+long headless_frames = 0; // number of frames to emulate in headless mode
+long cross_check_steps = 0; // instructions to run both CPU cores in lockstep
+uint32_t trace_dump_count = 64; // instructions dumped from the trace ring on a crash
+int batch_size = 0; // instances run by --batch
+int batch_threads = 0; // most threads tried by --batch, 0 for one per core
+int env_count = 0; // environments stepped by --env
+int density_count = 0; // instances created by --density
+const char *rom_override = NULL; // --rom, a ROM image or a directory
+bool rom_check = true; // require a known ROM set
+Debugger debugger; // attached to the main machine, idle until armed
+#define DENSITY_FRAMES 120 // frames each --density instance runs before it is measured
+#define ENV_FRAME_SKIP 4 // frames per --env step
+#define ENV_FACTOR 2 // --env observation downsample factor
 
+typedef enum VideoBackend {
+    VIDEO_SURFACE, // scaled by the CPU into the window surface
+    VIDEO_TEXTURE // native size streaming texture, scaled by SDL_RenderCopy
+} VideoBackend;
+
+VideoBackend video_backend = VIDEO_SURFACE;
+FrameStats present_stats = { "present (surface)" };
+FrameStats frame_stats = { "frame interval" };
+double emulation_speed = 1.0; // > 1 turbo, < 1 slow motion
+
+#ifndef NO_SDL
 SDL_Window *window = NULL;
 SDL_Surface *surface = NULL;
+SDL_Renderer *renderer = NULL;
+SDL_Texture *texture = NULL;
+Pacer pacer;
+Input input; // key and controller bindings
+#endif
 
-uint8_t shift0 = 0;
-uint8_t shift1 = 0;
-uint8_t shift_offset = 0;
+Machine machine; // the machine shown in the window
+Latency latency; // input-to-photon probes on machine
+bool latency_probes = false; // --latency, always on with a window
+Video video;
 
-uint8_t in_port_1 = 0;
-uint8_t in_port_2 = 0;
-uint8_t in_port_3 = 0;
+uint8_t savestate[SAVESTATE_MAX_SIZE]; // quick save slot
+size_t savestate_length = 0; // 0 while the slot is empty
+const char *savestate_file = "invaders.sav"; // written by quick save, read if the slot is empty
+const char *load_state_path = NULL; // --load-state
+const char *save_state_path = NULL; // --save-state
 
-uint8_t out_port_2 = 0;
-uint8_t out_port_4= 0;
+int rewind_seconds = -1; // history kept for rewinding, -1: 10 s with a window, off headless
+bool rewind_enabled = false;
+bool rewinding = false; // rewind key held
+Rewind history;
+uint8_t rewind_image[SAVESTATE_MAX_SIZE];
 
-uint8_t sound1_ = 0;
-uint8_t sound2_ = 0;
-uint8_t last_sound1_ = 0;
-uint8_t last_sound2_ = 0;
+const char *record_path = NULL; // --record, written on exit
+const char *replay_path = NULL; // --replay
+Movie record_movie;
+Movie replay_movie;
+bool replaying = false; // replay_path is set and the movie has not ended
 
-State8080 *state = NULL;
-State8080 *savestate = NULL;
+Mixer mixer; // fed by the sound ports, rendered by the audio device
+char *capture_video_path = NULL; // Y4M file or PNG pattern to capture frames to
+char *capture_audio_path = NULL; // WAV file to capture the mixed audio to
+bool capture_lossless = false; // wait for the capture writer instead of dropping frames
+bool capturing = false;
+Capture capture;
 
-uint8_t next_interrupt = 1;
-uint8_t save_next_interrupt = 1;
+#ifndef NO_SDL
+#define AUDIO_BUFFER 512 // samples per callback, about 12 ms
+SDL_AudioDeviceID audio_device = 0;
+#endif
 
-SDL_AudioSpec wavSpec;
-uint8_t* wavBuffers[18];
-uint32_t wavLengths[18];
+/**************************** SAVE STATE FUNCTIONS ****************************/
 
+/**
+ * @brief restores the machine from a save state image
+ * The whole screen is converted again on the next video update.
+ * @param buf the save state
+ * @param size size of the image
+ * @return true 
+ * @return false if the image was rejected, the machine is unchanged
+ */
+bool load_machine(const uint8_t *buf, size_t size) {
+    if (!machine_load(&machine, buf, size))
+        return false;
+    video.stale = true;
+    latency_cancel(&latency);
+    return true;
+}
 
-SDL_AudioDeviceID deviceId = NULL;
+/**
+ * @brief writes a save state image to a file
+ * 
+ * @return true 
+ * @return false 
+ */
+bool write_state_file(const char *path, const uint8_t *buf, size_t size) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL || fwrite(buf, size, 1, f) != 1) {
+        fprintf(stderr, "error: could not write save state %s\n", path);
+        if (f)
+            fclose(f);
+        return false;
+    }
+    fclose(f);
+    return true;
+}
 
+/**
+ * @brief reads a save state image from a file into buf
+ * 
+ * @return size_t size of the image, 0 on error
+ */
+size_t read_state_file(const char *path, uint8_t *buf, size_t capacity) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "error: could not open save state %s\n", path);
+        return 0;
+    }
+    size_t size = fread(buf, 1, capacity, f);
+    fclose(f);
+    return size;
+}
+
+/**
+ * @brief records the machine at the end of a frame in the rewind history
+ * 
+ */
+void record_rewind_frame() {
+    double start = now_seconds();
+    size_t size = machine_save(&machine, rewind_image);
+    rewind_push(&history, rewind_image, size);
+    stats_add(&history.capture_stats, now_seconds() - start);
+}
+
+/**
+ * @brief steps the machine back one frame in the rewind history
+ * The live inputs are kept so a key released while rewinding does not
+ * stay pressed.
+ * @return true 
+ * @return false if the history is used up
+ */
+bool step_back() {
+    const uint8_t *image = rewind_pop(&history);
+    if (image == NULL)
+        return false;
+    uint8_t port_1 = machine.in_port_1, port_2 = machine.in_port_2;
+    load_machine(image, history.image_size);
+    machine.in_port_1 = port_1;
+    machine.in_port_2 = port_2;
+    return true;
+}
+
+/**
+ * @brief saves the machine into the quick save slot and to savestate_file
+ * 
+ */
+void quick_save() {
+    double start = now_seconds();
+    savestate_length = machine_save(&machine, savestate);
+    double elapsed = now_seconds() - start;
+    write_state_file(savestate_file, savestate, savestate_length);
+    printf("state saved: %zu bytes in %.1f us\n", savestate_length, elapsed * 1e6);
+}
+
+/**
+ * @brief restores the machine from the quick save slot, or from 
+ * savestate_file if nothing was saved this session
+ * 
+ * @return true if a state was loaded
+ * @return false 
+ */
+bool quick_load() {
+    if (savestate_length == 0)
+        savestate_length = read_state_file(savestate_file, savestate, sizeof(savestate));
+    if (savestate_length == 0)
+        return false;
+    double start = now_seconds();
+    bool loaded = load_machine(savestate, savestate_length);
+    double elapsed = now_seconds() - start;
+    if (loaded)
+        printf("state loaded: %zu bytes in %.1f us\n", savestate_length, elapsed * 1e6);
+    else
+        savestate_length = 0;
+    return loaded;
+}
+
+/**
+ * @brief sets up the mixer and loads the sound effects from audio/ next to 
+ * the executable, or in the working directory without SDL
+ */
+void load_sounds() {
+    mixer_init(&mixer);
+#ifndef NO_SDL
+    char *base = SDL_GetBasePath();
+#else
+    char *base = NULL;
+#endif
+    for (int i = 0; i < AUDIO_SOUNDS; i++) {
+        char filename[32];
+        sprintf(filename, "audio/%d.wav", i);
+        char *path = join_path(base ? base : "", filename);
+        audio_load_wav(&mixer.samples[i], path);
+        free(path);
+    }
+#ifndef NO_SDL
+    SDL_free(base);
+#endif
+}
+
+#ifndef NO_SDL
 /**************************** SDL FUNCTIONS ****************************/
 
 /**
- * @brief initialize video and audio and load audio files
+ * @brief hands the mixed audio to the device, on SDL's audio thread
+ */
+static void audio_callback(void *context, Uint8 *stream, int length) {
+    mixer_pull(context, (int16_t *) stream, length / sizeof(int16_t));
+}
+
+/**
+ * @brief loads the sound effects and opens the audio device
+ * The device is opened in the mixer format; SDL converts if the hardware 
+ * wants something else. Without a device the game runs silent.
+ */
+void init_audio() {
+    load_sounds();
+    SDL_AudioSpec want = {0}, have;
+    want.freq = AUDIO_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = AUDIO_BUFFER;
+    want.callback = audio_callback;
+    want.userdata = &mixer;
+    audio_device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+    if (audio_device == 0) {
+        fprintf(stderr, "Failed to open audio: %s\n", SDL_GetError());
+        return;
+    }
+    mixer.output_delay = (double) have.samples / have.freq;
+    mixer.streaming = true;
+    SDL_PauseAudioDevice(audio_device, 0);
+}
+
+/**
+ * @brief initialize video and audio
  * 
  * @return true 
  * @return false 
@@ -66,50 +295,33 @@ bool init_SDL()
         return false;
     }
 
-    deviceId = SDL_OpenAudioDevice(NULL, 0, &wavSpec, NULL, 0);
+    // connected controllers arrive as SDL_CONTROLLERDEVICEADDED events
+    if (SDL_Init(SDL_INIT_GAMECONTROLLER) < 0)
+        fprintf(stderr, "No controller support: %s\n", SDL_GetError());
 
-    for (int i = 0; i < 19; ++i) {
-        char *filename = SDL_GetBasePath();
-        sprintf(filename, "audio/%d.wav", i);
-        if (SDL_LoadWAV(filename, &wavSpec, &wavBuffers[i], &wavLengths[i]) == NULL) {
-            fprintf(stderr, "ERROR: %s\n", SDL_GetError());
-            
-            continue;
-        }
-    }
-    
+    init_audio();
     return true;
 }
 
 /**
- * @brief play the specified wav file
- * 
- * @param index 
- */
-void play_wav_file(int index) {
-    
-    
-    if (deviceId == 0) {
-        fprintf(stderr, "Failed to open audio: %s\n", SDL_GetError());
-        exit(0);
-        // Handle error as needed
-        return;
-    }
-
-    SDL_QueueAudio(deviceId, wavBuffers[index], wavLengths[index]);
-    SDL_PauseAudioDevice(deviceId, 0);
-
-    return;
-}
-
-/**
- * @brief free wav file memory
+ * @brief prints the session statistics and shuts down SDL
  * 
  */
 void cleanup() {
-    for (int i = 0; i < 18; ++i) {
-        SDL_FreeWAV(wavBuffers[i]);
-    }
+    video_print_stats(&video);
+    stats_print(&present_stats);
+    stats_print(&frame_stats);
+    rewind_print_stats(&history);
+    printf("pacing: target %.3f ms at %.3gx speed, %llu resyncs\n",
+        1e3 / 60 / pacer.speed, pacer.speed, (unsigned long long) pacer.resyncs);
+    mixer_print_stats(&mixer);
+    input_print_stats(&input);
+    latency_print_stats(&latency);
+    latency_free(&latency);
+    input_free(&input);
+    if (audio_device)
+        SDL_CloseAudioDevice(audio_device);
+    mixer_free(&mixer);
     SDL_Quit();
 }
 
@@ -141,6 +353,31 @@ SDL_Window *create_window()
     return new_window;
 }
 
+/**
+ * @brief creates the renderer and the native size streaming texture for the 
+ * texture video backend
+ * 
+ * @return true 
+ * @return false 
+ */
+bool create_texture_backend() {
+    renderer = SDL_CreateRenderer(window, -1, 0);
+    if (!renderer)
+    {
+        fprintf(stderr, "Could not create SDL renderer: %s\n", SDL_GetError());
+        return false;
+    }
+
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
+    if (!texture)
+    {
+        fprintf(stderr, "Could not create SDL texture: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
 /**
  * @brief set the pixel object
  * 
@@ -155,292 +392,812 @@ void set_pixel(int x, int y, uint32_t pix)
 }
 
 /**
- * @brief process input and send IN instructions to the emulator
+ * @brief handles a key of the front end: quitting, speed, save states, 
+ * rewinding and the debugger
+ */
+void hotkey(const SDL_KeyboardEvent *key) {
+    if (key->type == SDL_KEYUP) {
+        if (key->keysym.sym == SDLK_r)
+            rewinding = false;
+        return;
+    }
+    switch (key->keysym.sym) {
+    case SDLK_ESCAPE:
+        game_running = false;
+        break;
+    case SDLK_EQUALS: // faster
+        pacer_set_speed(&pacer, pacer.speed * 2);
+        printf("speed: %.3gx\n", pacer.speed);
+        break;
+    case SDLK_MINUS: // slower
+        pacer_set_speed(&pacer, pacer.speed / 2);
+        printf("speed: %.3gx\n", pacer.speed);
+        break;
+    case SDLK_BACKSPACE: // normal speed
+        pacer_set_speed(&pacer, 1.0);
+        printf("speed: %.3gx\n", pacer.speed);
+        break;
+    case SDLK_F5: // quick save
+        if (!key->repeat)
+            quick_save();
+        break;
+    case SDLK_F9: // quick load
+        if (key->repeat)
+            break;
+        if (record_path)
+            printf("loading states is disabled while recording a movie\n");
+        else if (replaying)
+            printf("loading states is disabled while replaying a movie\n");
+        else
+            quick_load();
+        break;
+    case SDLK_r: // rewind while held
+        if (key->repeat)
+            break;
+        if (replaying)
+            printf("rewinding is disabled while replaying a movie\n");
+        else
+            rewinding = rewind_enabled;
+        break;
+    case SDLK_F2: // break into the console debugger
+        debugger.pause = true;
+        break;
+    }
+}
+
+/**
+ * @brief drains every pending event and sets the input ports for the next 
+ * frame; called at the frame boundary, right before the frame is emulated
  * 
- * @param state the State8080 object
+ * @param machine the Machine object
  */
-void process_input(State8080 *state) {
+void process_input(Machine *machine) {
     SDL_Event event;
-    SDL_PollEvent(&event);
+    while (SDL_PollEvent(&event)) {
+        if (input_event(&input, &event))
+            continue;
+        if (event.type == SDL_QUIT)
+            game_running = false;
+        else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
+            hotkey(&event.key);
+    }
+    input_sample(&input, &machine->in_port_1, &machine->in_port_2);
+}
 
-    if(event.type == SDL_QUIT){
-        game_running = false;
-        
+/**
+ * @brief presents the framebuffer through the streaming texture
+ * The native 224x256 image is uploaded once and SDL_RenderCopy scales it to 
+ * the window.
+ */
+void present_texture() {
+    SDL_UpdateTexture(texture, NULL, video.framebuffer, WIDTH * sizeof(uint32_t));
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+/**
+ * @brief presents the game video straight from VRAM into the window surface
+ * Only the blocks converted by the last video_update are redrawn, unless the 
+ * window surface is new.
+ * @param state the State8080 object
+ */
+void present_surface(State8080 *state) {
+    SDL_Surface *current = SDL_GetWindowSurface(window);
+    bool full = current != surface;
+    surface = current;
+
+    const uint8_t *vram = state->memory + VRAM_START;
+    uint32_t *pixels = (uint32_t *)surface->pixels;
+    int pitch = surface->pitch / sizeof(uint32_t);
+
+    if (full)
+        video_convert_frame(video_kernel, vram, pixels, pitch, DISPLAY_SCALE);
+    else {
+        for (uint32_t n = 0; n < video.changed_count; n++) {
+            uint16_t block = video.changed[n];
+            video_kernel(vram, block % BLOCK_COLUMNS, block / BLOCK_COLUMNS, pixels, pitch, DISPLAY_SCALE);
+        }
+    }
+
+    SDL_UpdateWindowSurface(window);
+}
+
+/**
+ * @brief renders the game video with the selected backend
+ * 
+ * @param state the State8080 object
+ */
+void render(State8080 *state) {
+    double start = now_seconds();
+    if (video_backend == VIDEO_TEXTURE)
+        present_texture();
+    else
+        present_surface(state);
+    double end = now_seconds();
+    stats_add(&present_stats, end - start);
+    latency_present(&latency, end);
+}
+
+#endif
+
+/**
+ * @brief returns where to look for the ROM: --rom, or the directory of the 
+ * executable
+ * 
+ * @return char* 
+ */
+char *rom_path() {
+    if (rom_override)
+        return strdup(rom_override);
+#ifndef NO_SDL
+    char *base = SDL_GetBasePath();
+    char *path = strdup(base);
+    SDL_free(base);
+    return path;
+#else
+    return strdup(".");
+#endif
+}
+
+/**
+ * @brief prints the emulated clock rate and frame rate of a headless run
+ * 
+ * @param frames number of frames emulated
+ * @param cycles number of 8080 cycles emulated
+ * @param seconds wall-clock time taken
+ */
+void report_benchmark(long frames, uint64_t cycles, double seconds) {
+    printf("core: %s\n", CPU_CORE_NAME);
+    printf("frames: %ld\n", frames);
+    printf("cycles: %llu\n", (unsigned long long) cycles);
+    printf("time: %.3f s\n", seconds);
+    printf("emulated clock: %.2f MHz (%.1fx real 8080)\n", cycles / seconds / 1e6, cycles / seconds / 2e6);
+    printf("frames/sec: %.1f\n", frames / seconds);
+    video_print_stats(&video);
+    rewind_print_stats(&history);
+}
+
+/**
+ * @brief compares the registers of two CPU states
+ * 
+ * @return true if all registers, flags and the cycle count match
+ * @return false 
+ */
+bool same_registers(State8080 *x, State8080 *y) {
+    return x->a == y->a && x->b == y->b && x->c == y->c && x->d == y->d &&
+        x->e == y->e && x->h == y->h && x->l == y->l && x->f == y->f &&
+        x->sp == y->sp && x->pc == y->pc && x->int_enable == y->int_enable && x->halted == y->halted &&
+        x->cycles == y->cycles;
+}
+
+void print_registers(const char *name, State8080 *state) {
+    printf("%-8s AF $%02x%02x BC $%02x%02x DE $%02x%02x HL $%02x%02x SP %04x PC %04x CYC %llu\n",
+        name, state->a, state->f, state->b, state->c, state->d,
+        state->e, state->h, state->l, state->sp, state->pc, (unsigned long long) state->cycles);
+}
+
+void ignore_out(void *context, uint8_t port, uint8_t value) {}
+
+/**
+ * @brief runs the switch and threaded cores side by side, one instruction at a 
+ * time, and stops at the first instruction where they disagree
+ * 
+ * @param steps number of instructions to run
+ * @return int 0 if the cores agreed, 1 otherwise
+ */
+int cross_check_cores(long steps) {
+#ifdef HAVE_THREADED_CORE
+    State8080 *state = machine.cpu;
+    State8080 *shadow = Init8080();
+    uint8_t *shadow_memory = shadow->memory;
+    *shadow = *state;
+    shadow->memory = shadow_memory;
+    memcpy(shadow->memory, state->memory, 0x10000);
+    // ports are machine state, so OUT must only be performed once; the 
+    // dirty map and watchpoints belong to the real machine too
+    shadow->port_out = ignore_out;
+    shadow->dirty_map = NULL;
+    shadow->write_hook = NULL;
+
+    int result = 0;
+
+    for (long i = 0; i < steps; i++) {
+        uint16_t pc = state->pc;
+        if (state->halted && shadow->halted) {
+            // both idle until an interrupt, as emulate8080_run does
+            state->cycles += 4;
+            shadow->cycles += 4;
+        }
+        else {
+            run_until_switch(state, 1);
+            run_until_threaded(shadow, 1);
+        }
+
+        bool memory_checked = (i & 0xfff) == 0 || i == steps - 1;
+        if (!same_registers(state, shadow) ||
+            (memory_checked && memcmp(state->memory, shadow->memory, 0x10000) != 0)) {
+            printf("cores diverged after %ld instructions at pc %04x: ", i + 1, pc);
+            Disassemble8080Op(state->memory, pc);
+            print_registers("switch", state);
+            print_registers("threaded", shadow);
+            result = 1;
+            break;
+        }
+
+        emulate8080_fire_events(state);
+        emulate8080_fire_events(shadow);
     }
+    if (result == 0)
+        printf("cores agree after %ld instructions\n", steps);
+    free(shadow->memory);
+    free(shadow);
+    return result;
+#else
+    printf("the threaded core is not available with this compiler\n");
+    return 1;
+#endif
+}
+
+/**
+ * @brief scripted input for batch instances: every instance inserts a coin 
+ * and starts a game, then moves and fires in its own pseudo-random pattern
+ * 
+ * @param machine the instance
+ * @param instance the instance number
+ * @param frame the frame about to run
+ * @param context unused
+ */
+void batch_input(Machine *machine, int instance, long frame, void *context) {
+    uint32_t x = (uint32_t) instance * 2654435761u ^ (uint32_t) (frame / 16) * 40503u;
+    x ^= x >> 13;
+    x *= 0x5bd1e995;
+    x ^= x >> 15;
 
-    if(event.type == SDL_KEYDOWN) {
-        if(event.key.keysym.sym == SDLK_ESCAPE) {
-            game_running = 0;
-            cleanup();
-            exit(0);
+    uint8_t port_1 = 0;
+    long phase = frame % 1200;
+    if (phase < 4)
+        port_1 = 1; // coin
+    else if (phase >= 60 && phase < 64)
+        port_1 = 1 << 2; // 1P start
+    else if (phase >= 120)
+        port_1 = x & (7 << 4); // fire, left, right
+    machine->in_port_1 = port_1;
+}
+
+/**
+ * @brief runs batch_size independent instances for headless_frames frames 
+ * with 1, 2, 4... up to batch_threads threads and reports aggregate 
+ * frames/sec and scaling
+ * 
+ * @param rom the ROM image
+ * @return int 0 if every thread count left the instances in the same state
+ */
+int run_batch(const SharedRom *rom) {
+    long frames = headless_frames > 0 ? headless_frames : 600;
+    int max_threads = batch_threads > 0 ? batch_threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    Machine *machines = malloc(batch_size * sizeof(Machine));
+    double base_rate = 0;
+    uint64_t reference = 0;
+    int result = 0;
+
+    printf("batch: %d instances x %ld frames, core %s\n", batch_size, frames, CPU_CORE_NAME);
+    for (int threads = 1; ; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        for (int i = 0; i < batch_size; i++)
+            machine_init(&machines[i], rom);
+
+        ThreadPool pool;
+        pool_init(&pool, threads);
+        double start = now_seconds();
+        batch_run(&pool, machines, batch_size, frames, batch_input, NULL);
+        double seconds = now_seconds() - start;
+        pool_free(&pool);
+
+        uint64_t digest = 0;
+        for (int i = 0; i < batch_size; i++) {
+            digest = digest * 31 + machine_hash(&machines[i]);
+            machine_free(&machines[i]);
         }
-        if(event.key.keysym.sym == SDLK_c) { // insert coin
-            in_port_1 |= 1;
+        if (threads == 1)
+            reference = digest;
+        else if (digest != reference) {
+            printf("threads %2d: instance states differ from the single-threaded run\n", threads);
+            result = 1;
         }
-        if(event.key.keysym.sym == SDLK_1) { // P1 Start
-            in_port_1 |= (1 << 2);
+
+        double rate = batch_size * frames / seconds;
+        if (threads == 1)
+            base_rate = rate;
+        printf("threads %2d: %.0f frames/sec, %.1f MHz emulated, %.2fx scaling\n",
+            threads, rate, rate * CYCLES_PER_FRAME / 1e6, rate / base_rate);
+        if (threads >= max_threads)
+            break;
+    }
+    free(machines);
+    return result;
+}
+
+/**
+ * @brief steps env_count environments with random actions through the batched 
+ * step API, resetting finished episodes, and reports the step rate
+ * 
+ * @param rom the ROM image
+ * @return int 
+ */
+int run_env_bench(const SharedRom *rom) {
+    long steps = (headless_frames > 0 ? headless_frames : 3600) / ENV_FRAME_SKIP;
+    int threads = batch_threads > 0 ? batch_threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    size_t obs_size = env_observation_size(ENV_FACTOR);
+
+    static EnvStart start;
+    env_prepare(&start, rom);
+    if (!start.started)
+        printf("env: the ROM never started a game, episodes will not end\n");
+
+    Env *envs = malloc(env_count * sizeof(Env));
+    uint8_t *actions = malloc(env_count);
+    StepResult *results = malloc(env_count * sizeof(StepResult));
+    uint8_t *observations = malloc(env_count * obs_size);
+    for (int i = 0; i < env_count; i++) {
+        env_init(&envs[i], rom, &start);
+        env_reset(&envs[i], observations + i * obs_size, ENV_FACTOR);
+    }
+
+    ThreadPool pool;
+    pool_init(&pool, threads);
+    uint32_t seed = 2463534242u;
+    long episodes = 0;
+    int64_t reward = 0;
+    double start_time = now_seconds();
+    for (long step = 0; step < steps; step++) {
+        for (int i = 0; i < env_count; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            actions[i] = seed % ACTION_COUNT;
         }
-        if(event.key.keysym.sym == SDLK_SPACE){ // P1 Shoot
-            in_port_1 |= (1 << 4);
+        env_step_batch(&pool, envs, env_count, actions, ENV_FRAME_SKIP, results, observations, ENV_FACTOR);
+        for (int i = 0; i < env_count; i++) {
+            reward += results[i].reward;
+            if (results[i].done) {
+                episodes++;
+                env_reset(&envs[i], observations + i * obs_size, ENV_FACTOR);
+            }
         }
-        if(event.key.keysym.sym == SDLK_a){ // P1 left
-            in_port_1 |= (1 << 5);
+    }
+    double seconds = now_seconds() - start_time;
+    pool_free(&pool);
+
+    double step_rate = steps * env_count / seconds;
+    printf("env: %d environments x %ld steps of %d frames, %d threads, %dx%d observations\n",
+        env_count, steps, ENV_FRAME_SKIP, threads, SCREEN_WIDTH / ENV_FACTOR, SCREEN_HEIGHT / ENV_FACTOR);
+    printf("env: %.0f steps/sec, %.0f frames/sec, %.2f us per step\n",
+        step_rate, step_rate * ENV_FRAME_SKIP, 1e6 / step_rate);
+    printf("env: %ld episodes finished, %lld total reward\n", episodes, (long long) reward);
+
+    for (int i = 0; i < env_count; i++)
+        machine_free(&envs[i].machine);
+    free(envs);
+    free(actions);
+    free(results);
+    free(observations);
+    return 0;
+}
+
+/**
+ * @brief creates density_count instances, runs each for DENSITY_FRAMES and 
+ * reports the private resident memory they take, with the shared ROM layout and 
+ * with the old private 64K copies
+ * 
+ * @param rom the ROM image
+ * @return int 
+ */
+int run_density(const SharedRom *rom) {
+    int threads = batch_threads > 0 ? batch_threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    printf("density: %d instances x %d frames, %zu bytes of Machine and State8080 each\n",
+        density_count, DENSITY_FRAMES, sizeof(Machine) + sizeof(State8080));
+    if (!rom_shareable(rom))
+        printf("density: the page size does not divide the ROM area, ROM is copied per instance\n");
+
+    for (int shared = 1; shared >= 0; shared--) {
+        size_t before = private_resident_bytes();
+        double start = now_seconds();
+        Machine *machines = malloc(density_count * sizeof(Machine));
+        for (int i = 0; i < density_count; i++) {
+            if (shared)
+                machine_init(&machines[i], rom);
+            else
+                machine_init_copy(&machines[i], rom);
         }
-        if(event.key.keysym.sym == SDLK_d){ // P1 right
-            in_port_1 |= (1 << 6);
+        double created = now_seconds() - start;
+
+        ThreadPool pool;
+        pool_init(&pool, threads);
+        batch_run(&pool, machines, density_count, DENSITY_FRAMES, batch_input, NULL);
+        pool_free(&pool);
+        size_t used = private_resident_bytes() - before;
+
+        printf("%-14s %.1f KB private resident per instance, %.1f MB total, %.1f us to create one\n",
+            shared ? "shared ROM:" : "private copy:", used / 1024.0 / density_count,
+            used / 1048576.0, created * 1e6 / density_count);
+        for (int i = 0; i < density_count; i++)
+            machine_free(&machines[i]);
+        free(machines);
+    }
+    return 0;
+}
+
+/**
+ * @brief dumps the instruction trace ring when the emulator crashes
+ * 
+ * @param sig the signal that was raised
+ */
+void crash_handler(int sig) {
+    fprintf(stderr, "caught signal %d\n", sig);
+    trace_dump(machine.cpu->memory, trace_dump_count);
+    fflush(stdout);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/**
+ * @brief parses command line arguments
+ * 
+ * --headless N     run N frames without window or audio and report throughput
+ * --trace SINK     instruction trace sink, stdout or ring (needs TRACE_LEVEL=2)
+ * --trace-dump N   number of ring entries dumped on a crash
+ * --cross-check N  run N instructions on both CPU cores in lockstep and compare
+ * --video BACKEND  surface (default) or texture
+ * --speed F        emulation speed multiplier (turbo > 1, slow motion < 1)
+ * --load-state F   start from the save state in file F
+ * --save-state F   write a save state to file F on exit
+ * --rewind S       keep S seconds of rewind history (0 disables it)
+ * --record F       record the inputs of every frame to movie file F
+ * --replay F       play back the inputs in movie file F and check the final state
+ * --batch N        run N headless instances on a thread pool and report scaling
+ * --threads T      most threads used by --batch and --env (default one per core)
+ * --env N          step N agent environments with random actions and report steps/sec
+ * --density N      create N instances and report resident memory per instance
+ * --rom PATH       ROM image, or directory with invaders.rom or invaders.h/g/f/e
+ * --no-rom-check   load a ROM whose CRC32 does not match a known set
+ * --debug          stop in the console debugger before the first instruction
+ * --break ADDR     set a debugger breakpoint at hex address ADDR (repeatable)
+ * --capture-video F  write every frame to Y4M file F, or to PNG files if F is 
+ *                  a printf pattern such as frames/%06llu.png
+ * --capture-audio F  write the mixed audio to WAV file F
+ * --capture-lossless wait for the capture writer instead of dropping frames
+ * --latency        probe input latency in headless runs too, timed apart from
+ *                  the benchmark
+ * --bind KEY=ACTION  bind an SDL key name, or pad:BUTTON, to coin, p1-start, 
+ *                  p1-fire, p1-left, p1-right, p2-start, p2-fire, p2-left, 
+ *                  p2-right or tilt (repeatable)
+ */
+void parse_args(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            headless = true;
+            headless_frames = atol(argv[++i]);
         }
-        if(event.key.keysym.sym == SDLK_2) { // P2 Start
-            in_port_1 |= (1 << 1);
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "ring") == 0)
+                trace_sink = TRACE_SINK_RING;
+            else if (strcmp(argv[i], "stdout") == 0)
+                trace_sink = TRACE_SINK_STDOUT;
+            else {
+                fprintf(stderr, "unknown trace sink: %s\n", argv[i]);
+                exit(1);
+            }
         }
-        if(event.key.keysym.sym == SDLK_k){ // P2 Shoot
-            in_port_2 |= (1 << 4);
+        else if (strcmp(argv[i], "--trace-dump") == 0 && i + 1 < argc) {
+            trace_dump_count = atol(argv[++i]);
         }
-        if(event.key.keysym.sym == SDLK_j){ // P2 left
-            in_port_2 |= (1 << 5);
+        else if (strcmp(argv[i], "--video") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "texture") == 0) {
+                video_backend = VIDEO_TEXTURE;
+                present_stats.name = "present (texture)";
+            }
+            else if (strcmp(argv[i], "surface") == 0)
+                video_backend = VIDEO_SURFACE;
+            else {
+                fprintf(stderr, "unknown video backend: %s\n", argv[i]);
+                exit(1);
+            }
         }
-        if(event.key.keysym.sym == SDLK_l){ // P2 right
-            in_port_2 |= (1 << 6);
+        else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            emulation_speed = atof(argv[++i]);
         }
-       
-    }
-            
-    else if(event.type == SDL_KEYUP) {
-        if(event.key.keysym.sym == SDLK_c) { // insert coin
-            in_port_1 &= ~1;
+        else if (strcmp(argv[i], "--load-state") == 0 && i + 1 < argc) {
+            load_state_path = argv[++i];
         }
-        if(event.key.keysym.sym == SDLK_1) { // P1 Start
-            in_port_1 &= ~(1 << 2);
+        else if (strcmp(argv[i], "--save-state") == 0 && i + 1 < argc) {
+            save_state_path = argv[++i];
         }
-        if(event.key.keysym.sym == SDLK_SPACE){ // P1 Shoot
-            in_port_1 &= ~(1 << 4);
+        else if (strcmp(argv[i], "--rewind") == 0 && i + 1 < argc) {
+            rewind_seconds = atoi(argv[++i]);
         }
-        if(event.key.keysym.sym == SDLK_a){ // P1 left
-            in_port_1 &= ~(1 << 5);
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
         }
-        if(event.key.keysym.sym == SDLK_d){ // P1 right
-            in_port_1 &= ~(1 << 6);
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
         }
-        if(event.key.keysym.sym == SDLK_2) { // P2 Start
-            in_port_1 &= ~(1 << 1);
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            headless = true;
+            batch_size = atoi(argv[++i]);
         }
-        if(event.key.keysym.sym == SDLK_k){ // P2 Shoot
-            in_port_2 &= ~(1 << 4);
+        else if (strcmp(argv[i], "--env") == 0 && i + 1 < argc) {
+            headless = true;
+            env_count = atoi(argv[++i]);
         }
-        if(event.key.keysym.sym == SDLK_j){ // P2 left
-            in_port_2 &= ~(1 << 5);
+        else if (strcmp(argv[i], "--density") == 0 && i + 1 < argc) {
+            headless = true;
+            density_count = atoi(argv[++i]);
         }
-        if(event.key.keysym.sym == SDLK_l){ // P2 right
-            in_port_2 &= ~(1 << 6);
+        else if (strcmp(argv[i], "--rom") == 0 && i + 1 < argc) {
+            rom_override = argv[++i];
         }
-    }
-    printf("IN PORT: %02x\n", in_port_1);
-}
-
-/**
- * @brief renders the game video from VRAM
- * 
- * @param state the State8080 object
- */
-void render(State8080 *state) {
-    
-    // FILE *f = fopen("frame.txt", "w+");
-    surface = SDL_GetWindowSurface(window);
-    
-    bool rotated_screen[224][256];
-    bool fixed_screen[256][224];
-
-    
-    for (int y = 0; y < WIDTH; y++) {
-        for (int x = 0; x < HEIGHT; x++) {
-            // printf("INDEX: %d", y + (WIDTH - x - 1) * HEIGHT);
-            rotated_screen[y][x] = state->memory[0x2400 + (x / 8 + y * HEIGHT / 8)] & (1 << (x & 7));
-        }
-    }
-    
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            fixed_screen[y][x] = rotated_screen[x][HEIGHT - y];
-            // fprintf(f, "%c", (fixed_screen[y][x] == 1) ? 'X' : ' ');
-            // scale up
-            for(int i = y * DISPLAY_SCALE; i < (y * DISPLAY_SCALE) + DISPLAY_SCALE; i++) {
-                for(int j = x * DISPLAY_SCALE; j < (x * DISPLAY_SCALE) + DISPLAY_SCALE; j++) {
-                    set_pixel(j, i, fixed_screen[y][x] ? 0x39ff14 : 0);
-                    
-                }
+        else if (strcmp(argv[i], "--no-rom-check") == 0) {
+            rom_check = false;
+        }
+        else if (strcmp(argv[i], "--debug") == 0) {
+            debugger.pause = true;
+        }
+        else if (strcmp(argv[i], "--break") == 0 && i + 1 < argc) {
+            uint16_t address;
+            if (!parse_address(argv[++i], &address))
+                exit(1);
+            debug_set_bit(debugger.breakpoint, &debugger.breakpoint_count, address, true);
+        }
+        else if (strcmp(argv[i], "--capture-video") == 0 && i + 1 < argc) {
+            capture_video_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--capture-audio") == 0 && i + 1 < argc) {
+            capture_audio_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--capture-lossless") == 0) {
+            capture_lossless = true;
+        }
+        else if (strcmp(argv[i], "--latency") == 0) {
+            latency_probes = true;
+        }
+#ifndef NO_SDL
+        else if (strcmp(argv[i], "--bind") == 0 && i + 1 < argc) {
+            if (!input_bind(&input, argv[++i])) {
+                fprintf(stderr, "bad binding: %s\n", argv[i]);
+                exit(1);
             }
         }
-        // fprintf(f, "\n");
+#endif
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            batch_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cross-check") == 0 && i + 1 < argc) {
+            headless = true;
+            cross_check_steps = atol(argv[++i]);
+        }
+        else {
+            fprintf(stderr, "usage: %s [--headless FRAMES] [--trace stdout|ring] [--trace-dump N] [--cross-check N] [--video surface|texture] [--speed F] [--load-state FILE] [--save-state FILE] [--rewind SECONDS] [--record MOVIE] [--replay MOVIE] [--batch N] [--threads T] [--env N] [--density N] [--rom PATH] [--no-rom-check] [--debug] [--break ADDR] [--capture-video FILE] [--capture-audio FILE] [--capture-lossless] [--latency] [--bind KEY=ACTION]\n", argv[0]);
+            exit(1);
+        }
+    }
+#ifdef NO_SDL
+    headless = true;
+    if (headless_frames <= 0 && !replay_path)
+        headless_frames = 3600;
+#endif
+    if (load_state_path && (record_path || replay_path)) {
+        fprintf(stderr, "movies start from power-on and cannot be combined with --load-state\n");
+        exit(1);
     }
-    
-
-    // fclose(f);
-    SDL_UpdateWindowSurface(window);
 }
 
-void play_sound() {
-    if (sound1_ != last_sound1_) // bit changed
-	{
-		if ( (sound1_ & 0x2) && !(last_sound1_ & 0x2) )
-			play_wav_file(1);
-        if ( (sound1_ & 0x4) && !(last_sound1_ & 0x4) )
-            play_wav_file(2);
-        if ( (sound1_ & 0x8) && !(last_sound1_ & 0x8) )
-			play_wav_file(3);
-		last_sound1_ = sound1_;
-	}
-	if (sound2_ != last_sound2_)
-	{
-		if ( (sound2_ & 0x1) && !(last_sound2_ & 0x1) )
-			play_wav_file(4);
-		if ( (sound2_ & 0x2) && !(last_sound2_ & 0x2) )
-			play_wav_file(5);
-		if ( (sound2_ & 0x4) && !(last_sound2_ & 0x4) )
-			play_wav_file(6);
-		if ( (sound2_ & 0x8) && !(last_sound2_ & 0x8) )
-			play_wav_file(7);
-		if ( (sound2_ & 0x10) && !(last_sound2_ & 0x10) )
-			play_wav_file(8);
-		last_sound2_ = sound2_;
-	}
-}
-
-/**************************** MACHINE I/O FUNCTIONS ****************************/
 /**
- * @brief reads data from the specified port
+ * @brief writes the recorded movie and checks a finished replay against the
+ * state its recording ended in
  * 
- * @param port the port to read from
- * @return uint8_t 
+ * @param frames number of frames emulated
+ * @return int 0 on success, 1 if writing failed or the replay diverged
  */
-static inline uint8_t machine_in(uint8_t port) {
-    uint8_t a;    
-    switch(port)    
-    {   
-        case 1:
-            a = in_port_1;
-            break;
-        case 2:
-            a = in_port_2;
-            break;
-        case 3:    
-        {    
-            uint16_t v = (shift1<<8) | (shift0);    
-            a = ((v >> (8-shift_offset)) & 0xff);  
-            break;    
-        }    
-      
-    }    
-    return a;  
+int finish_movies(long frames) {
+    int result = 0;
+    if (record_path) {
+        // the ports now hold input for a frame that was never run
+        if (record_movie.run_count > 0) {
+            machine.in_port_1 = record_movie.runs[record_movie.run_count - 1].port_1;
+            machine.in_port_2 = record_movie.runs[record_movie.run_count - 1].port_2;
+        }
+        movie_set_hash(&record_movie, machine_hash(&machine));
+        if (!movie_write(record_path, &record_movie))
+            result = 1;
+        else
+            printf("recorded %u frames in %u runs to %s\n", record_movie.frames, record_movie.run_count, record_path);
+    }
+    if (replay_path) {
+        if (frames != replay_movie.frames || !(replay_movie.flags & MOVIE_HAS_HASH))
+            printf("replay: stopped after %ld of %u frames, final state not checked\n", frames, replay_movie.frames);
+        else if (machine_hash(&machine) == replay_movie.hash)
+            printf("replay: %u frames, final state matches the recording\n", replay_movie.frames);
+        else {
+            printf("replay: %u frames, final state %016llx DIFFERS from the recording %016llx\n",
+                replay_movie.frames, (unsigned long long) machine_hash(&machine), (unsigned long long) replay_movie.hash);
+            result = 1;
+        }
+    }
+    return result;
 }
 
-/**
- * @brief writes data to the specified port
- * 
- * @param port the port to write to
- * @param value the data to write to the port
- */
-static inline void machine_out(uint8_t port, uint8_t value) {
-    switch(port)    
-    {    
-        case 2:    
-            shift_offset = value & 0x7;    
-            break;    
-        case 3:
-            sound1_ = value;
-            break;
-        case 4:    
-            shift0 = shift1;    
-            shift1 = value;    
-            break;  
-        case 5:
-            sound2_ = value;
-            break;  
-    }    
-    play_sound();
-}
-
-int main(void) {
-    state = Init8080();
-    savestate = Init8080();
-    char *romfile = SDL_GetBasePath();
-    printf("%s\n", romfile);
-    strcat(romfile, "invaders.rom");
-    FILE *f = fopen(romfile, "rb"); // open ROM file   
+int main(int argc, char **argv) {
+#ifndef NO_SDL
+    input_init(&input); // before parse_args applies --bind
+#endif
+    parse_args(argc, argv);
+    video_init_kernel();
 
-    if (f == NULL) {
-        printf("error: Could not open invaders.rom");
+    // one read-only mapping of the ROM, shared by every machine
+    char *romfile = rom_path();
+    SharedRom rom;
+    if (!rom_load(&rom, romfile, rom_check))
         exit(1);
+    printf("ROM: %s from %s\n", rom.set ? rom.set->name : "unchecked image", romfile);
+
+    if (batch_size > 0 || env_count > 0 || density_count > 0) {
+        int result = batch_size > 0 ? run_batch(&rom) : env_count > 0 ? run_env_bench(&rom) : run_density(&rom);
+        rom_close(&rom);
+        free(romfile);
+        return result;
     }
 
-    // get file size, read it into a buffer
-    fseek(f, 0L, SEEK_END);
-    int fsize = ftell(f);
-    fseek(f, 0L, SEEK_SET);
+    machine_init(&machine, &rom);
+    machine.cpu->dirty_map = video.dirty;
+    machine.cpu->dirty_base = VRAM_START;
+    machine.debugger = &debugger;
+    if (!headless)
+        latency_probes = true;
+    if (latency_probes)
+        latency_init(&latency, &rom, !headless);
 
-    // read the program into 8080 memory
-    fread(state->memory, fsize, 1, f);
-    fclose(f);
+    if (TRACE_LEVEL >= TRACE_INSTRUCTION && trace_sink == TRACE_SINK_RING) {
+        signal(SIGSEGV, crash_handler);
+        signal(SIGABRT, crash_handler);
+        signal(SIGFPE, crash_handler);
+        signal(SIGILL, crash_handler);
+    }
+
+    if (replay_path) {
+        if (!movie_read(replay_path, &replay_movie))
+            exit(1);
+        replaying = true;
+        if (headless && headless_frames <= 0)
+            headless_frames = replay_movie.frames;
+    }
 
-    state->pc = 0; // set program counter
+    if (load_state_path) {
+        savestate_length = read_state_file(load_state_path, savestate, sizeof(savestate));
+        if (savestate_length == 0 || !load_machine(savestate, savestate_length))
+            exit(1);
+    }
 
-    bool sdl_working = init_SDL();
+    if (cross_check_steps > 0) {
+        int result = cross_check_cores(cross_check_steps);
+        machine_free(&machine);
+        rom_close(&rom);
+        free(romfile);
+        return result;
+    }
 
-    window = create_window();
+#ifndef NO_SDL
+    if (!headless) {
+        bool sdl_working = init_SDL();
+        window = create_window();
+        if (video_backend == VIDEO_TEXTURE && !create_texture_backend())
+            exit(1);
+        pacer_init(&pacer, 0, emulation_speed);
+    }
+#endif
+    if (capture_video_path || capture_audio_path) {
+        // headless runs have no device, but the mixer still renders for the WAV
+        if (capture_audio_path && headless)
+            load_sounds();
+        if (!capture_open(&capture, capture_video_path, capture_audio_path, capture_lossless))
+            exit(1);
+        capturing = true;
+    }
+    if (rewind_seconds < 0)
+        rewind_seconds = headless ? 0 : 10;
+    if (rewind_seconds > 0) {
+        rewind_enabled = true;
+        rewind_init(&history, rewind_seconds * 60, REWIND_ARENA_SIZE);
+    }
     game_running = true;
 
-    int interrupt_timing = 33333 / 2;
+    long frames = 0;
+    uint64_t start_cycles = machine.cpu->cycles;
+#ifndef NO_SDL
+    uint64_t paced_cycles = 0; // frames shown times CYCLES_PER_FRAME, unaffected by loads and rewinding
+#endif
+    double start_time = now_seconds();
 
-    // play_wav_file(1);
-    // loop through file and read
     while (game_running) {
-        
-        if(state->pc == 0x0AC2)
-            printf("MODE = %d\n", state->memory[0x20c1]);
-
-        if(state->memory[state->pc] == 0xdb) {
-            // IN instruction
-            printf("PORT: %d\n", state->memory[state->pc + 1]);
-            uint8_t port = state->memory[state->pc + 1]; 
-
-            
-            state->a = machine_in(port);  
-
-            state->pc += 2; 
-            state->cycles += 10;
-            
-        } 
-        else if (state->memory[state->pc] == 0xd3) {
-            // OUT instruction
-            
-            uint8_t port = state->memory[state->pc + 1];  
-            
-            machine_out(port, state->a); 
-
-            printf("WRITE %02x TO PORT %02X\n", state->a, port); 
-            state->pc += 2;  
-            state->cycles += 10;
-        } 
-        else 
-            emulate8080Op(state);
-        
-        
-        if(state->cycles > interrupt_timing) {
-            generate_interrupt(state, next_interrupt);
-
-            if (interrupt_timing == 33333) {
-                render(state);
-                process_input(state);
-                
-            }
-            next_interrupt = (next_interrupt == 1) ? 2 : 1;
-            interrupt_timing = (interrupt_timing == 33333 / 2) ? 33333 : 33333 / 2;
+        const int16_t *audio = NULL; // this frame's mixed samples, if any
+        uint8_t port_1 = machine.in_port_1, port_2 = machine.in_port_2; // as the last frame saw them
+        double event_time = 0; // of the input this frame sees first
+#ifndef NO_SDL
+        if (!headless) {
+            process_input(&machine);
+            if (!game_running)
+                break;
+            event_time = input.sampled_press;
         }
+#endif
+        if (rewinding) {
+            // holds the oldest frame once the history is used up
+            if (step_back() && record_path)
+                movie_unrecord(&record_movie);
+        }
+        else {
+            // a finished replay hands over to live input
+            if (replaying)
+                replaying = movie_next(&replay_movie, &machine.in_port_1, &machine.in_port_2);
+            if (record_path)
+                movie_record(&record_movie, machine.in_port_1, machine.in_port_2);
 
-        if(state->cycles >= 33333)
-            state->cycles = 0;
-        
-       
-        
+            if (latency_probes)
+                latency_frame_start(&latency, &machine, port_1, port_2, event_time > 0 ? event_time : now_seconds());
+            machine_run_frame(&machine);
+            if (latency_probes)
+                latency_frame_end(&latency, &machine);
+            if (debugger.quit)
+                game_running = false;
+            if (mixer.streaming || capture_audio_path)
+                audio = mixer_render_frame(&mixer, machine.sound_events, machine.sound_event_count, CYCLES_PER_FRAME);
+            if (rewind_enabled)
+                record_rewind_frame();
+        }
+        video_update(&video, machine.cpu->memory);
+        if (capturing)
+            capture_submit(&capture, video.framebuffer, audio);
+
+#ifndef NO_SDL
+        if (!headless) {
+            render(machine.cpu);
+            paced_cycles += CYCLES_PER_FRAME;
+            stats_add(&frame_stats, pacer_wait(&pacer, paced_cycles));
+        }
+#endif
+        frames++;
+        if (headless && frames >= headless_frames)
+            game_running = false;
     }   
 
-    return 0;
+    if (headless) {
+        // the probes' shadow frames are not the machine's, keep them out of the rate
+        report_benchmark(frames, machine.cpu->cycles - start_cycles, now_seconds() - start_time - latency.time);
+        latency_print_stats(&latency);
+        latency_free(&latency);
+    }
+#ifndef NO_SDL
+    else
+        cleanup();
+#endif
+
+    int result = 0;
+    if (capturing && !capture_close(&capture))
+        result = 1;
+    if (headless)
+        mixer_free(&mixer);
+
+    if (result == 0 && save_state_path) {
+        savestate_length = machine_save(&machine, savestate);
+        if (!write_state_file(save_state_path, savestate, savestate_length))
+            result = 1;
+    }
+    if (result == 0)
+        result = finish_movies(frames);
+
+    machine_free(&machine);
+    rom_close(&rom);
+    free(romfile);
+    return result;
 }
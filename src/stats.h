@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*  Wall-clock timing and per-frame time statistics. The most recent
+    STATS_SAMPLES frame times are kept for percentiles.
+*/
+
+#define STATS_SAMPLES 4096
+
+/**
+ * @brief returns a monotonic wall-clock timestamp in seconds
+ * 
+ * @return double 
+ */
+static inline double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct FrameStats {
+    const char *name;
+    const char *unit; // what is counted, "frames" if NULL
+    uint64_t count;
+    double total;
+    double min;
+    double max;
+    float samples[STATS_SAMPLES]; // ring of recent frame times
+} FrameStats;
+
+/**
+ * @brief records one frame time
+ * 
+ * @param stats the FrameStats object
+ * @param seconds the time the frame took
+ */
+void stats_add(FrameStats *stats, double seconds) {
+    if (stats->count == 0 || seconds < stats->min)
+        stats->min = seconds;
+    if (seconds > stats->max)
+        stats->max = seconds;
+    stats->total += seconds;
+    stats->samples[stats->count % STATS_SAMPLES] = seconds;
+    stats->count++;
+}
+
+static int compare_floats(const void *a, const void *b) {
+    float x = *(const float *) a, y = *(const float *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief prints the average, minimum, maximum and 50th/95th/99th percentile 
+ * frame times in milliseconds
+ * 
+ * @param stats the FrameStats object
+ */
+void stats_print(FrameStats *stats) {
+    if (stats->count == 0)
+        return;
+    uint32_t n = stats->count < STATS_SAMPLES ? stats->count : STATS_SAMPLES;
+    float *sorted = malloc(n * sizeof(float));
+    memcpy(sorted, stats->samples, n * sizeof(float));
+    qsort(sorted, n, sizeof(float), compare_floats);
+
+    printf("%s: %llu %s, avg %.3f ms, min %.3f ms, max %.3f ms, "
+        "p50 %.3f ms, p95 %.3f ms, p99 %.3f ms\n", stats->name,
+        (unsigned long long) stats->count, stats->unit ? stats->unit : "frames", stats->total / stats->count * 1e3,
+        stats->min * 1e3, stats->max * 1e3,
+        sorted[n / 2] * 1e3, sorted[n * 95 / 100] * 1e3, sorted[n * 99 / 100] * 1e3);
+    free(sorted);
+}
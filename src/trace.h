@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdint.h>
+
+/*  Tracing for the 8080 core.
+    TRACE_LEVEL is fixed at compile time (make TRACE_LEVEL=n):
+        0 (TRACE_OFF)          no tracing, the core pays nothing
+        1 (TRACE_IO)           IN/OUT, input and game mode changes are printed
+        2 (TRACE_INSTRUCTION)  every instruction is sent to the trace sink
+    The sink for instruction traces is chosen at runtime: stdout prints
+    the disassembly and registers of every instruction, ring keeps the
+    last TRACE_RING_SIZE instructions in a binary buffer that is dumped
+    on a crash.
+*/
+
+#define TRACE_OFF 0
+#define TRACE_IO 1
+#define TRACE_INSTRUCTION 2
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_OFF
+#endif
+
+#define TRACE_RING_SIZE 4096 // must be a power of two
+
+#define IO_TRACE(...) do { if (TRACE_LEVEL >= TRACE_IO) printf(__VA_ARGS__); } while (0)
+
+typedef enum TraceSink {
+    TRACE_SINK_STDOUT,
+    TRACE_SINK_RING
+} TraceSink;
+
+typedef struct TraceEntry {
+    uint16_t pc;
+    uint16_t sp;
+    uint8_t opcode;
+    uint8_t a;
+    uint8_t flags;
+    uint8_t b;
+    uint8_t c;
+    uint8_t d;
+    uint8_t e;
+    uint8_t h;
+    uint8_t l;
+    uint8_t pad[3];
+} TraceEntry; // 16 bytes
+
+TraceSink trace_sink = TRACE_SINK_STDOUT;
+TraceEntry trace_ring[TRACE_RING_SIZE];
+uint32_t trace_head = 0; // total number of entries ever recorded
+
+/**
+ * @brief appends an entry to the ring buffer, overwriting the oldest one
+ *
+ * @param entry the instruction to record
+ */
+static inline void trace_record(const TraceEntry *entry) {
+    trace_ring[trace_head & (TRACE_RING_SIZE - 1)] = *entry;
+    trace_head++;
+}
+
+/**
+ * @brief prints the last n recorded instructions, oldest first
+ *
+ * The disassembly is read back from memory at each recorded pc, which is
+ * exact for code running from ROM.
+ * @param memory the 8080 memory the instructions were executed from
+ * @param n the number of entries to dump
+ */
+void trace_dump(unsigned char *memory, uint32_t n) {
+    uint32_t count = trace_head < TRACE_RING_SIZE ? trace_head : TRACE_RING_SIZE;
+    if (n > count)
+        n = count;
+
+    printf("---- last %u instructions ----\n", n);
+    for (uint32_t i = trace_head - n; i != trace_head; i++) {
+        TraceEntry *entry = &trace_ring[i & (TRACE_RING_SIZE - 1)];
+        printf("\tAF $%02x%02x BC $%02x%02x DE $%02x%02x HL $%02x%02x SP %04x  ",
+            entry->a, entry->flags, entry->b, entry->c, entry->d,
+            entry->e, entry->h, entry->l, entry->sp);
+        Disassemble8080Op(memory, entry->pc);
+    }
+}
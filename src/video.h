@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define VIDEO_HAVE_X86 1
+#endif
+
+/*  Space Invaders video.
+    VRAM at 0x2400-0x3FFF holds a 1 bit per pixel image rotated 90 degrees:
+    each of the 224 screen columns is 32 bytes, bottom of the screen first,
+    bit 0 of each byte lowest. The CPU store path marks changed VRAM bytes
+    in `dirty`, and video_update only converts those bytes into the upright
+    ARGB framebuffer.
+
+    Conversion works on blocks of 8 screen columns by one VRAM byte row:
+    the 8 bytes are transposed as an 8x8 bit matrix into 8 screen rows of 8
+    pixels, which are expanded to ARGB with SSE2 or AVX2 when available.
+*/
+
+#define VRAM_START 0x2400
+#define VRAM_SIZE 0x1c00 // 224 columns of 32 bytes
+#define SCREEN_WIDTH 224
+#define SCREEN_HEIGHT 256
+#define PIXEL_ON 0x39ff14
+#define PIXEL_OFF 0
+
+#define BLOCK_COLUMNS (SCREEN_WIDTH / 8) // 28
+#define BLOCK_ROWS 32 // bytes per VRAM column
+#define BLOCK_COUNT (BLOCK_COLUMNS * BLOCK_ROWS)
+
+typedef struct Video {
+    uint32_t framebuffer[SCREEN_HEIGHT * SCREEN_WIDTH]; // upright ARGB image
+    uint8_t dirty[(0x10000 - VRAM_START) / 8]; // one bit per byte from VRAM_START, set by the CPU
+    uint16_t changed[BLOCK_COUNT]; // blocks converted by the last update, row * BLOCK_COLUMNS + column
+    uint32_t changed_count;
+    uint64_t bytes_converted; // over all updates
+    uint64_t updates;
+    bool stale; // set when VRAM was replaced wholesale, the next update converts everything
+} Video;
+
+/*  Converts the block at block column `column` and VRAM byte row `row` into
+    dst, an image of `pitch` pixels per row, with every pixel scaled up to
+    scale x scale.
+*/
+typedef void (*VideoBlockKernel)(const uint8_t *vram, int column, int row, uint32_t *dst, int pitch, int scale);
+
+/************************ BLOCK KERNELS ************************/
+
+/**
+ * @brief transposes an 8x8 bit matrix, one row per byte
+ * Bit k of byte b of the result is bit b of byte k of the input.
+ * @param x the matrix
+ * @return uint64_t
+ */
+static inline uint64_t transpose8x8(uint64_t x) {
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+/**
+ * @brief loads a block and transposes it into 8 screen rows of 8 pixels
+ * Byte b of the result is the screen row showing bit b of the VRAM bytes,
+ * bit k of it is the pixel in block column k.
+ * @param vram the start of VRAM
+ * @param column the block column
+ * @param row the VRAM byte row
+ * @return uint64_t
+ */
+static inline uint64_t load_block(const uint8_t *vram, int column, int row) {
+    const uint8_t *src = vram + column * 8 * BLOCK_ROWS + row;
+    uint64_t x = 0;
+    for (int k = 0; k < 8; k++)
+        x |= (uint64_t) src[k * BLOCK_ROWS] << (8 * k);
+    return transpose8x8(x);
+}
+
+/**
+ * @brief returns the first destination pixel of screen row b of a block
+ */
+static inline uint32_t *block_row_start(uint32_t *dst, int column, int row, int b, int pitch, int scale) {
+    int y = SCREEN_HEIGHT - 1 - (row * 8 + b);
+    return dst + (size_t) y * scale * pitch + column * 8 * scale;
+}
+
+void video_block_scalar(const uint8_t *vram, int column, int row, uint32_t *dst, int pitch, int scale) {
+    uint64_t rows = load_block(vram, column, row);
+    for (int b = 0; b < 8; b++) {
+        uint8_t bits = rows >> (8 * b);
+        uint32_t *out = block_row_start(dst, column, row, b, pitch, scale);
+        uint32_t *pixel = out;
+        for (int k = 0; k < 8; k++) {
+            uint32_t pix = ((bits >> k) & 1) ? PIXEL_ON : PIXEL_OFF;
+            for (int s = 0; s < scale; s++)
+                *pixel++ = pix;
+        }
+        for (int s = 1; s < scale; s++)
+            memcpy(out + s * pitch, out, 8 * scale * sizeof(uint32_t));
+    }
+}
+
+#ifdef VIDEO_HAVE_X86
+__attribute__((target("sse2")))
+void video_block_sse2(const uint8_t *vram, int column, int row, uint32_t *dst, int pitch, int scale) {
+    const __m128i mask_lo = _mm_set_epi32(8, 4, 2, 1);
+    const __m128i mask_hi = _mm_set_epi32(128, 64, 32, 16);
+    const __m128i on = _mm_set1_epi32(PIXEL_ON);
+    const __m128i off = _mm_set1_epi32(PIXEL_OFF);
+    uint64_t rows = load_block(vram, column, row);
+
+    for (int b = 0; b < 8; b++) {
+        __m128i bits = _mm_set1_epi32((uint8_t) (rows >> (8 * b)));
+        __m128i set_lo = _mm_cmpeq_epi32(_mm_and_si128(bits, mask_lo), mask_lo);
+        __m128i set_hi = _mm_cmpeq_epi32(_mm_and_si128(bits, mask_hi), mask_hi);
+        __m128i lo = _mm_or_si128(_mm_and_si128(set_lo, on), _mm_andnot_si128(set_lo, off));
+        __m128i hi = _mm_or_si128(_mm_and_si128(set_hi, on), _mm_andnot_si128(set_hi, off));
+        uint32_t *out = block_row_start(dst, column, row, b, pitch, scale);
+
+        if (scale == 1) {
+            _mm_storeu_si128((__m128i *) out, lo);
+            _mm_storeu_si128((__m128i *) (out + 4), hi);
+            continue;
+        }
+        if (scale == 2) {
+            for (int s = 0; s < 2; s++, out += pitch) {
+                _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi32(lo, lo));
+                _mm_storeu_si128((__m128i *) (out + 4), _mm_unpackhi_epi32(lo, lo));
+                _mm_storeu_si128((__m128i *) (out + 8), _mm_unpacklo_epi32(hi, hi));
+                _mm_storeu_si128((__m128i *) (out + 12), _mm_unpackhi_epi32(hi, hi));
+            }
+            continue;
+        }
+        uint32_t pixels[8];
+        _mm_storeu_si128((__m128i *) pixels, lo);
+        _mm_storeu_si128((__m128i *) (pixels + 4), hi);
+        for (int k = 0; k < 8; k++)
+            for (int s = 0; s < scale; s++)
+                out[k * scale + s] = pixels[k];
+        for (int s = 1; s < scale; s++)
+            memcpy(out + s * pitch, out, 8 * scale * sizeof(uint32_t));
+    }
+}
+
+__attribute__((target("avx2")))
+void video_block_avx2(const uint8_t *vram, int column, int row, uint32_t *dst, int pitch, int scale) {
+    const __m256i mask = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+    const __m256i on = _mm256_set1_epi32(PIXEL_ON);
+    const __m256i off = _mm256_set1_epi32(PIXEL_OFF);
+    const __m256i first_half = _mm256_set_epi32(3, 3, 2, 2, 1, 1, 0, 0);
+    const __m256i second_half = _mm256_set_epi32(7, 7, 6, 6, 5, 5, 4, 4);
+    uint64_t rows = load_block(vram, column, row);
+
+    for (int b = 0; b < 8; b++) {
+        __m256i bits = _mm256_set1_epi32((uint8_t) (rows >> (8 * b)));
+        __m256i set = _mm256_cmpeq_epi32(_mm256_and_si256(bits, mask), mask);
+        __m256i pixels = _mm256_blendv_epi8(off, on, set);
+        uint32_t *out = block_row_start(dst, column, row, b, pitch, scale);
+
+        if (scale == 1) {
+            _mm256_storeu_si256((__m256i *) out, pixels);
+            continue;
+        }
+        if (scale == 2) {
+            __m256i left = _mm256_permutevar8x32_epi32(pixels, first_half);
+            __m256i right = _mm256_permutevar8x32_epi32(pixels, second_half);
+            for (int s = 0; s < 2; s++, out += pitch) {
+                _mm256_storeu_si256((__m256i *) out, left);
+                _mm256_storeu_si256((__m256i *) (out + 8), right);
+            }
+            continue;
+        }
+        uint32_t expanded[8];
+        _mm256_storeu_si256((__m256i *) expanded, pixels);
+        for (int k = 0; k < 8; k++)
+            for (int s = 0; s < scale; s++)
+                out[k * scale + s] = expanded[k];
+        for (int s = 1; s < scale; s++)
+            memcpy(out + s * pitch, out, 8 * scale * sizeof(uint32_t));
+    }
+}
+#endif
+
+VideoBlockKernel video_kernel = video_block_scalar;
+const char *video_kernel_name = "scalar";
+
+/**
+ * @brief picks the fastest block kernel the CPU supports
+ *
+ */
+void video_init_kernel() {
+#ifdef VIDEO_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        video_kernel = video_block_avx2;
+        video_kernel_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        video_kernel = video_block_sse2;
+        video_kernel_name = "sse2";
+    }
+#endif
+}
+
+/**
+ * @brief converts the whole screen from VRAM
+ *
+ * @param kernel the block kernel to use
+ * @param vram the start of VRAM
+ * @param dst the destination image
+ * @param pitch pixels per destination row
+ * @param scale integer scale factor
+ */
+void video_convert_frame(VideoBlockKernel kernel, const uint8_t *vram, uint32_t *dst, int pitch, int scale) {
+    for (int row = 0; row < BLOCK_ROWS; row++)
+        for (int column = 0; column < BLOCK_COLUMNS; column++)
+            kernel(vram, column, row, dst, pitch, scale);
+}
+
+/************************ FRAMEBUFFER ************************/
+
+/**
+ * @brief brings the framebuffer up to date with VRAM
+ * The first update and the one after VRAM was marked stale convert the 
+ * whole screen, others only the blocks
+ * holding a byte the CPU changed since the previous update. The converted
+ * blocks are left in video->changed.
+ * @param video the Video object
+ * @param memory the 8080 memory
+ * @return uint32_t number of VRAM bytes converted
+ */
+uint32_t video_update(Video *video, const uint8_t *memory) {
+    const uint8_t *vram = memory + VRAM_START;
+    bool full = video->updates == 0 || video->stale;
+    video->stale = false;
+    uint8_t block_dirty[BLOCK_COUNT] = {0};
+
+    // one dirty map byte covers 8 consecutive bytes of a VRAM column
+    for (int i = 0; i < VRAM_SIZE / 8; i++) {
+        uint8_t bits = video->dirty[i];
+        if (bits == 0)
+            continue;
+        video->dirty[i] = 0;
+        int column = (i * 8) >> 5 >> 3;
+        int row = (i * 8) & 31;
+        for (int b = 0; b < 8; b++)
+            if (bits & (1 << b))
+                block_dirty[(row + b) * BLOCK_COLUMNS + column] = 1;
+    }
+
+    video->changed_count = 0;
+    for (int n = 0; n < BLOCK_COUNT; n++) {
+        if (!full && !block_dirty[n])
+            continue;
+        video_kernel(vram, n % BLOCK_COLUMNS, n / BLOCK_COLUMNS, video->framebuffer, SCREEN_WIDTH, 1);
+        video->changed[video->changed_count++] = n;
+    }
+
+    video->bytes_converted += video->changed_count * 8;
+    video->updates++;
+    return video->changed_count * 8;
+}
+
+/**
+ * @brief prints how many VRAM bytes had to be converted per frame
+ *
+ * @param video the Video object
+ */
+void video_print_stats(Video *video) {
+    if (video->updates == 0)
+        return;
+    double average = (double) video->bytes_converted / video->updates;
+    printf("video: %.1f of %d VRAM bytes converted per frame (%.1f%%), %s kernel\n",
+        average, VRAM_SIZE, 100.0 * average / VRAM_SIZE, video_kernel_name);
+}
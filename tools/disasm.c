@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/Disassemble8080.h"
+#include "../src/rom.h"
+
+/*  Dumps the whole ROM as a listing: address, bytes and instruction, with
+    a label on every address that is the target of a jump (L_xxxx) or of
+    a call or restart (SUB_xxxx), and the label of the target next to
+    each jump and call. The ROM is decoded in one linear sweep, so tables
+    and text in it show up as instructions, and targets that land inside
+    another instruction are listed at the end.
+
+        disasm [--no-rom-check] [ROM]
+
+    ROM is an image or a directory, as for the emulator's --rom.
+*/
+
+static uint8_t jump_target[ROM_SIZE];
+static uint8_t call_target[ROM_SIZE];
+static uint8_t boundary[ROM_SIZE];
+
+static void label(char *buf, uint16_t address) {
+    sprintf(buf, "%s_%04x", call_target[address] ? "SUB" : "L", address);
+}
+
+int main(int argc, char **argv) {
+    const char *path = "invaders.rom";
+    bool check = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-rom-check") == 0)
+            check = false;
+        else if (argv[i][0] != '-')
+            path = argv[i];
+        else {
+            fprintf(stderr, "usage: %s [--no-rom-check] [ROM]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    SharedRom rom;
+    if (!rom_load(&rom, path, check))
+        return 1;
+    // instructions at the end may read past the ROM
+    uint8_t code[ROM_SIZE + 2] = {0};
+    memcpy(code, rom.data, ROM_SIZE);
+
+    for (int pc = 0; pc < ROM_SIZE; ) {
+        uint16_t target;
+        DisasmFlow flow = disassemble8080_target(&code[pc], &target);
+        if (flow != DISASM_NONE && target < ROM_SIZE) {
+            if (flow == DISASM_JUMP)
+                jump_target[target]++;
+            else
+                call_target[target]++;
+        }
+        boundary[pc] = 1;
+        pc += DISASM_OPS[code[pc]].length;
+    }
+
+    printf("; %s, %s\n", path, rom.set ? rom.set->name : "unchecked image");
+    char text[DISASM_TEXT_SIZE], name[16];
+    for (int pc = 0; pc < ROM_SIZE; ) {
+        if (jump_target[pc] || call_target[pc]) {
+            label(name, pc);
+            printf("\n%s:\n", name);
+        }
+        int length = disassemble8080(&code[pc], text);
+        char bytes[12] = "";
+        for (int i = 0; i < length; i++)
+            sprintf(bytes + i * 3, "%02x ", code[pc + i]);
+        printf("%04x  %-9s  ", pc, bytes);
+
+        uint16_t target;
+        if (disassemble8080_target(&code[pc], &target) != DISASM_NONE && target < ROM_SIZE) {
+            label(name, target);
+            printf("%-18s; %s\n", text, name);
+        }
+        else
+            printf("%s\n", text);
+        pc += length;
+    }
+
+    bool header = false;
+    for (int address = 0; address < ROM_SIZE; address++) {
+        if ((jump_target[address] || call_target[address]) && !boundary[address]) {
+            if (!header)
+                printf("\n; targets inside other instructions (data, or code the sweep misaligned):\n");
+            header = true;
+            label(name, address);
+            printf(";   %s\n", name);
+        }
+    }
+    rom_close(&rom);
+    return 0;
+}